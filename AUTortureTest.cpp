@@ -5,10 +5,32 @@
 //
 
 #include "AUTortureTest.h"
+#include "AUValAllocProfile.h"
+#include "AUValCheckpoint.h"
+#include "AUValChildProcess.h"
+#include "AUValCostHistory.h"
+#include "AUValFootprint.h"
+#include "AUValGuardedBuffer.h"
+#include "AUValOptions.h"
+#include "AUValRenderMemory.h"
+#include "AUValWatchdog.h"
+#include "FakeNew.h"
+#include "MemoryStats.h"
+#include "RunningStats.h"
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <execinfo.h>
+#include <map>
+#include <memory>
+#include <set>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <thread>
 #include <time.h>
 
 #define DP_VERSION 0
@@ -20,6 +42,95 @@ using namespace std;
 namespace
 {
     const int kTimesToRepeatTests = 5;
+
+    // in a tiered schedule, every test in one tier runs before any test in the next.
+    enum AUTestTier
+    {
+        kTierSmoke,         // cheap probes that catch the most common failures
+        kTierStructural,    // the rest of the property and parameter inspection
+        kTierRender,        // needs a configured, rendering instance
+        kTierStress,        // slow, and only worth it once everything else passes
+
+        kNumTiers
+    };
+
+    // per-test settings.  Tests that aren't listed get the defaults.
+    // "SetUp" and "TearDown" cover creating and destroying the shared instance.
+    struct AUTestTraits
+    {
+        const char* name;
+        AUTestTier tier;
+        double timeoutSeconds;      // watchdog budget for a single run of the test
+        bool timingSensitive;       // repeated until its timing settles in adaptive mode
+        bool extra;                 // slow or noisy, so only run (once) if named in extra_tests
+    };
+
+    const AUTestTraits kTestTraits[] =
+    {
+        { "SetUp",                      kTierSmoke,         300,    false, false },
+        { "TearDown",                   kTierSmoke,         120,    false, false },
+        { "TestComponentVersion",       kTierSmoke,         60,     false, false },
+        { "InspectLatency",             kTierSmoke,         60,     false, false },
+        { "InspectBusAndChannelInfo",   kTierSmoke,         60,     false, false },
+        { "InspectClassInfo",           kTierStructural,    60,     false, false },
+        { "InspectPresetInfo",          kTierStructural,    60,     false, false },
+        { "InspectParameterInfo",       kTierStructural,    60,     false, false },
+        { "InspectUIComponentList",     kTierStructural,    60,     false, false },
+        { "MakeAndDeleteListener",      kTierStructural,    60,     false, false },
+        { "InspectStreamFormat",        kTierStructural,    120,    true,  false },
+        { "TestSchedulingAbility",      kTierRender,        120,    true,  false },
+        { "RenderPageFaults",           kTierRender,        120,    false, true },
+        { "ReinitializeInstance",       kTierStress,        300,    true,  false },
+        { "LeakCheckLifecycle",         kTierStress,        600,    false, true },
+        { "FootprintScaling",           kTierStress,        600,    false, true },
+        { "RenderMemoryPolicies",       kTierStress,        600,    false, true },
+        { "ParameterSweep",             kTierStress,        600,    false, true },
+    };
+
+    const AUTestTraits* findTestTraits( const string& testName )
+    {
+        for ( const AUTestTraits& traits : kTestTraits )
+        {
+            if ( testName == traits.name )
+                return &traits;
+        }
+        return nullptr;
+    }
+
+    double GetTestTimeout( const string& testName )
+    {
+        const AUValOptions& options = GetAUValOptions();
+
+        auto iter = options.testTimeouts.find( testName );
+        if ( iter != options.testTimeouts.end() )
+            return iter->second;
+
+        const AUTestTraits* traits = findTestTraits( testName );
+        return traits ? traits->timeoutSeconds : options.testTimeout;
+    }
+
+    AUTestTier GetTestTier( const string& testName )
+    {
+        const AUTestTraits* traits = findTestTraits( testName );
+        return traits ? traits->tier : kTierStructural;
+    }
+
+    // a timing-sensitive test needs a few runs before its timing means anything.
+    const uint32_t kMinTimedRepetitions = 3;
+
+    // in adaptive mode, each test is instantiated once and repeats itself as needed.
+    int GetTimesToRepeatTests()
+    {
+        return GetAUValOptions().adaptiveRepeat ? 1 : kTimesToRepeatTests;
+    }
+
+    // since we do each test multiple times, each test has "/N" appended to it
+    // to indicate which iteration it is.  This strips it back off.
+    string baseTestName( const ::testing::TestInfo& testInfo )
+    {
+        string testName = testInfo.name();
+        return testName.substr(0, testName.find_last_of('/'));
+    }
     
     class InitializedAudioUnit : public AudioUnits::Base
     {
@@ -46,6 +157,36 @@ namespace
             bool wasInitialized;
     };
 
+    // prints the allocation problems found since the last call, and fails the
+    // current test (or the set up or tear down) if the options say to.
+    void reportAllocProblems()
+    {
+        static uint64_t reported = 0;
+        uint64_t count = FakeNewProblemCount();
+        if ( count == reported )
+            return;
+
+        for ( uint64_t i = reported; i < count; ++i )
+        {
+            FakeNewProblem problem;
+            if ( not FakeNewGetProblem( i, problem ) )
+                continue;
+
+            printf( "allocation problem in %s: %s (%p)\n", problem.context, FakeNewProblemDescription( problem.kind ), problem.address );
+            char** symbols = backtrace_symbols( problem.frames, problem.numFrames );
+            for ( int frame = 0; symbols and frame < problem.numFrames; ++frame )
+                printf( "    %s\n", symbols[frame] );
+            free( symbols );
+        }
+        if ( count > kFakeNewMaxProblems and reported < count )
+            printf( "(only the first %d allocation problems are shown)\n", kFakeNewMaxProblems );
+        fflush( stdout );
+
+        if ( GetAUValOptions().allocDiagnostics == AUValOptions::kAllocDiagnosticsFail )
+            ADD_FAILURE() << (count - reported) << " allocation problems";
+        reported = count;
+    }
+
     // we keep a AU instance in globals so we don't have to recreate it for every test case.
     // (recreating a AU can be prohibitively slow for some AUs)
     class Globals : public ::testing::Environment
@@ -53,29 +194,49 @@ namespace
         public:
             Globals(AudioComponentDescription cd) :
                 cd(std::move(cd)),
-                unauthorized(false)
+                unauthorized(false),
+                keepInstance(false)
             {}
         
             void SetUp()
             {
+                // a tiered schedule runs the tests in several passes, sharing one instance.
+                if ( audioUnit )
+                    return;
+
+                FakeNewSetContext("SetUp");
+
                 // force "requires init" if it's a non-apple version one component.
                 auto version = AudioUnits::GetComponentVersion(cd);
 
                 if ( (not gRequiresInit) and (version.hasValue()) and *version == 1 and cd.componentManufacturer != 'appl')
                     gRequiresInit = true;
 
+                // the first instance in the process also pays for whatever the plug-in
+                // sets up once; FootprintScaling reports it.
+                FakeNewEnableProfiling(true);
+                AUValFootprint::Sample before = AUValFootprint::Measure();
                 audioUnit.reset(new InitializedAudioUnit(cd));
+                firstInstance = AUValFootprint::Measure() - before;
+                FakeNewEnableProfiling(GetAUValOptions().allocProfile);
+
+                reportAllocProblems();
             }
         
             void TearDown()
             {
                 // we have to delete everything that we created in SetUp here.
-                audioUnit.reset();
+                FakeNewSetContext("TearDown");
+                if ( not keepInstance )
+                    audioUnit.reset();
+                reportAllocProblems();
             }
         
             AudioComponentDescription cd;
             bool unauthorized;
+            bool keepInstance;      // set while more passes of a tiered schedule are to come
             shared_ptr<InitializedAudioUnit> audioUnit;
+            AUValFootprint::Sample firstInstance;
     };
     
     // owned by gtest
@@ -87,8 +248,9 @@ namespace
         {
             f();
         }
-        catch(int32_t errorCode)
+        catch(const AudioUnits::AudioUnitError& error)
         {
+            int32_t errorCode = error.code();
             if ( errorCode == kAudioUnitErr_Uninitialized )
             {
                 // try again, with initialization.
@@ -97,6 +259,7 @@ namespace
                     gRequiresInit = true;
                     globals->audioUnit.reset(new InitializedAudioUnit(globals->cd));
                     HandleErrors(f);
+                    return;
                 }
             }
 
@@ -106,7 +269,11 @@ namespace
                 FAIL() << " unauthorized.";
             }
             
-            FAIL()<<"AU Error:"<<errorCode;
+            FAIL()<<"AU Error:"<<errorCode<<" in "<<error.where().name<<" line "<<error.where().line;
+        }
+        catch(const std::exception& e)
+        {
+            FAIL()<<e.what();
         }
         catch(...)
         {
@@ -124,12 +291,64 @@ namespace
         {}
 
     protected:
+        virtual void SetUp()
+        {
+            reportAllocProblems();
+            FakeNewSetContext(::testing::UnitTest::GetInstance()->current_test_info()->name());
+        }
+        virtual void TearDown()
+        {
+            reportAllocProblems();
+        }
+
         AudioComponentDescription& cd;
         shared_ptr<InitializedAudioUnit>& audioUnit;
     };
 
-    #define BEGIN_AUTEST(x) TEST_P(AUTest, x) { HandleErrors([&](){
-    #define END_AUTEST });}
+    // seconds spent so far on repeating timing-sensitive tests, across all tests.
+    double gRepeatSecondsUsed = 0;
+
+    // runs a test once, or in adaptive mode, until its timing settles.
+    void RunRepetitions(const char* testName, std::function<void ()> f)
+    {
+        const AUValOptions& options = GetAUValOptions();
+        const AUTestTraits* traits = findTestTraits(testName);
+        if ( not options.adaptiveRepeat or not traits or not traits->timingSensitive )
+        {
+            f();
+            return;
+        }
+
+        RunningStats stats;
+        for (;;)
+        {
+            // the watchdog budget is for a single run, so restart the clock for each one.
+            if ( stats.count() > 0 and options.watchdog )
+                AUValWatchdog::Arm(testName, GetTestTimeout(testName));
+
+            auto start = chrono::steady_clock::now();
+            f();
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            stats.add(seconds);
+            gRepeatSecondsUsed += seconds;
+
+            if ( ::testing::Test::HasFailure() )
+                break;
+            if ( gRepeatSecondsUsed >= options.repeatBudget )
+                break;
+            if ( stats.count() >= kMinTimedRepetitions and stats.relativeHalfWidth95() <= options.repeatPrecision )
+                break;
+            if ( stats.count() >= uint32_t(options.maxRepetitions) )
+                break;
+        }
+
+        ::testing::Test::RecordProperty("repetitions", int(stats.count()));
+        ::testing::Test::RecordProperty("mean_ms", int(stats.mean() * 1000));
+    }
+
+    #define BEGIN_AUTEST(x) TEST_P(AUTest, x) { RunRepetitions(#x, [&](){ HandleErrors([&](){
+    #define END_AUTEST });});}
     
     BEGIN_AUTEST(ReinitializeInstance)
         audioUnit.reset(new InitializedAudioUnit(cd));
@@ -243,51 +462,16 @@ namespace
     END_AUTEST
     
     BEGIN_AUTEST(InspectParameterInfo)
-        std::vector<AudioUnitParameterID> ids = audioUnit->getParameterList( kAudioUnitScope_Global );
+        const AudioUnits::ParameterCatalog& params = audioUnit->getParameterCatalog();
         
         int32_t numBlank = 0;
         
-        for ( const AudioUnitParameterID& id : ids)
+        for ( size_t i = 0; i < params.size(); ++i )
         {
-            char nameStr[100];
-            nameStr[0] = 0; // starts off blank.
-            
-            AudioUnitParameterInfo info;
-            info.cfNameString = NULL;
-            audioUnit->getParameterInfo( kAudioUnitScope_Global, id, info );
-
-            if (( info.flags & kAudioUnitParameterFlag_HasCFNameString ) and (info.cfNameString != nullptr))
-            {
-                CFStringGetCString( info.cfNameString, nameStr, 99,  kCFStringEncodingUTF8 );
-            }
-            else if (info.name != nullptr)
-            {
-                strcpy( nameStr, info.name );
-            }
-            
-            if ( strlen( nameStr) == 0 )
+            if ( params.name( i )[0] == 0 )
             {
                 numBlank++;
             }
-
-            if ( info.unit == kAudioUnitParameterUnit_Indexed )
-            {
-                CFArrayRef strings;
-                audioUnit->getParameterValueStrings( kAudioUnitScope_Global, id, strings );
-                if ( strings )
-                {
-                    int num = CFArrayGetCount(strings);
-                    char presetvalstr[100];
-                    for ( int j = 0; j < num; ++j )
-                    {
-                        CFStringGetCString( (CFStringRef)CFArrayGetValueAtIndex(strings, j), presetvalstr, 99,  kCFStringEncodingUTF8 );
-                    }
-                    CFRelease( strings );
-                }
-                else
-                {
-                }
-            }
         }
         if ( numBlank > 0 )
         {
@@ -295,12 +479,28 @@ namespace
         }
     END_AUTEST
     
+    // the probes below ask for properties without throwing.  A property the
+    // plug-in doesn't have is fine; any other failure to get one isn't.
+    template<typename T>
+    bool expectProperty( const expected<T, OSStatus>& value, const char* what, bool mayBeMissing = false )
+    {
+        if ( value.hasValue() )
+            return true;
+        if ( not (mayBeMissing and value.error() == kAudioUnitErr_InvalidProperty) )
+            ADD_FAILURE() << "AU Error:" << value.error() << " getting the " << what;
+        return false;
+    }
+
     BEGIN_AUTEST(InspectBusAndChannelInfo)
         std::vector<AUChannelInfo> supChans = audioUnit->getSupportedNumChannels();
+        if ( not audioUnit->IsASynth() )
+            expectProperty( audioUnit->tryGetNumBusses( kAudioUnitScope_Input ), "number of input busses" );
+        expectProperty( audioUnit->tryGetNumBusses( kAudioUnitScope_Output ), "number of output busses" );
     END_AUTEST
     
     BEGIN_AUTEST(InspectLatency)
-        audioUnit->getLatency();
+        expectProperty( audioUnit->tryGetLatency(), "latency", true );
+        expectProperty( audioUnit->tryGetTail(), "tail time", true );
     END_AUTEST
     
     BEGIN_AUTEST(InspectUIComponentList)
@@ -313,11 +513,13 @@ namespace
 
     static void inspectOneStreamFormat( shared_ptr<InitializedAudioUnit>& base, int scope  )
     {
-        AudioStreamBasicDescription desc;
-        base->getStreamFormat( scope, 0, desc );
+        expected<AudioStreamBasicDescription, OSStatus> desc = base->tryGetStreamFormat( scope, 0 );
+        if ( not expectProperty( desc, scope == kAudioUnitScope_Input ? "input stream format" : "output stream format" ) )
+            return;
+
         if ( base->IsInitialized() )
             base->Uninitialize();
-        base->setStreamFormat( scope, 0, desc );
+        base->setStreamFormat( scope, 0, *desc );
         base->Initialize();
     }
     
@@ -348,6 +550,88 @@ namespace
     }
 
     const int kTestFrames = 2048;
+    const double kTestSampleRate = 44100;
+
+    // the output buffers for render, one mono buffer per channel, from memory
+    // allocated under the given policy.  With the guard_buffers option, each
+    // one ends against a guard page instead.
+    class RenderBuffers
+    {
+    public:
+        RenderBuffers( int numBuffers, int frames, RenderMemoryPolicy policy = kRenderMemoryHeap ) :
+            fListBuffer( sizeof( AudioBufferList ) + (sizeof( AudioBuffer ) * numBuffers) ),
+            fCapacity( frames ),
+            fSamples( NULL )
+        {
+            list()->mNumberBuffers = numBuffers;
+            if ( GetAUValOptions().guardBuffers )
+            {
+                for ( int i = 0; i < numBuffers; ++i )
+                    fGuarded.push_back( unique_ptr<AUValGuardedBuffer>( new AUValGuardedBuffer( sizeof( float ) * frames ) ) );
+            }
+            else
+            {
+                fMemory.reset( new AUValRenderMemory( sizeof( float ) * max( numBuffers * frames, 1 ), policy ) );
+                fSamples = static_cast<float*>( fMemory->Data() );
+            }
+
+            for ( int i = 0; i < numBuffers; ++i )
+                list()->mBuffers[i].mNumberChannels = 1;
+            setFrames( frames );
+
+            // with prefault_buffers, the host's buffers are touched and wired
+            // now, so no page fault in render is ours.
+            if ( GetAUValOptions().prefaultBuffers )
+            {
+                for ( int i = 0; i < numBuffers; ++i )
+                {
+                    AudioBuffer& buffer = list()->mBuffers[i];
+                    memset( buffer.mData, 0, buffer.mDataByteSize );
+                    if ( mlock( buffer.mData, buffer.mDataByteSize ) == 0 )
+                        fLocked.push_back( buffer );
+                }
+            }
+        }
+
+        ~RenderBuffers()
+        {
+            for ( const AudioBuffer& buffer : fLocked )
+                munlock( buffer.mData, buffer.mDataByteSize );
+        }
+
+        AudioBufferList* list() { return reinterpret_cast<AudioBufferList*>( fListBuffer.data() ); }
+        bool policyApplied() const { return fMemory and fMemory->Applied(); }
+
+        // no more than the number of frames the buffers were made with.
+        void setFrames( int frames )
+        {
+            for ( UInt32 i = 0; i < list()->mNumberBuffers; ++i )
+            {
+                AudioBuffer& buffer = list()->mBuffers[i];
+                buffer.mDataByteSize = sizeof( float ) * frames;
+                if ( fGuarded.empty() )
+                    buffer.mData = &fSamples[i * fCapacity];
+                else
+                    buffer.mData = fGuarded[i]->Place( buffer.mDataByteSize );
+            }
+        }
+
+        // an overrun faults on the spot, but a write in front of a buffer is only
+        // found by looking.  Call after rendering.
+        void checkCanaries()
+        {
+            for ( size_t i = 0; i < fGuarded.size(); ++i )
+                EXPECT_TRUE( fGuarded[i]->CanariesIntact() ) << "the plug-in wrote outside render buffer " << i;
+        }
+
+    private:
+        vector<char> fListBuffer;
+        int fCapacity;      // in frames
+        unique_ptr<AUValRenderMemory> fMemory;
+        float* fSamples;
+        vector<unique_ptr<AUValGuardedBuffer> > fGuarded;
+        vector<AudioBuffer> fLocked;
+    };
 
     void setupTestStreamFormat( shared_ptr<InitializedAudioUnit>& aunt, int32_t& numIn, int32_t& numOut )
     {
@@ -363,7 +647,7 @@ namespace
         
         aunt->getStreamFormat( kAudioUnitScope_Output, 0, description );
         
-        description.mSampleRate = 44100;
+        description.mSampleRate = kTestSampleRate;
         description.mFormatID = kAudioFormatLinearPCM;
         description.mFormatFlags = kAudioFormatFlagsNativeFloatPacked | kLinearPCMFormatFlagIsNonInterleaved;       //  flags specific to each format
         description.mBytesPerPacket = sizeof ( float ); 
@@ -388,41 +672,29 @@ namespace
         aunt->setMaxFramesPerSlice( kTestFrames );
     }
 
-    bool getAParamForScheduleTest( std::vector<AudioUnitParameterID>& ids, shared_ptr<InitializedAudioUnit>& audioUnit, AudioUnitParameterID& id, Float32& minVal, Float32& maxVal, bool& ramps )
+    // prefers a parameter that can ramp, and otherwise takes the first one.
+    bool getAParamForScheduleTest( const AudioUnits::ParameterCatalog& params, AudioUnitParameterID& id, Float32& minVal, Float32& maxVal, bool& ramps )
     {
-        int32_t firstAuto = -1;
+        if ( params.empty() )
+            return false;
+
+        const vector<AudioUnitParameterOptions>& flags = params.flags();
+        size_t chosen = 0;
         ramps = false;
-        try
+        for ( size_t i = 0; i < flags.size(); ++i )
         {
-            for ( int i = 0; i < ids.size(); ++i )
+            if ( (flags[i] & kAudioUnitParameterFlag_CanRamp) != 0 )
             {
-                AudioUnitParameterInfo itsInfo;
-                itsInfo.cfNameString = NULL;
-                itsInfo.name[0] = 0;
-                itsInfo.flags = 0;
-
-                audioUnit->getParameterInfo( kAudioUnitScope_Global, ids[i], itsInfo );
-
-                if ( (itsInfo.flags & kAudioUnitParameterFlag_CanRamp) != 0 )
-                {
-                    id = ids[i];
-                    minVal = itsInfo.minValue;
-                    maxVal = itsInfo.maxValue;
-                    ramps = true;
-                    return true;
-                }
-                else if ( firstAuto == -1 )
-                {
-                    firstAuto = id = ids[i];
-                    minVal = itsInfo.minValue;
-                    maxVal = itsInfo.maxValue;
-                }           
+                chosen = i;
+                ramps = true;
+                break;
             }
-        }   
-        catch(...)
-        {
         }
-        return firstAuto != -1;
+
+        id = params.id( chosen );
+        minVal = params.minValue( chosen );
+        maxVal = params.maxValue( chosen );
+        return true;
     }
     
     // Dummy defaults for our host callbacks. Turns out some plug-ins (such as
@@ -512,8 +784,7 @@ namespace
     } // anonymous namespace
 
     BEGIN_AUTEST(TestSchedulingAbility)
-        std::vector<AudioUnitParameterID> ids = audioUnit->getParameterList( kAudioUnitScope_Global );
-        if ( ids.size() == 0 ) return;
+        if ( audioUnit->getParameterCatalog().empty() ) return;
         
         bool wasInited = audioUnit->IsInitialized();
         if ( audioUnit->IsInitialized() )
@@ -527,16 +798,7 @@ namespace
         AUHostCallbackStruct info = { &gHostData, GetBeatAndTempoProc, GetMusicalTimeLocationProc, GetTransportStateProc };
         audioUnit->setCallbacks(info);
         
-        vector<char> fBufferListBuffer(sizeof( AudioBufferList ) + (sizeof(AudioBuffer) * numOuts));
-        AudioBufferList* fBufferList = reinterpret_cast<AudioBufferList*>(fBufferListBuffer.data());
-
-        fBufferList->mNumberBuffers = numOuts;
-        for ( int i = 0; i < numOuts; ++i )
-        {
-            fBufferList->mBuffers[i].mNumberChannels = 1;
-            fBufferList->mBuffers[i].mDataByteSize = sizeof( float ) * kTestFrames; 
-            fBufferList->mBuffers[i].mData = new float[kTestFrames];
-        }
+        RenderBuffers buffers( numOuts, kTestFrames );
 
         try
         {
@@ -545,16 +807,15 @@ namespace
             timestamp.mSampleTime = 0;
             timestamp.mFlags = kAudioTimeStampSampleTimeValid;
 
-            audioUnit->render( actionFlags, timestamp, 0, kTestFrames, fBufferList );   
+            audioUnit->render( actionFlags, timestamp, 0, kTestFrames, buffers.list() );   
+            buffers.checkCanaries();
 
-            int32_t smallBuf = sizeof( float ) * (kTestFrames / 4);
-            for ( int i = 0; i < numOuts; ++i )
-                fBufferList->mBuffers[i].mDataByteSize = smallBuf;  
+            buffers.setFrames( kTestFrames / 4 );
 
             AudioUnitParameterID id;
             Float32 minVal, maxVal;
             bool ramps;
-            if ( getAParamForScheduleTest( ids, audioUnit, id, minVal,  maxVal, ramps ) )
+            if ( getAParamForScheduleTest( audioUnit->getParameterCatalog(), id, minVal,  maxVal, ramps ) )
             {
                 AudioUnitParameterEvent thisParam;
                 thisParam.scope = kAudioUnitScope_Global;
@@ -582,13 +843,12 @@ namespace
             timestamp.mSampleTime = kTestFrames;
             timestamp.mFlags = kAudioTimeStampSampleTimeValid;
             actionFlags = 0;
-            audioUnit->render( actionFlags, timestamp, 0, kTestFrames / 4, fBufferList );   
+            audioUnit->render( actionFlags, timestamp, 0, kTestFrames / 4, buffers.list() );   
+            buffers.checkCanaries();
         }
         catch(...)
         {
         }
-        for ( int i = 0; i < numOuts; ++i )
-            delete [] (float*) fBufferList->mBuffers[i].mData;
             
         audioUnit->clearCallbacks();
 
@@ -601,7 +861,472 @@ namespace
             audioUnit->Initialize();
     END_AUTEST
 
-    INSTANTIATE_TEST_CASE_P(AUTest, AUTest, ::testing::Range(0, kTimesToRepeatTests));
+    // the cycles before this are left out of the fit; plug-ins often build caches
+    // the first time or two they're instantiated.
+    const int kLeakWarmupCycles = 2;
+    // growth in resident memory below this is allocator noise.
+    const double kResidentLeakThreshold = 256 * 1024;
+    const int kLeakSitesToShow = 5;
+
+    // a fresh instance, set up with the test stream format and (unless asked not to) initialized.
+    shared_ptr<InitializedAudioUnit> makeRenderingInstance( const AudioComponentDescription& cd, int32_t& numOuts, bool initialize = true )
+    {
+        shared_ptr<InitializedAudioUnit> unit( new InitializedAudioUnit( cd ) );
+        if ( unit->IsInitialized() )
+            unit->Uninitialize();
+        unit->wasInitialized = false;
+
+        int32_t numIn;
+        setupTestStreamFormat( unit, numIn, numOuts );
+        if ( initialize )
+            unit->Initialize();
+        return unit;
+    }
+
+    // creates, initializes, renders with, uninitializes and destroys a fresh instance.
+    void runLifecycle( const AudioComponentDescription& cd )
+    {
+        int32_t numOuts;
+        shared_ptr<InitializedAudioUnit> unit = makeRenderingInstance( cd, numOuts );
+
+        RenderBuffers buffers( numOuts, kTestFrames );
+
+        AudioUnitRenderActionFlags actionFlags = 0;
+        AudioTimeStamp timestamp;
+        memset( &timestamp, 0, sizeof( timestamp ) );
+        timestamp.mFlags = kAudioTimeStampSampleTimeValid;
+        unit->render( actionFlags, timestamp, 0, kTestFrames, buffers.list() );
+        buffers.checkCanaries();
+
+        unit->Uninitialize();
+        if ( not unit->IsASynth() )
+            unit->removeRenderCallback( false );
+    }
+
+    // the least-squares slope of the samples, per sample.
+    double growthPerCycle( const vector<double>& samples )
+    {
+        double n = samples.size();
+        double sumX = 0, sumY = 0, sumXY = 0, sumXX = 0;
+        for ( size_t i = 0; i < samples.size(); ++i )
+        {
+            sumX += i;
+            sumY += samples[i];
+            sumXY += i * samples[i];
+            sumXX += double( i ) * i;
+        }
+        double denominator = n * sumXX - sumX * sumX;
+        return (denominator > 0) ? (n * sumXY - sumX * sumY) / denominator : 0;
+    }
+
+    string describeLeakSites()
+    {
+        FakeNewSite sites[kLeakSitesToShow];
+        int numSites = FakeNewTopSites( sites, kLeakSitesToShow );
+
+        string description;
+        for ( int i = 0; i < numSites; ++i )
+        {
+            char line[100];
+            snprintf( line, sizeof( line ), "\n%llu bytes in %llu blocks from:", (unsigned long long)sites[i].liveBytes, (unsigned long long)sites[i].liveBlocks );
+            description += line;
+
+            char** symbols = backtrace_symbols( sites[i].frames, sites[i].numFrames );
+            for ( int frame = 0; symbols and frame < sites[i].numFrames; ++frame )
+                description += string( "\n    " ) + symbols[frame];
+            free( symbols );
+        }
+        return description;
+    }
+
+    // an extra test: the cycles take too long to run with every validation,
+    // let alone with every repetition.
+    BEGIN_AUTEST(LeakCheckLifecycle)
+        const AUValOptions& options = GetAUValOptions();
+
+        // live bytes are counted while profiling is on, so turn it on if alloc_profile hasn't.
+        struct Profiling
+        {
+            Profiling() { FakeNewEnableProfiling( true ); }
+            ~Profiling()
+            {
+                FakeNewTrackSites( false );
+                FakeNewEnableProfiling( GetAUValOptions().allocProfile );
+            }
+        } profiling;
+
+        vector<double> heapBytes, residentBytes;
+        for ( int cycle = 0; cycle < options.leakCycles; ++cycle )
+        {
+            // track only the cycles that are measured.
+            if ( cycle == kLeakWarmupCycles )
+                FakeNewTrackSites( true );
+
+            runLifecycle( cd );
+
+            if ( cycle >= kLeakWarmupCycles )
+            {
+                heapBytes.push_back( double( FakeNewLiveBytes() ) );
+                residentBytes.push_back( double( MemoryStats::ResidentBytes() ) );
+            }
+        }
+        double heapGrowth = growthPerCycle( heapBytes );
+        double residentGrowth = growthPerCycle( residentBytes );
+        ::testing::Test::RecordProperty( "heap_growth_per_cycle", int( heapGrowth ) );
+        ::testing::Test::RecordProperty( "resident_growth_per_cycle", int( residentGrowth ) );
+
+        if ( heapGrowth > options.leakThreshold or residentGrowth > kResidentLeakThreshold )
+        {
+            FAIL() << "leaks about " << int( heapGrowth ) << " bytes of heap (" << int( residentGrowth )
+                   << " bytes resident) per instance" << describeLeakSites();
+        }
+    END_AUTEST
+
+    // page faults in render are stalls on the audio thread.  A fresh instance
+    // renders fault_slices slices; the first fault_first_slices are reported
+    // one by one, since that's where lazily built tables get touched, and the
+    // rest as the steady state.  An extra test, since it reports rather than checks.
+    BEGIN_AUTEST(RenderPageFaults)
+        const AUValOptions& options = GetAUValOptions();
+
+        int32_t numOuts;
+        shared_ptr<InitializedAudioUnit> unit = makeRenderingInstance( cd, numOuts );
+        RenderBuffers buffers( numOuts, kTestFrames );
+
+        AudioTimeStamp timestamp;
+        memset( &timestamp, 0, sizeof( timestamp ) );
+        timestamp.mFlags = kAudioTimeStampSampleTimeValid;
+
+        string firstSlices;
+        RunningStats steadyMinor, steadyMajor;
+        for ( int slice = 0; slice < options.faultSlices; ++slice )
+        {
+            AudioUnitRenderActionFlags actionFlags = 0;
+            MemoryStats::PageFaults before = MemoryStats::PageFaultCounts();
+            unit->render( actionFlags, timestamp, 0, kTestFrames, buffers.list() );
+            MemoryStats::PageFaults after = MemoryStats::PageFaultCounts();
+            timestamp.mSampleTime += kTestFrames;
+
+            uint64_t minor = after.minor - before.minor;
+            uint64_t major = after.major - before.major;
+            if ( slice < options.faultFirstSlices )
+            {
+                char line[80];
+                snprintf( line, sizeof( line ), "\n    slice %d: %llu minor, %llu major", slice + 1, (unsigned long long)minor, (unsigned long long)major );
+                firstSlices += line;
+            }
+            else
+            {
+                steadyMinor.add( double( minor ) );
+                steadyMajor.add( double( major ) );
+            }
+        }
+        buffers.checkCanaries();
+
+        unit->Uninitialize();
+        if ( not unit->IsASynth() )
+            unit->removeRenderCallback( false );
+
+        printf( "page faults in render%s:%s\n", options.prefaultBuffers ? " (host buffers prefaulted)" : "", firstSlices.c_str() );
+        if ( steadyMinor.count() )
+        {
+            printf( "    after that, per slice: %.2f minor (at most %.0f), %.2f major (at most %.0f)\n",
+                    steadyMinor.mean(), steadyMinor.max(), steadyMajor.mean(), steadyMajor.max() );
+
+            char perSlice[32];
+            snprintf( perSlice, sizeof( perSlice ), "%.2f", steadyMinor.mean() );
+            ::testing::Test::RecordProperty( "steady_minor_faults_per_slice", perSlice );
+            snprintf( perSlice, sizeof( perSlice ), "%.2f", steadyMajor.mean() );
+            ::testing::Test::RecordProperty( "steady_major_faults_per_slice", perSlice );
+        }
+    END_AUTEST
+
+    // the slices before this are left out of the timing; they are mostly page faults.
+    const int kPolicyWarmupSlices = 16;
+    const int kPolicySlices = 256;
+
+    // how fast instances render side by side, one to a core, with their buffers
+    // under each render memory policy (see AUValRenderMemory.h).  An extra test.
+    BEGIN_AUTEST(RenderMemoryPolicies)
+        const AUValOptions& options = GetAUValOptions();
+        int numCores = max( 1, int( thread::hardware_concurrency() ) );
+        int numInstances = options.policyInstances ? options.policyInstances : numCores;
+
+        printf( "render memory policies, %d instances on %d cores:\n", numInstances, numCores );
+        double heapMicroseconds = 0;
+        for ( RenderMemoryPolicy policy : options.renderMemoryPolicies )
+        {
+            // under first touch, the plug-in's memory is first touched where it renders too.
+            bool initializeOnWorker = (policy != kRenderMemoryHeap);
+
+            vector<shared_ptr<InitializedAudioUnit> > units( numInstances );
+            vector<int32_t> numOuts( numInstances );
+            for ( int i = 0; i < numInstances; ++i )
+                units[i] = makeRenderingInstance( cd, numOuts[i], not initializeOnWorker );
+
+            vector<RunningStats> sliceTimes( numInstances );
+            vector<exception_ptr> errors( numInstances );
+            atomic<bool> applied( true );
+
+            // the phase hook (and FakeNew's current phase) follow one instance at
+            // a time, and these are initialized and rendered side by side.
+            struct PhaseHookOff
+            {
+                PhaseHookOff() : hook( AudioUnits::SetLifecyclePhaseHook( NULL ) ) {}
+                ~PhaseHookOff() { AudioUnits::SetLifecyclePhaseHook( hook ); }
+                AudioUnits::LifecyclePhaseHook hook;
+            } phaseHookOff;
+
+            vector<thread> workers;
+            for ( int i = 0; i < numInstances; ++i )
+            {
+                workers.push_back( thread( [&, i]()
+                {
+                    try
+                    {
+                        PinThreadToCore( i % numCores );
+                        if ( initializeOnWorker )
+                            units[i]->Initialize();
+                        RenderBuffers buffers( numOuts[i], kTestFrames, policy );
+
+                        AudioTimeStamp timestamp;
+                        memset( &timestamp, 0, sizeof( timestamp ) );
+                        timestamp.mFlags = kAudioTimeStampSampleTimeValid;
+                        for ( int slice = 0; slice < kPolicySlices; ++slice )
+                        {
+                            AudioUnitRenderActionFlags actionFlags = 0;
+                            auto start = chrono::steady_clock::now();
+                            units[i]->render( actionFlags, timestamp, 0, kTestFrames, buffers.list() );
+                            auto end = chrono::steady_clock::now();
+                            timestamp.mSampleTime += kTestFrames;
+
+                            if ( slice >= kPolicyWarmupSlices )
+                                sliceTimes[i].add( chrono::duration<double, micro>( end - start ).count() );
+                        }
+                        if ( not buffers.policyApplied() )
+                            applied = false;
+                    }
+                    catch ( ... )
+                    {
+                        errors[i] = current_exception();
+                    }
+                } ) );
+            }
+            for ( thread& worker : workers )
+                worker.join();
+
+            for ( auto& unit : units )
+            {
+                if ( unit->IsInitialized() )
+                    unit->Uninitialize();
+                if ( not unit->IsASynth() )
+                    unit->removeRenderCallback( false );
+            }
+            for ( const exception_ptr& error : errors )
+            {
+                if ( error )
+                    rethrow_exception( error );
+            }
+
+            RunningStats all;
+            double slowest = 0;
+            for ( const RunningStats& times : sliceTimes )
+            {
+                all.add( times.mean() );
+                slowest = max( slowest, times.mean() );
+            }
+            if ( policy == kRenderMemoryHeap )
+                heapMicroseconds = all.mean();
+
+            printf( "    %s: %.1f us per slice (slowest instance %.1f)", RenderMemoryPolicyName( policy ), all.mean(), slowest );
+            if ( policy != kRenderMemoryHeap and heapMicroseconds > 0 )
+                printf( ", %+.1f%% against heap", 100 * (all.mean() - heapMicroseconds) / heapMicroseconds );
+            if ( policy == kRenderMemoryHugePages and not applied )
+                printf( " (the OS gave no huge pages)" );
+            if ( policy == kRenderMemoryInterleave and not applied )
+                printf( " (no memory nodes to interleave across)" );
+            printf( "\n" );
+        }
+    END_AUTEST
+
+    // the sweep renders slices this size, closer to what a host automates with.
+    const int kSweepFrames = 512;
+    const int kSweepWarmupSlices = 8;
+    const int kSweepParamsToShow = 20;
+
+    struct ParameterSweepCost
+    {
+        AudioUnitParameterID id;
+        string name;
+        double worstMicroseconds;   // setting the value, and rendering the slice after
+        double worstSetMicroseconds;    // of that, the part in setParameter
+        float worstValue;
+        RunningStats microseconds;
+    };
+
+    // steps every writable global parameter across its range (indexed ones
+    // through each of their values), timing each setParameter and the render
+    // after it.  Parameters whose change costs more than sweep_budget of a
+    // slice's duration are the ones that glitch under automation.  An extra test.
+    BEGIN_AUTEST(ParameterSweep)
+        const AUValOptions& options = GetAUValOptions();
+
+        int32_t numOuts;
+        shared_ptr<InitializedAudioUnit> unit = makeRenderingInstance( cd, numOuts );
+        RenderBuffers buffers( numOuts, kSweepFrames );
+
+        AudioTimeStamp timestamp;
+        memset( &timestamp, 0, sizeof( timestamp ) );
+        timestamp.mFlags = kAudioTimeStampSampleTimeValid;
+        auto renderSlice = [&]()
+        {
+            AudioUnitRenderActionFlags actionFlags = 0;
+            unit->render( actionFlags, timestamp, 0, kSweepFrames, buffers.list() );
+            timestamp.mSampleTime += kSweepFrames;
+        };
+        for ( int slice = 0; slice < kSweepWarmupSlices; ++slice )
+            renderSlice();
+
+        const AudioUnits::ParameterCatalog& params = unit->getParameterCatalog();
+        vector<ParameterSweepCost> costs;
+        RunningStats renderOnly;
+        for ( size_t i = 0; i < params.size(); ++i )
+        {
+            if ( (params.flags( i ) & kAudioUnitParameterFlag_IsWritable) == 0 )
+                continue;
+
+            vector<float> values;
+            size_t numValueStrings = params.numValueStrings( i );
+            if ( params.unit( i ) == kAudioUnitParameterUnit_Indexed and numValueStrings > 0 )
+            {
+                for ( size_t j = 0; j < numValueStrings; ++j )
+                    values.push_back( params.minValue( i ) + j );
+            }
+            else
+            {
+                for ( int step = 0; step < options.sweepSteps; ++step )
+                    values.push_back( params.minValue( i ) + (params.maxValue( i ) - params.minValue( i )) * step / max( options.sweepSteps - 1, 1 ) );
+            }
+
+            ParameterSweepCost cost;
+            cost.id = params.id( i );
+            cost.name = params.name( i );
+            cost.worstMicroseconds = 0;
+            cost.worstSetMicroseconds = 0;
+            cost.worstValue = 0;
+            for ( float value : values )
+            {
+                auto start = chrono::steady_clock::now();
+                unit->setParameter( cost.id, kAudioUnitScope_Global, 0, value, 0 );
+                auto set = chrono::steady_clock::now();
+                renderSlice();
+                auto end = chrono::steady_clock::now();
+                double microseconds = chrono::duration<double, micro>( end - start ).count();
+
+                cost.microseconds.add( microseconds );
+                if ( microseconds > cost.worstMicroseconds )
+                {
+                    cost.worstMicroseconds = microseconds;
+                    cost.worstSetMicroseconds = chrono::duration<double, micro>( set - start ).count();
+                    cost.worstValue = value;
+                }
+            }
+
+            // a slice with nothing changed, for comparison.
+            auto start = chrono::steady_clock::now();
+            renderSlice();
+            renderOnly.add( chrono::duration<double, micro>( chrono::steady_clock::now() - start ).count() );
+
+            costs.push_back( cost );
+        }
+        buffers.checkCanaries();
+
+        unit->Uninitialize();
+        if ( not unit->IsASynth() )
+            unit->removeRenderCallback( false );
+
+        double budget = options.sweepBudget * 1e6 * kSweepFrames / kTestSampleRate;
+        vector<const ParameterSweepCost*> overBudget;
+        for ( const ParameterSweepCost& cost : costs )
+        {
+            if ( cost.worstMicroseconds > budget )
+                overBudget.push_back( &cost );
+        }
+        sort( overBudget.begin(), overBudget.end(), []( const ParameterSweepCost* a, const ParameterSweepCost* b )
+        {
+            return a->worstMicroseconds > b->worstMicroseconds;
+        } );
+        ::testing::Test::RecordProperty( "parameters_over_budget", int( overBudget.size() ) );
+
+        printf( "parameter sweep: %d parameters, %.0f us per slice with no change, budget %.0f us\n",
+                int( costs.size() ), renderOnly.mean(), budget );
+        for ( size_t i = 0; i < overBudget.size() and i < size_t( kSweepParamsToShow ); ++i )
+        {
+            const ParameterSweepCost& cost = *overBudget[i];
+            printf( "    %u (%s): %.0f us at %g (%.0f us in setParameter), %.0f us on average\n", (unsigned)cost.id, cost.name.c_str(),
+                    cost.worstMicroseconds, cost.worstValue, cost.worstSetMicroseconds, cost.microseconds.mean() );
+        }
+        if ( overBudget.size() > size_t( kSweepParamsToShow ) )
+            printf( "    and %d more\n", int( overBudget.size() ) - kSweepParamsToShow );
+    END_AUTEST
+
+    // an extra test, since the report it prints is only wanted when asked for.
+    BEGIN_AUTEST(FootprintScaling)
+        const AUValOptions& options = GetAUValOptions();
+
+        // the heap is only counted while profiling is on.
+        struct Profiling
+        {
+            Profiling() { FakeNewEnableProfiling( true ); }
+            ~Profiling() { FakeNewEnableProfiling( GetAUValOptions().allocProfile ); }
+        } profiling;
+
+        AUValFootprint::Report report;
+        report.firstInstance = globals->firstInstance;
+        report.firstInstanceInitialized = gRequiresInit;
+
+        // the instances are added a batch at a time, and all of them are
+        // measured uninitialized, then initialized.
+        AUValFootprint::Sample baseline = AUValFootprint::Measure();
+        vector<shared_ptr<InitializedAudioUnit> > units;
+        for ( int count = 1; count <= options.footprintInstances; count *= 2 )
+        {
+            for ( auto& unit : units )
+                unit->Uninitialize();
+            while ( int( units.size() ) < count )
+            {
+                shared_ptr<InitializedAudioUnit> unit( new InitializedAudioUnit( cd ) );
+                if ( unit->IsInitialized() )
+                    unit->Uninitialize();
+                unit->wasInitialized = false;
+                units.push_back( unit );
+            }
+            AUValFootprint::Point point = { count, AUValFootprint::Measure() - baseline };
+            report.uninitialized.push_back( point );
+
+            for ( auto& unit : units )
+            {
+                unit->Initialize();
+                unit->wasInitialized = true;
+            }
+            point.footprint = AUValFootprint::Measure() - baseline;
+            report.initialized.push_back( point );
+        }
+        units.clear();
+
+        string json = AUValFootprint::ToJSON( report );
+        if ( options.footprintReport.empty() )
+            printf( "footprint: %s", json.c_str() );
+        else
+        {
+            FILE* file = fopen( options.footprintReport.c_str(), "w" );
+            ASSERT_TRUE( file != NULL ) << "can't write " << options.footprintReport;
+            fputs( json.c_str(), file );
+            fclose( file );
+        }
+    END_AUTEST
+
+    INSTANTIATE_TEST_CASE_P(AUTest, AUTest, ::testing::Range(0, GetTimesToRepeatTests()));
     
         // this is the test printer that works with Digital Performer
     class DigitalPerformerPrinter : public ::testing::EmptyTestEventListener
@@ -614,15 +1339,394 @@ namespace
         }
         virtual void OnTestStart(const ::testing::TestInfo& testInfo)
         {
-            string testName = testInfo.name();
-            // since we do each test multiple times, each test has "/N" appended to it
-            // to indicate which iteration it is.  let's strip that out for the output.
-            testName = testName.substr(0, testName.find_last_of('/'));
-            cout<<++testNumber<<", "<<testName<<endl;
+            cout<<++testNumber<<", "<<baseTestName(testInfo)<<endl;
         }
     private:
         int testNumber;
     };
+
+    // puts each test, and the set up and tear down of the shared instance,
+    // under the watchdog so a hung plug-in can't stall us forever.
+    class WatchdogListener : public ::testing::EmptyTestEventListener
+    {
+    public:
+        virtual void OnEnvironmentsSetUpStart(const ::testing::UnitTest&)
+        {
+            AUValWatchdog::Arm("SetUp", GetTestTimeout("SetUp"));
+        }
+        virtual void OnEnvironmentsSetUpEnd(const ::testing::UnitTest&)
+        {
+            AUValWatchdog::Disarm();
+        }
+        virtual void OnTestStart(const ::testing::TestInfo& testInfo)
+        {
+            string testName = baseTestName(testInfo);
+            AUValWatchdog::Arm(testName, GetTestTimeout(testName));
+        }
+        virtual void OnTestEnd(const ::testing::TestInfo&)
+        {
+            AUValWatchdog::Disarm();
+        }
+        virtual void OnEnvironmentsTearDownStart(const ::testing::UnitTest&)
+        {
+            AUValWatchdog::Arm("TearDown", GetTestTimeout("TearDown"));
+        }
+        virtual void OnEnvironmentsTearDownEnd(const ::testing::UnitTest&)
+        {
+            AUValWatchdog::Disarm();
+        }
+    };
+
+    // keeps track of how long each test takes, for ordering the next run.
+    class CostListener : public ::testing::EmptyTestEventListener
+    {
+    public:
+        explicit CostListener(CostHistory& history) : history(history) {}
+
+        virtual void OnTestEnd(const ::testing::TestInfo& testInfo)
+        {
+            Cost& cost = costs[baseTestName(testInfo)];
+            cost.milliseconds += testInfo.result()->elapsed_time();
+            cost.runs += 1;
+        }
+        virtual void OnTestProgramEnd(const ::testing::UnitTest&)
+        {
+            for ( const auto& entry : costs )
+                UpdateCostHistory(history, entry.first, entry.second.milliseconds / entry.second.runs);
+            costs.clear();
+        }
+    private:
+        struct Cost
+        {
+            Cost() : milliseconds(0), runs(0) {}
+            double milliseconds;
+            int runs;
+        };
+        CostHistory& history;
+        map<string, Cost> costs;
+    };
+
+    // reports each test's allocations, stage by stage.
+    class AllocProfileListener : public ::testing::EmptyTestEventListener
+    {
+    public:
+        virtual void OnEnvironmentsSetUpStart(const ::testing::UnitTest&)
+        {
+            AUValAllocProfile::Reset();
+        }
+        virtual void OnEnvironmentsSetUpEnd(const ::testing::UnitTest&)
+        {
+            AUValAllocProfile::Report("SetUp");
+        }
+        virtual void OnTestStart(const ::testing::TestInfo&)
+        {
+            AUValAllocProfile::Reset();
+        }
+        virtual void OnTestEnd(const ::testing::TestInfo& testInfo)
+        {
+            AUValAllocProfile::Report(baseTestName(testInfo));
+        }
+        virtual void OnEnvironmentsTearDownStart(const ::testing::UnitTest&)
+        {
+            AUValAllocProfile::Reset();
+        }
+        virtual void OnEnvironmentsTearDownEnd(const ::testing::UnitTest&)
+        {
+            AUValAllocProfile::Report("TearDown");
+        }
+    };
+
+    CostHistory gCostHistory;
+
+    AUValCheckpoint gCheckpoint;
+
+    string fullTestName(const ::testing::TestInfo& testInfo)
+    {
+        return string(testInfo.test_case_name()) + "." + testInfo.name();
+    }
+
+    // records each test as it starts and finishes, so a run that crashes can be resumed.
+    class CheckpointListener : public ::testing::EmptyTestEventListener
+    {
+    public:
+        virtual void OnTestStart(const ::testing::TestInfo& testInfo)
+        {
+            gCheckpoint.TestStarted(fullTestName(testInfo));
+        }
+        virtual void OnTestEnd(const ::testing::TestInfo& testInfo)
+        {
+            gCheckpoint.TestFinished(fullTestName(testInfo), testInfo.result()->Passed());
+        }
+    };
+
+    // matches a name against a single gtest-style pattern, where '*' matches
+    // any string and '?' any single character.
+    bool matchesPattern(const char* pattern, const char* name)
+    {
+        switch ( *pattern )
+        {
+            case 0:
+            case ':':
+                return *name == 0;
+            case '?':
+                return *name != 0 and matchesPattern(pattern + 1, name + 1);
+            case '*':
+                return (*name != 0 and matchesPattern(pattern, name + 1)) or matchesPattern(pattern + 1, name);
+            default:
+                return *pattern == *name and matchesPattern(pattern + 1, name + 1);
+        }
+    }
+
+    bool matchesAnyPattern(const string& patterns, const string& name)
+    {
+        size_t pos = 0;
+        for (;;)
+        {
+            if ( matchesPattern(patterns.c_str() + pos, name.c_str()) )
+                return true;
+            pos = patterns.find(':', pos);
+            if ( pos == string::npos )
+                return false;
+            ++pos;
+        }
+    }
+
+    // applies a --gtest_filter ("positive patterns-negative patterns") the same way gtest does.
+    bool matchesFilter(const string& filter, const string& name)
+    {
+        size_t dash = filter.find('-');
+        string positive = filter.substr(0, dash);
+        string negative = (dash == string::npos) ? string() : filter.substr(dash + 1);
+
+        if ( positive.empty() )
+            positive = "*";
+        return matchesAnyPattern(positive, name) and not (not negative.empty() and matchesAnyPattern(negative, name));
+    }
+
+    struct ScheduledTest
+    {
+        string name;
+        AUTestTier tier;
+        double cost;
+        vector<string> instances;   // the full gtest names of each repetition
+
+        bool operator< (const ScheduledTest& o) const
+        {
+            if ( tier != o.tier )
+                return tier < o.tier;
+            return cost < o.cost;
+        }
+    };
+
+    // groups the tests selected by the filter into tiers, cheapest first within each tier.
+    // Tests we have no history for are assumed to be cheap.
+    vector<ScheduledTest> BuildSchedule(const string& filter)
+    {
+        map<string, ScheduledTest> tests;
+
+        const ::testing::UnitTest& unitTest = *::testing::UnitTest::GetInstance();
+        for ( int i = 0; i < unitTest.total_test_case_count(); ++i )
+        {
+            const ::testing::TestCase* testCase = unitTest.GetTestCase(i);
+            for ( int j = 0; j < testCase->total_test_count(); ++j )
+            {
+                const ::testing::TestInfo* testInfo = testCase->GetTestInfo(j);
+                string fullName = fullTestName(*testInfo);
+                if ( not matchesFilter(filter, fullName) )
+                    continue;
+
+                string name = baseTestName(*testInfo);
+                ScheduledTest& test = tests[name];
+                if ( test.instances.empty() )
+                {
+                    test.name = name;
+                    test.tier = GetTestTier(name);
+                    auto cost = gCostHistory.find(name);
+                    test.cost = (cost != gCostHistory.end()) ? cost->second : 0;
+                }
+                test.instances.push_back(fullName);
+            }
+        }
+
+        vector<ScheduledTest> schedule;
+        for ( auto& entry : tests )
+            schedule.push_back(std::move(entry.second));
+
+        // a shard (see AUValShards) takes every shardCount'th test, with all of
+        // its repetitions, since the passes below each run one test and gtest
+        // would otherwise shard the repetitions of that one test.
+        const char* totalShards = getenv("GTEST_TOTAL_SHARDS");
+        const char* shardIndex = getenv("GTEST_SHARD_INDEX");
+        int shardCount = totalShards ? atoi(totalShards) : 1;
+        int shard = shardIndex ? atoi(shardIndex) : 0;
+        if ( shardCount > 1 and shard >= 0 and shard < shardCount )
+        {
+            vector<ScheduledTest> ours;
+            for ( size_t i = shard; i < schedule.size(); i += shardCount )
+                ours.push_back(std::move(schedule[i]));
+            schedule.swap(ours);
+        }
+
+        stable_sort(schedule.begin(), schedule.end());
+        return schedule;
+    }
+
+    string JoinNames(const vector<string>& names)
+    {
+        string joined;
+        for ( const string& name : names )
+        {
+            if ( not joined.empty() )
+                joined += ':';
+            joined += name;
+        }
+        return joined;
+    }
+
+    // runs the tests one at a time in tier and cost order.  Each test is its own
+    // pass through gtest, sharing the instance in globals between passes.
+    bool RunTieredSchedule()
+    {
+        const string userFilter = ::testing::GTEST_FLAG(filter);
+        vector<ScheduledTest> schedule = BuildSchedule(userFilter);
+
+        // the schedule is already this shard's share.
+        unsetenv("GTEST_TOTAL_SHARDS");
+        unsetenv("GTEST_SHARD_INDEX");
+
+        ::testing::GTEST_FLAG(shuffle) = false;
+        globals->keepInstance = true;
+
+        bool success = true;
+        for ( size_t i = 0; i < schedule.size(); )
+        {
+            AUTestTier tier = schedule[i].tier;
+            bool tierPassed = true;
+
+            for ( ; i < schedule.size() and schedule[i].tier == tier; ++i )
+            {
+                ::testing::GTEST_FLAG(filter) = JoinNames(schedule[i].instances);
+                if ( RUN_ALL_TESTS() != 0 )
+                    tierPassed = false;
+
+                if ( globals->unauthorized )
+                    break;
+            }
+
+            success = success and tierPassed;
+            if ( globals->unauthorized or (not tierPassed and GetAUValOptions().failFast) )
+                break;
+        }
+
+        ::testing::GTEST_FLAG(filter) = userFilter;
+        globals->keepInstance = false;
+
+        if ( GetAUValOptions().watchdog )
+            AUValWatchdog::Arm("TearDown", GetTestTimeout("TearDown"));
+        globals->audioUnit.reset();
+        AUValWatchdog::Disarm();
+
+        return success;
+    }
+
+    // re-runs the test an earlier run died in, by itself in a fresh copy of the validator,
+    // to find out whether the crash reproduces.  Returns the copy's exit status.
+    int RerunCrashedTest(const string& testName)
+    {
+        vector<string> args = GetValidatorArguments({ "--auexamine_checkpoint", "--auexamine_result_store", "--auexamine_shards", "--gtest_filter" });
+        args.push_back("--gtest_filter=" + testName);
+
+        printf("re-running %s, which the last run crashed in\n", testName.c_str());
+        fflush(stdout);
+
+        // if we are one shard of several, the test is not necessarily in the same shard of one.
+        pid_t pid = SpawnValidator(args, { "GTEST_TOTAL_SHARDS=1", "GTEST_SHARD_INDEX=0" });
+        if ( pid < 0 )
+            return kAUValStatusCouldNotRun;
+        return WaitForValidator(pid);
+    }
+
+    // adds negative patterns (separated by ':') to the gtest filter.
+    void ExcludeFromFilter(const string& patterns)
+    {
+        string filter = ::testing::GTEST_FLAG(filter);
+        if ( filter.find('-') == string::npos )
+            filter += '-' + patterns;
+        else
+            filter += ':' + patterns;
+        ::testing::GTEST_FLAG(filter) = filter;
+    }
+
+    // picks up where an earlier run that crashed left off: the test it died in is re-run
+    // on its own, and the tests it finished are filtered out of this run.
+    // Returns false if none of the earlier results were failures.
+    bool ResumeFromCheckpoint()
+    {
+        const string& inFlight = gCheckpoint.InFlight();
+        if ( not inFlight.empty() )
+        {
+            int status = RerunCrashedTest(inFlight);
+            gCheckpoint.CrashRerun(inFlight, status);
+
+            if ( IsCrashStatus(status) )
+                printf("!%s crashed again\n", inFlight.c_str());
+            else
+                printf("%s did not crash when run on its own\n", inFlight.c_str());
+        }
+
+        bool success = true;
+        string skipped;
+        for ( const auto& entry : gCheckpoint.Completed() )
+        {
+            skipped += ':' + entry.first;
+            success = success and entry.second;
+        }
+
+        if ( not skipped.empty() )
+            ExcludeFromFilter(skipped.substr(1));
+
+        return success;
+    }
+
+    bool IsExtraTestRequested(const string& testName)
+    {
+        const set<string>& requested = GetAUValOptions().extraTests;
+        return requested.count(testName) or requested.count("all");
+    }
+
+    // filters out the extra tests that weren't asked for, and all but the first
+    // repetition of those that were: a measurement only needs taking once.
+    void ExcludeExtraTests()
+    {
+        for ( const string& name : GetAUValOptions().extraTests )
+        {
+            const AUTestTraits* traits = findTestTraits(name);
+            if ( name != "all" and not (traits and traits->extra) )
+                printf("%s is not one of the extra tests\n", name.c_str());
+        }
+
+        string excluded;
+        set<string> seen;
+        const ::testing::UnitTest& unitTest = *::testing::UnitTest::GetInstance();
+        for ( int i = 0; i < unitTest.total_test_case_count(); ++i )
+        {
+            const ::testing::TestCase* testCase = unitTest.GetTestCase(i);
+            for ( int j = 0; j < testCase->total_test_count(); ++j )
+            {
+                const ::testing::TestInfo* testInfo = testCase->GetTestInfo(j);
+                string name = baseTestName(*testInfo);
+                const AUTestTraits* traits = findTestTraits(name);
+                if ( not traits or not traits->extra )
+                    continue;
+
+                if ( not IsExtraTestRequested(name) or not seen.insert(name).second )
+                    excluded += ':' + fullTestName(*testInfo);
+            }
+        }
+
+        if ( not excluded.empty() )
+            ExcludeFromFilter(excluded.substr(1));
+    }
 }
 
 namespace AudioUnits
@@ -632,15 +1736,76 @@ namespace AudioUnits
         globals = new Globals(std::move(cd));
         // transfer ownership to gtest (we no longer control lifetime)
         ::testing::AddGlobalTestEnvironment(globals);
+
+        const AUValOptions& options = GetAUValOptions();
+        ::testing::TestEventListeners& listeners = ::testing::UnitTest::GetInstance()->listeners();
+        if ( options.watchdog )
+        {
+            AUValWatchdog::Start();
+            listeners.Append(new WatchdogListener); //owned by gtest.
+        }
         
+        if ( options.guardBuffers )
+            AUValGuardedBuffer::InstallFaultHandler();
+
+        if ( options.allocDiagnostics != AUValOptions::kAllocDiagnosticsOff )
+            FakeNewEnableDiagnostics(true);
+
+        if ( options.allocProfile )
+        {
+            AUValAllocProfile::Start();
+            listeners.Append(new AllocProfileListener); //owned by gtest.
+        }
+
+        if ( not options.costHistory.empty() )
+            gCostHistory = LoadCostHistory(options.costHistory);
+        if ( not options.costHistory.empty() or options.tieredSchedule )
+            listeners.Append(new CostListener(gCostHistory)); //owned by gtest.
+
+        if ( not options.checkpoint.empty() )
+        {
+            if ( gCheckpoint.Open(options.checkpoint) )
+                listeners.Append(new CheckpointListener); //owned by gtest.
+            else
+                printf("could not open checkpoint file %s\n", options.checkpoint.c_str());
+        }
+
         // we use a minimal test printing style for use with Digital Performer
         #if DP_VERSION
-            ::testing::TestEventListeners& listeners = ::testing::UnitTest::GetInstance()->listeners();
             listeners.Append(new DigitalPerformerPrinter); //owned by gtest.
             delete listeners.Release(listeners.default_result_printer());
         #endif
     }
     
+    bool RunTests(AUValStatus& failureStatus)
+    {
+        const AUValOptions& options = GetAUValOptions();
+
+        ExcludeExtraTests();
+
+        bool success = true;
+        if ( gCheckpoint.IsOpen() )
+            success = ResumeFromCheckpoint();
+
+        bool passed = options.tieredSchedule
+                      ? RunTieredSchedule()
+                      : (RUN_ALL_TESTS() == 0);
+        success = success and passed;
+
+        if ( not options.costHistory.empty() )
+            SaveCostHistory(options.costHistory, gCostHistory);
+
+        failureStatus = kAUValStatusFailure;
+        if ( gCheckpoint.IsOpen() )
+        {
+            if ( IsCrashStatus(gCheckpoint.ConfirmedCrashStatus()) )
+                failureStatus = AUValStatus(gCheckpoint.ConfirmedCrashStatus());
+            gCheckpoint.RunFinished();
+        }
+
+        return success and failureStatus == kAUValStatusFailure;
+    }
+
     bool IsAuthorized()
     {
         return not globals->unauthorized;
@@ -8,10 +8,15 @@
 #define _AU_TORTURE_TEST_
 
 #include "AudioUnitUtils.h"
+#include "AUValStatus.h"
 
 namespace AudioUnits
 {
     void SetupTest(AudioComponentDescription cd);
+    // runs the tests in the order the options ask for; returns true if they all passed.
+    // Otherwise failureStatus is kAUValStatusFailure, or kAUValStatusCrashed/Hung if
+    // a resumed run confirmed that a test crashes.
+    bool RunTests(AUValStatus& failureStatus);
     bool IsAuthorized();
 }
 
@@ -20,6 +20,8 @@ enum AUValStatus
 	kAUValStatusSuccessDoesNotRequireInit,
 	kAUValStatusSuccessRequiresInit,
 	kAUValStatusNotAuthorized,
+	kAUValStatusHung,
+	kAUValStatusBufferOverrun,
 
 	kAUValStatusLastCode // always last
 };
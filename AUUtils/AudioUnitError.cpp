@@ -0,0 +1,87 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "AudioUnitError.h"
+#include <map>
+#include <mutex>
+#include <stdio.h>
+
+namespace AudioUnits
+{
+
+namespace
+{
+	// keyed on the call site; the names are string literals, so their addresses will do.
+	typedef std::pair<const char*, int> CallSite;
+
+	std::mutex gErrorStatsMutex;
+	std::map<CallSite, AudioUnitErrorStats> gErrorStats;
+
+	void recordError( int32_t error, const FuncDesc& desc, bool thrown )
+	{
+		std::lock_guard<std::mutex> lock( gErrorStatsMutex );
+		std::map<CallSite, AudioUnitErrorStats>::iterator iter = gErrorStats.find( CallSite( desc.name, desc.line ) );
+		if ( iter == gErrorStats.end() )
+		{
+			AudioUnitErrorStats stats = { desc, error, 0, 0 };
+			iter = gErrorStats.insert( std::make_pair( CallSite( desc.name, desc.line ), stats ) ).first;
+		}
+
+		iter->second.lastError = error;
+		if ( thrown )
+			++iter->second.thrown;
+		else
+			++iter->second.probed;
+	}
+}
+
+void FailAudioUnitError( int32_t error, const FuncDesc& desc, bool* negOneErrorCode )
+{
+	if ( error != 0 )
+	{
+		if ( negOneErrorCode )
+			*negOneErrorCode = (error == -1);
+
+		recordError( error, desc, true );
+		throw AudioUnitError( error, desc );
+	}
+	else
+	{
+		if ( negOneErrorCode )
+			*negOneErrorCode = false;
+	}
+}
+
+bool CheckAudioUnitError( int32_t error, const FuncDesc& desc )
+{
+	if ( error == 0 )
+		return true;
+
+	recordError( error, desc, false );
+	return false;
+}
+
+const char* AudioUnitError::what() const noexcept
+{
+	if ( fMessage.empty() )
+	{
+		char errorStr[500];
+		snprintf( errorStr, sizeof( errorStr ), "Failure: %s %d %d", fWhere.name, fWhere.line, int(fCode) );
+		fMessage = errorStr;
+	}
+	return fMessage.c_str();
+}
+
+std::vector<AudioUnitErrorStats> GetAudioUnitErrorStats()
+{
+	std::lock_guard<std::mutex> lock( gErrorStatsMutex );
+	std::vector<AudioUnitErrorStats> ret;
+	for ( std::map<CallSite, AudioUnitErrorStats>::const_iterator iter = gErrorStats.begin(); iter != gErrorStats.end(); ++iter )
+		ret.push_back( iter->second );
+	return ret;
+}
+
+} // AudioUnits namespace
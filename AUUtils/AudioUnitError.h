@@ -0,0 +1,75 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+#ifndef _AUDIOUNITERROR_H_
+#define _AUDIOUNITERROR_H_
+
+/**********************************************************************************
+
+	AudioUnitError
+
+	How a failed call into an AudioUnit is reported: thrown as an
+	AudioUnitError, or, for probes, returned.  Either way the failure is
+	counted against its call site.
+
+	This file doesn't depend on any Apple headers.
+
+**********************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <exception>
+#include <string>
+#include <vector>
+
+namespace AudioUnits
+{
+
+struct FuncDesc
+{
+	const char* name;
+	int line;
+
+	FuncDesc( const char* n, int l ):
+		name(n), line(l){}
+};
+#define DCL_AU_FUNC(x) const char* x_name = #x; //FuncTimer t(x_name);
+#define AU_DESC FuncDesc( x_name, __LINE__ )
+#define AU_FILEDESC FuncDesc( __FILE__, __LINE__ )
+void FailAudioUnitError( int32_t error, const FuncDesc& desc, bool* negOneErrorCode = NULL );
+
+// for probes, where a failure is an answer rather than a problem: records the
+// failure like FailAudioUnitError, but returns false instead of throwing.
+bool CheckAudioUnitError( int32_t error, const FuncDesc& desc );
+
+// what FailAudioUnitError throws.  The message is only formatted if someone asks for it.
+class AudioUnitError : public std::exception
+{
+public:
+	AudioUnitError( int32_t code, const FuncDesc& where ) : fCode(code), fWhere(where) {}
+
+	int32_t code() const { return fCode; }
+	const FuncDesc& where() const { return fWhere; }
+	const char* what() const noexcept override;
+
+private:
+	int32_t fCode;
+	FuncDesc fWhere;
+	mutable std::string fMessage;
+};
+
+// how often each call site has failed, and how; thrown and probed failures are counted apart.
+struct AudioUnitErrorStats
+{
+	FuncDesc where;
+	int32_t lastError;
+	uint32_t thrown;
+	uint32_t probed;
+};
+std::vector<AudioUnitErrorStats> GetAudioUnitErrorStats();
+
+} // AudioUnits namespace
+
+#endif // _AUDIOUNITERROR_H_
@@ -12,11 +12,13 @@
 **********************************************************************************/
 
 #include "AudioUnitUtils.h"
+#include "ComponentRegistry.h"
 #include <CoreAudio/AudioHardware.h>
 #include <AudioToolbox/AudioUnitUtilities.h>
 #include <AudioUnit/AudioUnitCarbonView.h>
 #include "AUValStatus.h"
 #include <memory>
+#include <stdlib.h>
 
 
 #define kMusicDeviceProperty_DualSchedulingMode 1013
@@ -25,9 +27,49 @@
 namespace AudioUnits
 {
 
+namespace
+{
+	// Base is only driven from one thread at a time while there's a hook.
+	LifecyclePhaseHook gPhaseHook = NULL;
+	LifecyclePhase gCurrentPhase = kPhaseNone;
+
+	// enters a phase for the rest of the block, unless it's already in one.
+	class PhaseScope
+	{
+	public:
+		PhaseScope( LifecyclePhase phase ) : fEntered( gPhaseHook != NULL and gCurrentPhase == kPhaseNone )
+		{
+			if ( fEntered )
+			{
+				gCurrentPhase = phase;
+				gPhaseHook( phase );
+			}
+		}
+		~PhaseScope()
+		{
+			if ( fEntered )
+			{
+				gCurrentPhase = kPhaseNone;
+				if ( gPhaseHook )
+					gPhaseHook( kPhaseNone );
+			}
+		}
+	private:
+		bool fEntered;
+	};
+}
+
+LifecyclePhaseHook SetLifecyclePhaseHook( LifecyclePhaseHook hook )
+{
+	LifecyclePhaseHook previous = gPhaseHook;
+	gPhaseHook = hook;
+	return previous;
+}
+
 bool GetGlobalPropertyInfo(  AudioUnit  ci,  AudioUnitPropertyID inID,
                                 UInt32& outDataSize, Boolean& outWritable, bool* negOneErrorCode = NULL)
 {
+    PhaseScope phase( kPhasePropertyQuery );
     int32_t err = AudioUnitGetPropertyInfo(  ci, inID, kAudioUnitScope_Global, 0, &outDataSize, &outWritable );
     if ( negOneErrorCode ) *negOneErrorCode = err == -1;
     return err == noErr;
@@ -36,6 +78,7 @@ bool GetGlobalPropertyInfo(  AudioUnit  ci,  AudioUnitPropertyID inID,
 void GetGlobalProperty( AudioUnit ci, AudioUnitPropertyID  inID,
                                 void* outData, UInt32&  ioDataSize, const FuncDesc& desc, bool* negOneErrorCode = NULL)
 {
+    PhaseScope phase( kPhasePropertyQuery );
     FailAudioUnitError( AudioUnitGetProperty( ci, inID, kAudioUnitScope_Global, 0, outData, &ioDataSize), desc, negOneErrorCode );
 }
 
@@ -49,6 +92,7 @@ void SetGlobalProperty( AudioUnit ci, AudioUnitPropertyID  inID,
 bool GetPropertyInfo(  AudioUnit  ci,  AudioUnitPropertyID inID, AudioUnitScope scope, AudioUnitElement elem,
                                 UInt32& outDataSize, Boolean& outWritable )
 {
+    PhaseScope phase( kPhasePropertyQuery );
     int32_t error = AudioUnitGetPropertyInfo(  ci, inID, scope, elem, &outDataSize, &outWritable );
 
     if ( error == kAudioUnitErr_Uninitialized)
@@ -63,6 +107,7 @@ bool GetPropertyInfo(  AudioUnit  ci,  AudioUnitPropertyID inID, AudioUnitScope
 void GetProperty( AudioUnit ci, AudioUnitPropertyID  inID, AudioUnitScope scope, AudioUnitElement elem,
                                 void* outData, UInt32&  ioDataSize, const FuncDesc& desc )
 {
+    PhaseScope phase( kPhasePropertyQuery );
     FailAudioUnitError( AudioUnitGetProperty( ci, inID, scope, elem, outData, &ioDataSize), desc );
 }
 
@@ -72,21 +117,36 @@ void SetProperty( AudioUnit ci, AudioUnitPropertyID  inID, AudioUnitScope scope,
     FailAudioUnitError( AudioUnitSetProperty(ci, inID, scope, elem, const_cast<void*>(inData), inDataSize), desc );
 }
 
+// like GetProperty, but hands back the error instead of throwing it.
+template<typename T>
+expected<T, OSStatus> TryGetProperty( AudioUnit ci, AudioUnitPropertyID inID, AudioUnitScope scope, AudioUnitElement elem )
+{
+    PhaseScope phase( kPhasePropertyQuery );
+    T value;
+    UInt32 dataSize = sizeof( T );
+    OSStatus error = AudioUnitGetProperty( ci, inID, scope, elem, &value, &dataSize );
+    if ( error != noErr )
+        return make_unexpected( error );
+    if ( dataSize != sizeof( T ) )
+        return make_unexpected( OSStatus( kAudioUnitErr_InvalidPropertyValue ) );
+    return value;
+}
+
 //--------------------------------
 Base::Base( const AudioComponentDescription& desc ) :
     fComponentDesc(desc),
     fIsInitialized(false),
     fSupportsPrioritizedMIDI(false),
-    fParamListenerRef(NULL)
+    fParamListenerRef(NULL),
 #if SUPPORT_AU_VERSION_1
-	,fRenderProc(NULL)
+	fRenderProc(NULL),
 #endif
+	fParameterCatalogStale(true)
 {
     DCL_AU_FUNC(Base::Base)
+    PhaseScope phase( kPhaseConstruction );
 
-    AudioComponent auComp;
-    AudioComponentDescription nonConst = desc;
-    auComp = AudioComponentFindNext (NULL, &nonConst);
+    AudioComponent auComp = ComponentRegistry::Get().find( desc );
     if ( auComp == NULL )
 		FailAudioUnitError( kAudioUnitErr_FailedInitialization, AU_DESC );
 
@@ -97,6 +157,8 @@ Base::Base( const AudioComponentDescription& desc ) :
 		FailAudioUnitError( kAudioUnitErr_FailedInitialization, AU_DESC );
 
     fCi = newAudioUnit;
+
+	AudioUnitAddPropertyListener( fCi, kAudioUnitProperty_ParameterList, ParameterListChanged, this );
 }
 
 namespace {
@@ -151,6 +213,7 @@ std::string handleToUTF8Str( Handle h )
 
 Base::~Base()
 {
+	PhaseScope phase( kPhaseTeardown );
 	for ( int i = 0; i < fEventListeners.size(); ++i )
 		fEventListeners[i]->BaseDied();
 	fEventListeners.clear();
@@ -158,6 +221,7 @@ Base::~Base()
 	if ( fParamListenerRef != NULL )
 		AUListenerDispose( fParamListenerRef );
 
+	AudioUnitRemovePropertyListenerWithUserData( fCi, kAudioUnitProperty_ParameterList, ParameterListChanged, this );
 	AudioComponentInstanceDispose( fCi );
 	fCi = NULL;
 }
@@ -184,6 +248,7 @@ void Base::SetHostInfo( CFStringRef host, const AUNumVersion& version )
 void Base::Initialize()
 {
 	DCL_AU_FUNC(Initialize)
+	PhaseScope phase( kPhaseInitialize );
 	assert( not fIsInitialized );
 	FailAudioUnitError( AudioUnitInitialize( fCi ), AU_DESC );
 
@@ -198,6 +263,7 @@ void Base::Initialize()
 void Base::Uninitialize()
 {
 	DCL_AU_FUNC(Uninitialize)
+	PhaseScope phase( kPhaseTeardown );
 
 	assert( fIsInitialized );
 
@@ -312,6 +378,7 @@ OSStatus Base::testPropList( CFPropertyListRef plist )
 void Base::setClassInfo( const PropertyList& dict )
 {
 	DCL_AU_FUNC(FInfo)
+	PhaseScope phase( kPhasePresetLoad );
 	CFPropertyListRef propList = dict.getPropList();
 	OSStatus err = testPropList( propList );
 	assert( err == noErr );
@@ -336,6 +403,7 @@ void Base::setClassInfo( const PropertyList& dict )
 
 void Base::setFromMASData( char* buffer, int32_t len )
 {
+	PhaseScope phase( kPhasePresetLoad );
 	PropertyList propList( buffer, len, fComponentDesc );
 	setClassInfo( propList );
 }
@@ -366,6 +434,7 @@ bool Base::presetsRequireInit()
 	dataSize = sizeof( CFArrayRef );
 
 	OSStatus err = AudioUnitGetProperty( fCi, kAudioUnitProperty_FactoryPresets, kAudioUnitScope_Global, 0, &array, &dataSize);
+	CheckAudioUnitError( err, AU_DESC );
 
 	if ( err == kAudioUnitErr_Uninitialized )
 		return true;
@@ -408,6 +477,7 @@ void Base::getCurrentPreset( AUPreset& preset )
 void Base::setCurrentPreset( AUPreset& preset )
 {
 	DCL_AU_FUNC(setCurrentPreset)
+	PhaseScope phase( kPhasePresetLoad );
 
 	OSStatus result = AudioUnitSetProperty ( fCi, kAudioUnitProperty_PresentPreset,
 								kAudioUnitScope_Global, 0,
@@ -543,6 +613,30 @@ float	Base::getParameterValue( int scope, int32_t element, AudioUnitParameterID
 	return 0;
 }
 
+const ParameterCatalog& Base::getParameterCatalog()
+{
+	// cleared first, so a change reported while we're building isn't lost.
+	if ( fParameterCatalogStale.exchange( false ) )
+	{
+		try
+		{
+			fParameterCatalog.build( *this, kAudioUnitScope_Global );
+		}
+		catch(...)
+		{
+			fParameterCatalogStale = true;
+			throw;
+		}
+	}
+	return fParameterCatalog;
+}
+
+void Base::ParameterListChanged( void* inRefCon, AudioUnit, AudioUnitPropertyID, AudioUnitScope inScope, AudioUnitElement )
+{
+	if ( inScope == kAudioUnitScope_Global )
+		((Base*)inRefCon)->fParameterCatalogStale = true;
+}
+
 //---------
 #if 0
 std::vector<AudioUnitMIDIControlMapping> Base::getMIDIControlMapping()
@@ -661,6 +755,26 @@ optional<Float64> Base::getTail()
 	return nullptr;
 }
 
+expected<Float64, OSStatus> Base::tryGetLatency()
+{
+	return TryGetProperty<Float64>( fCi, kAudioUnitProperty_Latency, kAudioUnitScope_Global, 0 );
+}
+
+expected<Float64, OSStatus> Base::tryGetTail()
+{
+	return TryGetProperty<Float64>( fCi, kAudioUnitProperty_TailTime, kAudioUnitScope_Global, 0 );
+}
+
+expected<UInt32, OSStatus> Base::tryGetNumBusses( int scope )
+{
+	return TryGetProperty<UInt32>( fCi, kAudioUnitProperty_ElementCount, scope, 0 );
+}
+
+expected<AudioStreamBasicDescription, OSStatus> Base::tryGetStreamFormat( int scope, int busNumber )
+{
+	return TryGetProperty<AudioStreamBasicDescription>( fCi, kAudioUnitProperty_StreamFormat, scope, busNumber );
+}
+
 void	Base::setMaxFramesPerSlice( uint32_t max )
 {
 	DCL_AU_FUNC(setMaxFramesPerSlice)
@@ -770,14 +884,8 @@ std::vector<AudioUnitOtherPluginDesc> Base::getReplacementList()
 	{
 
 		dataSize = sizeof( CFArrayRef );
-		try
-		{
-			GetGlobalProperty( fCi, kAudioUnitMigrateProperty_FromPlugin, &array, dataSize, AU_DESC);
-		}
-		catch(...)
-		{
+		if ( not CheckAudioUnitError( AudioUnitGetProperty( fCi, kAudioUnitMigrateProperty_FromPlugin, kAudioUnitScope_Global, 0, &array, &dataSize ), AU_DESC ) )
 			array = NULL;
-		}
 
 		if ( array != NULL )
 		{
@@ -850,15 +958,8 @@ optional<CFStringRef> Base::getBusName( int scope, int bus )
 	{
 		dataSize = sizeof( CFStringRef );
         CFStringRef name;
-		try
-		{
-			GetProperty( fCi, kAudioUnitProperty_ElementName, scope, bus, &name, dataSize, AU_DESC );
-		}
-		catch(...)
-		{
-			name = 0;
+		if ( not CheckAudioUnitError( AudioUnitGetProperty( fCi, kAudioUnitProperty_ElementName, scope, bus, &name, &dataSize ), AU_DESC ) )
 			return nullptr;
-		}
 		return name;
 	}
 	return nullptr;
@@ -935,6 +1036,7 @@ void Base::render( AudioUnitRenderActionFlags& ioActionFlags,
   					AudioBufferList* ioData )
 {
 	DCL_AU_FUNC(renderSlice)
+	PhaseScope phase( kPhaseRender );
 	FailAudioUnitError(  AudioUnitRender( fCi, &ioActionFlags, &inTimeStamp, inOutputBusNumber, inNumberFrames, ioData ), AU_DESC );
 }
 
@@ -943,39 +1045,81 @@ void Base::render( AudioUnitRenderActionFlags& ioActionFlags,
 namespace
 {
 
-bool HasValidName( const AudioComponentDescription& desc )
+void AddComponentsToVector( std::vector<AudioComponentDescription>& vec, uint32_t component_type  )
+{
+	std::vector<AudioComponentDescription> found = ComponentRegistry::Get().getComponentsOfType( component_type, true );
+	vec.insert( vec.end(), found.begin(), found.end() );
+}
+} // unnamed namespace
+std::vector<std::string> GetComponentDirectories()
 {
-	optional<UTF8ComponentInfo> info = GetUTF8ComponentInfo( desc );
-	return info.hasValue() and (info->name.length() > 5);
+    std::vector<std::string> dirs;
+    dirs.push_back( "/System/Library/Components" );
+    dirs.push_back( "/Library/Audio/Plug-Ins/Components" );
+
+    const char* home = getenv( "HOME" );
+    if ( home )
+        dirs.push_back( std::string( home ) + "/Library/Audio/Plug-Ins/Components" );
+    return dirs;
 }
 
-void AddComponentsToVector( std::vector<AudioComponentDescription>& vec, uint32_t component_type  )
+namespace
+{
+OSType fourCharCode( CFTypeRef str )
 {
-	int mNumUnits = 0;
+    char chars[5] = { ' ', ' ', ' ', ' ', 0 };
+    if ( str == NULL or CFGetTypeID( str ) != CFStringGetTypeID() )
+        return 0;
 
-	AudioComponentDescription	cd2;
+    char buffer[16];
+    if ( not CFStringGetCString( (CFStringRef)str, buffer, sizeof( buffer ), kCFStringEncodingMacRoman ) )
+        return 0;
 
- 	cd2.componentType = component_type;
-	cd2.componentFlags = 0;
-	cd2.componentFlagsMask = 0;
-	cd2.componentSubType = 0;
-	cd2.componentManufacturer = 0;
+    // space-pad
+    for ( int i = 0; i < 4 and buffer[i]; ++i )
+        chars[i] = buffer[i];
+    return (OSType(uint8_t(chars[0])) << 24) | (OSType(uint8_t(chars[1])) << 16) | (OSType(uint8_t(chars[2])) << 8) | OSType(uint8_t(chars[3]));
+}
+} // unnamed namespace
 
-	AudioComponent comp = NULL;
+std::vector<AudioComponentDescription> GetBundleComponents( const std::string& bundlePath )
+{
+    std::vector<AudioComponentDescription> ret;
 
-	// find all the v2 effect AUs
- 	comp = AudioComponentFindNext (NULL, &cd2);
-	while (comp != NULL)
-	{
-		AudioComponentDescription desc;
-		AudioComponentGetDescription (comp, &desc);
-		if ( HasValidName( desc ) )
-			vec.push_back( desc );
+    ScopedCFTypeRef<CFURLRef> url( CFURLCreateFromFileSystemRepresentation( NULL, (const UInt8*)bundlePath.c_str(), bundlePath.size(), true ) );
+    if ( not url )
+        return ret;
 
-		comp = AudioComponentFindNext (comp, &cd2);
-	}
+    ScopedCFTypeRef<CFBundleRef> bundle( CFBundleCreate( NULL, url.get() ) );
+    if ( not bundle )
+        return ret;
+
+    // bundles that only have Component Manager resources don't list anything here.
+    CFTypeRef components = CFBundleGetValueForInfoDictionaryKey( bundle.get(), CFSTR("AudioComponents") );
+    if ( components == NULL or CFGetTypeID( components ) != CFArrayGetTypeID() )
+        return ret;
+
+    CFIndex count = CFArrayGetCount( (CFArrayRef)components );
+    for ( CFIndex i = 0; i < count; ++i )
+    {
+        CFTypeRef entry = CFArrayGetValueAtIndex( (CFArrayRef)components, i );
+        if ( entry == NULL or CFGetTypeID( entry ) != CFDictionaryGetTypeID() )
+            continue;
+
+        CFDictionaryRef dict = (CFDictionaryRef)entry;
+        AudioComponentDescription desc;
+        desc.componentType = fourCharCode( CFDictionaryGetValue( dict, CFSTR("type") ) );
+        desc.componentSubType = fourCharCode( CFDictionaryGetValue( dict, CFSTR("subtype") ) );
+        desc.componentManufacturer = fourCharCode( CFDictionaryGetValue( dict, CFSTR("manufacturer") ) );
+        desc.componentFlags = 0;
+        desc.componentFlagsMask = 0;
+
+        if ( desc.componentType and desc.componentSubType and desc.componentManufacturer )
+            ret.push_back( desc );
+    }
+    return ret;
 }
-} // unnamed namespace
+
 std::vector<AudioComponentDescription> GetEffectList()
 {
 	std::vector<AudioComponentDescription> ret;
@@ -999,62 +1143,15 @@ std::vector<AudioComponentDescription> GetCompleteList()
 	return ret;
 }
 
-void FailAudioUnitError( int32_t error, const FuncDesc& desc, bool* negOneErrorCode )
-{
-	if ( error != noErr )
-	{
-		if ( negOneErrorCode )
-			*negOneErrorCode = (error == -1);
-
-		char errorStr[500];
-		sprintf( errorStr, "Failure: %s %d %d", desc.name, desc.line, error );
-        throw std::runtime_error(errorStr);
-	}
-	else
-	{
-		if ( negOneErrorCode )
-			*negOneErrorCode = false;
-	}
-}
 
 optional<UTF8ComponentInfo> GetUTF8ComponentInfo( const AudioComponentDescription& desc )
 {
-    AudioComponent auComp = AudioComponentFindNext (NULL, &desc);
-
-	if ( !auComp )
-        return nullptr;
-    
-    UTF8ComponentInfo info;
-    
-    ScopedCFTypeRef<CFStringRef> name;
-    CFStringRef rawName;
-    
-    if(AudioComponentCopyName(auComp, &rawName) != noErr)
-        return nullptr;
-    
-    name.reset(rawName); // adopt the cfstringref
-
-    std::vector<char> cStringBuffer(CFStringGetLength(name.get()) * 6 + 1);
-    if(not CFStringGetCString(name.get(), cStringBuffer.data(), cStringBuffer.size(), kCFStringEncodingUTF8))
-        return nullptr;
-
-    // convert to c++ string
-    info.name = cStringBuffer.data();
-
-	return info;
+    return ComponentRegistry::Get().getInfo( desc );
 }
 
 optional<uint32_t> GetComponentVersion( const AudioComponentDescription& desc )
 {
-    AudioComponent auComp = AudioComponentFindNext (NULL, &desc);
-    if( !auComp )
-        return nullptr;
-    
-    UInt32 version = 0;
-    if(AudioComponentGetVersion(auComp, &version) != noErr)
-        return nullptr;
-    
-    return version;
+    return ComponentRegistry::Get().getVersion( desc );
 }
 
 CFURLRef Base::getMIDIXMLDoc()
@@ -1065,17 +1162,11 @@ CFURLRef Base::getMIDIXMLDoc()
 	UInt32 dataSize;
 	Boolean writable;
 
-	try
+	if ( GetGlobalPropertyInfo( fCi,  kMusicDeviceProperty_MIDIXMLNames, dataSize, writable  ) )
 	{
-	 	if ( GetGlobalPropertyInfo( fCi,  kMusicDeviceProperty_MIDIXMLNames, dataSize, writable  ) )
-		{
-			dataSize = sizeof( CFURLRef );
-			GetGlobalProperty( fCi, kMusicDeviceProperty_MIDIXMLNames, &url, dataSize, AU_DESC );
-		}
-	}
-	catch(...)
-	{
-		return NULL;
+		dataSize = sizeof( CFURLRef );
+		if ( not CheckAudioUnitError( AudioUnitGetProperty( fCi, kMusicDeviceProperty_MIDIXMLNames, kAudioUnitScope_Global, 0, &url, &dataSize ), AU_DESC ) )
+			return NULL;
 	}
 	return url;
 }
@@ -1116,8 +1207,8 @@ void Base::getSupportedLayouts( bool input,  int bus, std::vector<AudioChannelLa
 			if ( num > 0 )
 			{
 				std::vector<AudioChannelLayoutTag> buffer( num );
-				GetProperty( fCi, kAudioUnitProperty_SupportedChannelLayoutTags, input ? kAudioUnitScope_Input : kAudioUnitScope_Output, bus, buffer.data(), dataSize, AU_DESC );
-				layouts = std::move(buffer);
+				if ( CheckAudioUnitError( AudioUnitGetProperty( fCi, kAudioUnitProperty_SupportedChannelLayoutTags, input ? kAudioUnitScope_Input : kAudioUnitScope_Output, bus, buffer.data(), &dataSize ), AU_DESC ) )
+					layouts = std::move(buffer);
 			}
 		}
 	}
@@ -1166,15 +1257,7 @@ bool Base::setChannelLayout(  bool input, int bus, const AudioChannelLayout* lay
 {
 	DCL_AU_FUNC(setChannelLayout)
 
-	try
-	{
-		SetProperty( fCi,  kAudioUnitProperty_AudioChannelLayout, input ? kAudioUnitScope_Input : kAudioUnitScope_Output, bus, layout, byteSize, AU_DESC  );
-		return true;
-	}
-	catch(...)
-	{
-	}
-	return false;
+	return CheckAudioUnitError( AudioUnitSetProperty( fCi, kAudioUnitProperty_AudioChannelLayout, input ? kAudioUnitScope_Input : kAudioUnitScope_Output, bus, layout, byteSize ), AU_DESC );
 }
 
 namespace
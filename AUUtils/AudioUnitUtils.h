@@ -14,14 +14,19 @@
 
 **********************************************************************************/
 
+#include <atomic>
+#include <exception>
 #include <vector>
 #include <string>
 #include <AudioUnit/AudioUnit.h>
 #include <AudioToolbox/AudioUnitUtilities.h>
 #include <Carbon/Carbon.h>
 #include <CoreFoundation/CFURL.h>
+#include "AudioUnitError.h"
 #include "optional.h"
+#include "expected.h"
 #include "scoped_cftyperef.h"
+#include "ParameterCatalog.h"
 
 typedef OSStatus (*HostCallback_GetTransportState) (void 	*inHostUserData,
 										Boolean 			*outIsPlaying,
@@ -78,6 +83,26 @@ private:
     bool fGeneric;
 };
 
+// the stages of a unit's life.  A host can set a hook to hear when Base moves
+// between them, to attribute what happens (allocations, say) to each one.
+// Only the outermost stage counts, so the property queries that Initialize
+// makes belong to initializing.  The hook follows one unit at a time: while
+// units are driven from several threads, it has to be set to NULL.
+enum LifecyclePhase
+{
+	kPhaseNone,
+	kPhaseConstruction,
+	kPhaseInitialize,
+	kPhasePropertyQuery,
+	kPhasePresetLoad,
+	kPhaseRender,
+	kPhaseTeardown,
+	kNumLifecyclePhases
+};
+typedef void (*LifecyclePhaseHook)( LifecyclePhase phase );
+// returns the hook that was set.
+LifecyclePhaseHook SetLifecyclePhaseHook( LifecyclePhaseHook hook );
+
 class PropertyList;
 
 class Base
@@ -112,6 +137,11 @@ public:
 	void	getParameterValueStrings( int scope, AudioUnitParameterID id, CFArrayRef& strings );
 	float	getParameterValue( int scope, int32_t element, AudioUnitParameterID id );
 
+	// the global parameters, all described in one pass the first time they're
+	// asked for, and again after the plug-in reports that its parameter list
+	// changed.  The reference is good until the next call.
+	const ParameterCatalog& getParameterCatalog();
+
 /*  TODO: rewrite using standard-compliant types.
 	bool	parameterValueToString( int scope, int32_t element, AudioUnitParameterID id, float val, MotuString* str );
 	bool	stringToParameterValue( int scope, int32_t element, AudioUnitParameterID id, ConstMotuString* str, float& val );
@@ -131,6 +161,12 @@ public:
 	void	setMaxFramesPerSlice( uint32_t );
 	void	setRealtimeHint( bool realtime );
 
+	// these report a failure as its OSStatus, rather than throwing it.
+	expected<Float64, OSStatus> tryGetLatency();
+	expected<Float64, OSStatus> tryGetTail();
+	expected<UInt32, OSStatus> tryGetNumBusses( int scope );
+	expected<AudioStreamBasicDescription, OSStatus> tryGetStreamFormat( int scope, int busNumber );
+
 	GUIInfo getGUIInfo();
  	optional<CocoaUIInfo> getCocoaUIInfo();
 
@@ -235,6 +271,11 @@ private:
 
 	void ListenToEvent( const AudioUnitEvent*	inEvent, UInt64 inEventHostTime, Float32 inParameterValue );
 	std::vector<EventListener*> fEventListeners;
+
+	static void ParameterListChanged( void* inRefCon, AudioUnit inUnit, AudioUnitPropertyID inID,
+									AudioUnitScope inScope, AudioUnitElement inElement );
+	ParameterCatalog fParameterCatalog;
+	std::atomic<bool> fParameterCatalogStale;	// set from whatever thread the plug-in notifies on
 	OSStatus testPropList( CFPropertyListRef plist );
 };
 
@@ -244,26 +285,19 @@ struct UTF8ComponentInfo
     std::string info;
 };
 
+// these look the component up in the ComponentRegistry.
 optional<UTF8ComponentInfo> GetUTF8ComponentInfo( const AudioComponentDescription& desc );
 optional<uint32_t> GetComponentVersion( const AudioComponentDescription& desc );
 
+// where component bundles get installed.
+std::vector<std::string> GetComponentDirectories();
+// the components a bundle's Info.plist declares.
+std::vector<AudioComponentDescription> GetBundleComponents( const std::string& bundlePath );
+
 std::vector<AudioComponentDescription> GetEffectList();
 std::vector<AudioComponentDescription> GetSynthList();
 std::vector<AudioComponentDescription> GetCompleteList();
 
-struct FuncDesc
-{
-	const char* name;
-	int line;
-
-	FuncDesc( const char* n, int l ):
-		name(n), line(l){}
-};
-#define DCL_AU_FUNC(x) const char* x_name = #x; //FuncTimer t(x_name);
-#define AU_DESC FuncDesc( x_name, __LINE__ )
-#define AU_FILEDESC FuncDesc( __FILE__, __LINE__ )
-void FailAudioUnitError( int32_t error, const FuncDesc& desc, bool* negOneErrorCode = NULL );
-
 
 class PropertyList
 {
@@ -0,0 +1,290 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "BundleTracker.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace AudioUnits
+{
+
+namespace
+{
+const char kBundleExtension[] = ".component";
+
+const uint64_t kFNVOffset = 14695981039346656037ull;
+const uint64_t kFNVPrime = 1099511628211ull;
+
+uint64_t fnv1a( uint64_t hash, const void* data, size_t size )
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>( data );
+    for ( size_t i = 0; i < size; ++i )
+        hash = (hash ^ bytes[i]) * kFNVPrime;
+    return hash;
+}
+
+uint64_t hashFile( const std::string& path )
+{
+    uint64_t hash = kFNVOffset;
+    int fd = open( path.c_str(), O_RDONLY );
+    if ( fd < 0 )
+        return 0;
+
+    char buffer[16384];
+    ssize_t bytes;
+    while ( (bytes = read( fd, buffer, sizeof( buffer ) )) > 0 )
+        hash = fnv1a( hash, buffer, bytes );
+    close( fd );
+    return hash;
+}
+
+bool endsWith( const std::string& str, const char* suffix )
+{
+    size_t len = strlen( suffix );
+    return str.size() >= len and str.compare( str.size() - len, len, suffix ) == 0;
+}
+
+template <class F>
+void forEachDirectoryEntry( const std::string& path, F f )
+{
+    DIR* dir = opendir( path.c_str() );
+    if ( not dir )
+        return;
+
+    while ( struct dirent* entry = readdir( dir ) )
+    {
+        if ( entry->d_name[0] != '.' )
+            f( std::string( entry->d_name ) );
+    }
+    closedir( dir );
+}
+}
+
+BundleTracker::BundleTracker( ComponentReader reader ) :
+    fReader(reader)
+{
+}
+
+void BundleTracker::readBundle( const std::string& path, Bundle& bundle )
+{
+    struct stat info;
+    const std::string plistPath = path + "/Contents/Info.plist";
+    bundle.plistStamp = Stamp();
+    if ( stat( plistPath.c_str(), &info ) == 0 )
+    {
+#ifdef __APPLE__
+        bundle.plistStamp.seconds = info.st_mtimespec.tv_sec;
+        bundle.plistStamp.nanoseconds = info.st_mtimespec.tv_nsec;
+#else
+        bundle.plistStamp.seconds = info.st_mtim.tv_sec;
+        bundle.plistStamp.nanoseconds = info.st_mtim.tv_nsec;
+#endif
+        bundle.plistStamp.size = info.st_size;
+    }
+
+    // the newest of the executables, and their total size.
+    const std::string executableDir = path + "/Contents/MacOS";
+    bundle.executableStamp = Stamp();
+    forEachDirectoryEntry( executableDir, [&]( const std::string& name )
+    {
+        struct stat exeInfo;
+        if ( stat( (executableDir + "/" + name).c_str(), &exeInfo ) != 0 )
+            return;
+
+        Stamp stamp;
+#ifdef __APPLE__
+        stamp.seconds = exeInfo.st_mtimespec.tv_sec;
+        stamp.nanoseconds = exeInfo.st_mtimespec.tv_nsec;
+#else
+        stamp.seconds = exeInfo.st_mtim.tv_sec;
+        stamp.nanoseconds = exeInfo.st_mtim.tv_nsec;
+#endif
+        if ( stamp.seconds > bundle.executableStamp.seconds or
+             (stamp.seconds == bundle.executableStamp.seconds and stamp.nanoseconds > bundle.executableStamp.nanoseconds) )
+        {
+            bundle.executableStamp.seconds = stamp.seconds;
+            bundle.executableStamp.nanoseconds = stamp.nanoseconds;
+        }
+        bundle.executableStamp.size += exeInfo.st_size;
+    });
+}
+
+BundleChanges BundleTracker::scan( const std::vector<std::string>& directories )
+{
+    BundleChanges changes;
+    std::map<std::string, Bundle> found;
+
+    for ( const std::string& dir : directories )
+    {
+        forEachDirectoryEntry( dir, [&]( const std::string& name )
+        {
+            if ( endsWith( name, kBundleExtension ) )
+                readBundle( dir + "/" + name, found[dir + "/" + name] );
+        });
+    }
+
+    for ( auto& entry : found )
+    {
+        const std::string& path = entry.first;
+        Bundle& bundle = entry.second;
+
+        auto old = fBundles.find( path );
+        if ( old != fBundles.end() and old->second.plistStamp == bundle.plistStamp and old->second.executableStamp == bundle.executableStamp )
+        {
+            bundle = old->second;
+            continue;
+        }
+
+        bundle.plistHash = hashFile( path + "/Contents/Info.plist" );
+
+        uint64_t fingerprint = fnv1a( kFNVOffset, &bundle.plistHash, sizeof( bundle.plistHash ) );
+        fingerprint = fnv1a( fingerprint, &bundle.executableStamp, sizeof( bundle.executableStamp ) );
+        bundle.fingerprint = fingerprint;
+
+        if ( old != fBundles.end() and old->second.fingerprint == bundle.fingerprint )
+        {
+            // just touched.
+            bundle.components = old->second.components;
+            continue;
+        }
+
+        bundle.components = fReader( path );
+        changes.components.insert( changes.components.end(), bundle.components.begin(), bundle.components.end() );
+
+        if ( old == fBundles.end() )
+            changes.added.push_back( path );
+        else
+        {
+            changes.modified.push_back( path );
+            changes.components.insert( changes.components.end(), old->second.components.begin(), old->second.components.end() );
+        }
+    }
+
+    for ( const auto& entry : fBundles )
+    {
+        if ( found.find( entry.first ) == found.end() )
+        {
+            changes.removed.push_back( entry.first );
+            changes.components.insert( changes.components.end(), entry.second.components.begin(), entry.second.components.end() );
+        }
+    }
+
+    fBundles.swap( found );
+    rebuildComponentIndex();
+    return changes;
+}
+
+void BundleTracker::rebuildComponentIndex()
+{
+    fComponentBundles.clear();
+    for ( const auto& entry : fBundles )
+    {
+        for ( const ComponentKey& component : entry.second.components )
+            fComponentBundles.insert( std::make_pair( component, entry.first ) );
+    }
+}
+
+uint64_t BundleTracker::getFingerprint( const ComponentKey& component ) const
+{
+    auto iter = fComponentBundles.find( component );
+    if ( iter == fComponentBundles.end() )
+        return 0;
+    return fBundles.find( iter->second )->second.fingerprint;
+}
+
+// the state file has a line per bundle:
+//	<path>\t<plist stamp>\t<executable stamp>\t<plist hash>\t<fingerprint>\t<components>
+// where a stamp is "seconds nanoseconds size" and components are "type:subtype:manufacturer" separated by spaces.
+void BundleTracker::load( const std::string& path )
+{
+    fBundles.clear();
+
+    FILE* file = fopen( path.c_str(), "r" );
+    if ( not file )
+    {
+        rebuildComponentIndex();
+        return;
+    }
+
+    std::string line;
+    int c;
+    while ( (c = fgetc( file )) != EOF )
+    {
+        if ( c != '\n' )
+        {
+            line += char(c);
+            continue;
+        }
+
+        size_t tab = line.find( '\t' );
+        if ( tab != std::string::npos )
+        {
+            Bundle bundle;
+            int consumed = 0;
+            const char* fields = line.c_str() + tab + 1;
+            if ( sscanf( fields, "%" SCNd64 " %" SCNd64 " %" SCNd64 "\t%" SCNd64 " %" SCNd64 " %" SCNd64 "\t%" SCNu64 "\t%" SCNu64 "%n",
+                         &bundle.plistStamp.seconds, &bundle.plistStamp.nanoseconds, &bundle.plistStamp.size,
+                         &bundle.executableStamp.seconds, &bundle.executableStamp.nanoseconds, &bundle.executableStamp.size,
+                         &bundle.plistHash, &bundle.fingerprint, &consumed ) == 8 )
+            {
+                const char* components = fields + consumed;
+                ComponentKey key;
+                int used;
+                while ( sscanf( components, " %" SCNu32 ":%" SCNu32 ":%" SCNu32 "%n", &key.type, &key.subType, &key.manufacturer, &used ) == 3 )
+                {
+                    bundle.components.push_back( key );
+                    components += used;
+                }
+                fBundles[line.substr( 0, tab )] = bundle;
+            }
+        }
+        line.clear();
+    }
+    fclose( file );
+
+    rebuildComponentIndex();
+}
+
+bool BundleTracker::save( const std::string& path ) const
+{
+    // several validators can be finishing at once, so each writes its own temporary file.
+    char suffix[32];
+    snprintf( suffix, sizeof( suffix ), ".%d.tmp", int(getpid()) );
+    std::string tempPath = path + suffix;
+
+    FILE* file = fopen( tempPath.c_str(), "w" );
+    if ( not file )
+        return false;
+
+    for ( const auto& entry : fBundles )
+    {
+        const Bundle& bundle = entry.second;
+        fprintf( file, "%s\t%" PRId64 " %" PRId64 " %" PRId64 "\t%" PRId64 " %" PRId64 " %" PRId64 "\t%" PRIu64 "\t%" PRIu64 "\t",
+                 entry.first.c_str(),
+                 bundle.plistStamp.seconds, bundle.plistStamp.nanoseconds, bundle.plistStamp.size,
+                 bundle.executableStamp.seconds, bundle.executableStamp.nanoseconds, bundle.executableStamp.size,
+                 bundle.plistHash, bundle.fingerprint );
+        for ( const ComponentKey& key : bundle.components )
+            fprintf( file, " %" PRIu32 ":%" PRIu32 ":%" PRIu32, key.type, key.subType, key.manufacturer );
+        fprintf( file, "\n" );
+    }
+
+    bool ok = (fclose( file ) == 0);
+    if ( not ok )
+    {
+        unlink( tempPath.c_str() );
+        return false;
+    }
+    return rename( tempPath.c_str(), path.c_str() ) == 0;
+}
+
+} // namespace AudioUnits
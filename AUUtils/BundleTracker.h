@@ -0,0 +1,121 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+#ifndef _BUNDLETRACKER_H_
+#define _BUNDLETRACKER_H_
+
+/**********************************************************************************
+
+	BundleTracker
+
+	Keeps track of the component bundles in the plug-in directories
+	between runs, so that after something is installed only the bundles
+	that were added, removed or modified need to be looked at again.
+
+	A scan only stats each bundle's Info.plist and executables.  The
+	Info.plist is hashed, and the bundle's components read, only for
+	bundles whose stamps have moved; a bundle that was just touched
+	keeps its components and fingerprint.
+
+	This polls rather than relying on change notifications (there is no
+	inotify on the Mac, and FSEvents wouldn't help a process that only
+	lives for one validation).  The state file is plain text.
+
+	This file doesn't depend on any Apple headers.
+
+**********************************************************************************/
+
+#include <functional>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace AudioUnits
+{
+
+struct ComponentKey
+{
+    ComponentKey() : type(0), subType(0), manufacturer(0) {}
+    ComponentKey( uint32_t t, uint32_t s, uint32_t m ) : type(t), subType(s), manufacturer(m) {}
+
+    bool operator< ( const ComponentKey& k ) const
+    {
+        if ( type != k.type )
+            return type < k.type;
+        if ( subType != k.subType )
+            return subType < k.subType;
+        return manufacturer < k.manufacturer;
+    }
+
+    uint32_t type;
+    uint32_t subType;
+    uint32_t manufacturer;
+};
+
+struct BundleChanges
+{
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+    std::vector<std::string> modified;
+
+    // the components of every bundle above (for modified bundles, before and after).
+    std::vector<ComponentKey> components;
+
+    bool empty() const { return added.empty() and removed.empty() and modified.empty(); }
+};
+
+class BundleTracker
+{
+public:
+    // reads the components a bundle provides.
+    typedef std::function<std::vector<ComponentKey> ( const std::string& bundlePath )> ComponentReader;
+
+    explicit BundleTracker( ComponentReader reader );
+
+    // a missing or unreadable state file means every bundle will show up as added.
+    void load( const std::string& path );
+    bool save( const std::string& path ) const;
+
+    // looks for *.component bundles in the directories, and returns what changed since the last scan.
+    BundleChanges scan( const std::vector<std::string>& directories );
+
+    // identifies the contents of the bundle holding the component; 0 if no tracked bundle does.
+    uint64_t getFingerprint( const ComponentKey& component ) const;
+
+private:
+    struct Stamp
+    {
+        Stamp() : seconds(0), nanoseconds(0), size(0) {}
+        bool operator== ( const Stamp& s ) const { return seconds == s.seconds and nanoseconds == s.nanoseconds and size == s.size; }
+        bool operator!= ( const Stamp& s ) const { return not (*this == s); }
+
+        int64_t seconds;
+        int64_t nanoseconds;
+        int64_t size;
+    };
+
+    struct Bundle
+    {
+        Bundle() : plistHash(0), fingerprint(0) {}
+
+        Stamp plistStamp;
+        Stamp executableStamp;
+        uint64_t plistHash;
+        uint64_t fingerprint;
+        std::vector<ComponentKey> components;
+    };
+
+    void readBundle( const std::string& path, Bundle& bundle );
+    void rebuildComponentIndex();
+
+    ComponentReader fReader;
+    std::map<std::string, Bundle> fBundles;
+    std::map<ComponentKey, std::string> fComponentBundles;
+};
+
+} // namespace AudioUnits
+
+#endif // _BUNDLETRACKER_H_
@@ -0,0 +1,328 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "ComponentCatalog.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace AudioUnits
+{
+
+namespace
+{
+const uint32_t kCatalogMagic = 'AUcg';
+const uint32_t kCatalogFormatVersion = 2;
+
+const char kBundleExtension[] = ".component";
+
+// a file or directory that doesn't exist is stamped with this.
+const int64_t kMissing = -1;
+
+void getModificationTime( const std::string& path, int64_t& seconds, int64_t& nanoseconds, int64_t* size = NULL )
+{
+    struct stat info;
+    if ( stat( path.c_str(), &info ) != 0 )
+    {
+        seconds = nanoseconds = kMissing;
+        if ( size )
+            *size = kMissing;
+        return;
+    }
+
+    if ( size )
+        *size = info.st_size;
+
+#ifdef __APPLE__
+    seconds = info.st_mtimespec.tv_sec;
+    nanoseconds = info.st_mtimespec.tv_nsec;
+#else
+    seconds = info.st_mtim.tv_sec;
+    nanoseconds = info.st_mtim.tv_nsec;
+#endif
+}
+
+bool isBundleName( const char* name )
+{
+    size_t len = strlen( name );
+    size_t extensionLen = sizeof( kBundleExtension ) - 1;
+    return name[0] != '.' and len > extensionLen and strcmp( name + len - extensionLen, kBundleExtension ) == 0;
+}
+
+bool entryLess( const CatalogEntry& a, const CatalogEntry& b )
+{
+    if ( a.type != b.type )
+        return a.type < b.type;
+    if ( a.subType != b.subType )
+        return a.subType < b.subType;
+    return a.manufacturer < b.manufacturer;
+}
+
+bool writeAll( int fd, const void* data, size_t size )
+{
+    const char* bytes = static_cast<const char*>( data );
+    while ( size > 0 )
+    {
+        ssize_t written = ::write( fd, bytes, size );
+        if ( written <= 0 )
+            return false;
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+}
+
+//--------------------------------
+ComponentCatalogWriter::ComponentCatalogWriter()
+{
+}
+
+uint32_t ComponentCatalogWriter::intern( const std::string& str )
+{
+    auto iter = fStringOffsets.find( str );
+    if ( iter != fStringOffsets.end() )
+        return iter->second;
+
+    uint32_t offset = uint32_t( fStringPool.size() );
+    fStringPool.append( str.c_str(), str.size() + 1 );
+    fStringOffsets[str] = offset;
+    return offset;
+}
+
+void ComponentCatalogWriter::addWatchedDirectory( const std::string& path )
+{
+    CatalogDirectory dir;
+    dir.pathOffset = intern( path );
+    dir.reserved = 0;
+    getModificationTime( path, dir.modifiedSeconds, dir.modifiedNanoseconds );
+    fDirectories.push_back( dir );
+
+    DIR* contents = opendir( path.c_str() );
+    if ( not contents )
+        return;
+    while ( struct dirent* entry = readdir( contents ) )
+    {
+        if ( not isBundleName( entry->d_name ) )
+            continue;
+
+        std::string plistPath = path + "/" + entry->d_name + "/Contents/Info.plist";
+        CatalogBundle bundle;
+        bundle.plistPathOffset = intern( plistPath );
+        bundle.reserved = 0;
+        getModificationTime( plistPath, bundle.modifiedSeconds, bundle.modifiedNanoseconds, &bundle.size );
+        fBundles.push_back( bundle );
+    }
+    closedir( contents );
+}
+
+void ComponentCatalogWriter::addComponent( uint32_t type, uint32_t subType, uint32_t manufacturer,
+                                           const std::string* name, const uint32_t* version )
+{
+    CatalogEntry entry;
+    entry.type = type;
+    entry.subType = subType;
+    entry.manufacturer = manufacturer;
+    entry.version = version ? *version : 0;
+    entry.nameOffset = name ? intern( *name ) : 0;
+    entry.flags = (name ? CatalogEntry::kHasName : 0) | (version ? CatalogEntry::kHasVersion : 0);
+    fEntries.push_back( entry );
+}
+
+bool ComponentCatalogWriter::write( const std::string& path )
+{
+    // keep the first of any duplicates, the same as the component list does.
+    std::stable_sort( fEntries.begin(), fEntries.end(), entryLess );
+    fEntries.erase( std::unique( fEntries.begin(), fEntries.end(),
+                                 []( const CatalogEntry& a, const CatalogEntry& b ) { return not entryLess( a, b ) and not entryLess( b, a ); } ),
+                    fEntries.end() );
+
+    CatalogHeader header;
+    header.magic = kCatalogMagic;
+    header.formatVersion = kCatalogFormatVersion;
+    header.directoryCount = uint32_t( fDirectories.size() );
+    header.bundleCount = uint32_t( fBundles.size() );
+    header.entryCount = uint32_t( fEntries.size() );
+    header.stringPoolSize = uint32_t( fStringPool.size() );
+
+    // named for this process, so copies of the validator writing at once don't share it.
+    char suffix[32];
+    snprintf( suffix, sizeof( suffix ), ".%d.tmp", int( getpid() ) );
+    std::string tempPath = path + suffix;
+
+    int fd = ::open( tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if ( fd < 0 )
+        return false;
+
+    bool ok = writeAll( fd, &header, sizeof( header ) )
+              and writeAll( fd, fDirectories.data(), fDirectories.size() * sizeof( CatalogDirectory ) )
+              and writeAll( fd, fBundles.data(), fBundles.size() * sizeof( CatalogBundle ) )
+              and writeAll( fd, fEntries.data(), fEntries.size() * sizeof( CatalogEntry ) )
+              and writeAll( fd, fStringPool.data(), fStringPool.size() );
+    ok = (::close( fd ) == 0) and ok;
+
+    if ( not ok )
+    {
+        unlink( tempPath.c_str() );
+        return false;
+    }
+    return rename( tempPath.c_str(), path.c_str() ) == 0;
+}
+
+//--------------------------------
+ComponentCatalog::ComponentCatalog() :
+    fMapping(NULL),
+    fMappingSize(0),
+    fHeader(NULL),
+    fDirectories(NULL),
+    fBundles(NULL),
+    fEntries(NULL),
+    fStringPool(NULL)
+{
+}
+
+ComponentCatalog::~ComponentCatalog()
+{
+    close();
+}
+
+void ComponentCatalog::close()
+{
+    if ( fMapping )
+        munmap( fMapping, fMappingSize );
+
+    fMapping = NULL;
+    fMappingSize = 0;
+    fHeader = NULL;
+    fDirectories = NULL;
+    fBundles = NULL;
+    fEntries = NULL;
+    fStringPool = NULL;
+}
+
+bool ComponentCatalog::open( const std::string& path )
+{
+    close();
+
+    int fd = ::open( path.c_str(), O_RDONLY );
+    if ( fd < 0 )
+        return false;
+
+    struct stat info;
+    if ( fstat( fd, &info ) != 0 or size_t( info.st_size ) < sizeof( CatalogHeader ) )
+    {
+        ::close( fd );
+        return false;
+    }
+
+    void* mapping = mmap( NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    ::close( fd );
+    if ( mapping == MAP_FAILED )
+        return false;
+
+    fMapping = mapping;
+    fMappingSize = info.st_size;
+
+    const char* bytes = static_cast<const char*>( mapping );
+    fHeader = reinterpret_cast<const CatalogHeader*>( bytes );
+    if ( not validate() )
+    {
+        close();
+        return false;
+    }
+
+    fDirectories = reinterpret_cast<const CatalogDirectory*>( bytes + sizeof( CatalogHeader ) );
+    fBundles = reinterpret_cast<const CatalogBundle*>( fDirectories + fHeader->directoryCount );
+    fEntries = reinterpret_cast<const CatalogEntry*>( fBundles + fHeader->bundleCount );
+    fStringPool = reinterpret_cast<const char*>( fEntries + fHeader->entryCount );
+    return true;
+}
+
+bool ComponentCatalog::validate() const
+{
+    if ( fHeader->magic != kCatalogMagic or fHeader->formatVersion != kCatalogFormatVersion )
+        return false;
+
+    uint64_t expectedSize = sizeof( CatalogHeader )
+                            + uint64_t( fHeader->directoryCount ) * sizeof( CatalogDirectory )
+                            + uint64_t( fHeader->bundleCount ) * sizeof( CatalogBundle )
+                            + uint64_t( fHeader->entryCount ) * sizeof( CatalogEntry )
+                            + fHeader->stringPoolSize;
+    if ( expectedSize != fMappingSize )
+        return false;
+
+    // every string has to end inside the pool.
+    const char* pool = static_cast<const char*>( fMapping ) + (fMappingSize - fHeader->stringPoolSize);
+    return fHeader->stringPoolSize == 0 or pool[fHeader->stringPoolSize - 1] == 0;
+}
+
+const char* ComponentCatalog::getString( uint32_t offset ) const
+{
+    return (offset < fHeader->stringPoolSize) ? fStringPool + offset : NULL;
+}
+
+bool ComponentCatalog::isCurrent() const
+{
+    if ( not isOpen() )
+        return false;
+
+    for ( uint32_t i = 0; i < fHeader->directoryCount; ++i )
+    {
+        const CatalogDirectory& dir = fDirectories[i];
+        const char* path = getString( dir.pathOffset );
+        if ( not path )
+            return false;
+
+        int64_t seconds, nanoseconds;
+        getModificationTime( path, seconds, nanoseconds );
+        if ( seconds != dir.modifiedSeconds or nanoseconds != dir.modifiedNanoseconds )
+            return false;
+    }
+
+    for ( uint32_t i = 0; i < fHeader->bundleCount; ++i )
+    {
+        const CatalogBundle& bundle = fBundles[i];
+        const char* path = getString( bundle.plistPathOffset );
+        if ( not path )
+            return false;
+
+        int64_t seconds, nanoseconds, size;
+        getModificationTime( path, seconds, nanoseconds, &size );
+        if ( seconds != bundle.modifiedSeconds or nanoseconds != bundle.modifiedNanoseconds or size != bundle.size )
+            return false;
+    }
+    return true;
+}
+
+const CatalogEntry* ComponentCatalog::find( uint32_t type, uint32_t subType, uint32_t manufacturer ) const
+{
+    if ( not isOpen() )
+        return NULL;
+
+    CatalogEntry key;
+    key.type = type;
+    key.subType = subType;
+    key.manufacturer = manufacturer;
+
+    const CatalogEntry* end = fEntries + fHeader->entryCount;
+    const CatalogEntry* iter = std::lower_bound( static_cast<const CatalogEntry*>( fEntries ), end, key, entryLess );
+    if ( iter == end or entryLess( key, *iter ) )
+        return NULL;
+    return iter;
+}
+
+const char* ComponentCatalog::getName( const CatalogEntry& entry ) const
+{
+    return (entry.flags & CatalogEntry::kHasName) ? getString( entry.nameOffset ) : NULL;
+}
+
+} // namespace AudioUnits
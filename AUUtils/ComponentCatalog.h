@@ -0,0 +1,165 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+#ifndef _COMPONENTCATALOG_H_
+#define _COMPONENTCATALOG_H_
+
+/**********************************************************************************
+
+	ComponentCatalog
+
+	A snapshot of the component list saved to disk, so a fresh process
+	can look up names and versions without enumerating (and naming)
+	every component on the system.
+
+	The file is read by mapping it into memory.  It holds:
+
+		CatalogHeader
+		CatalogDirectory[directoryCount]	the plug-in directories the snapshot
+											was taken from, with their
+											modification times
+		CatalogBundle[bundleCount]			the Info.plist of each bundle in
+											them, with its modification time
+											and size
+		CatalogEntry[entryCount]			sorted by type, subtype, manufacturer
+		string pool							NUL-terminated UTF-8; each distinct
+											string is stored once
+
+	A directory's time moves when a bundle is added or removed, but not
+	when one is updated in place, which is why each bundle's Info.plist
+	(where its components' names and versions come from) is stamped too.
+
+	Strings are referred to by their offset into the pool.  Everything is
+	in the byte order of the machine that wrote it; a catalog from another
+	machine fails the magic check and is ignored.
+
+	This file doesn't depend on any Apple headers.
+
+**********************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace AudioUnits
+{
+
+struct CatalogHeader
+{
+    uint32_t magic;
+    uint32_t formatVersion;
+    uint32_t directoryCount;
+    uint32_t bundleCount;
+    uint32_t entryCount;
+    uint32_t stringPoolSize;
+};
+
+struct CatalogDirectory
+{
+    uint32_t pathOffset;
+    uint32_t reserved;
+    int64_t modifiedSeconds;
+    int64_t modifiedNanoseconds;
+};
+
+struct CatalogBundle
+{
+    uint32_t plistPathOffset;
+    uint32_t reserved;
+    int64_t modifiedSeconds;
+    int64_t modifiedNanoseconds;
+    int64_t size;
+};
+
+struct CatalogEntry
+{
+    enum
+    {
+        kHasName = 1,
+        kHasVersion = 2
+    };
+
+    uint32_t type;
+    uint32_t subType;
+    uint32_t manufacturer;
+    uint32_t version;
+    uint32_t nameOffset;
+    uint32_t flags;
+};
+
+// builds a catalog file.
+class ComponentCatalogWriter
+{
+public:
+    ComponentCatalogWriter();
+
+    // a directory whose changes make the catalog out of date, along with those
+    // of the *.component bundles in it.  A missing directory is recorded as
+    // missing, so it showing up later counts as a change.
+    void addWatchedDirectory( const std::string& path );
+
+    // name and version may be NULL if the component didn't provide them.
+    void addComponent( uint32_t type, uint32_t subType, uint32_t manufacturer,
+                       const std::string* name, const uint32_t* version );
+
+    // writes to the side and renames, so readers never see a partial file.
+    bool write( const std::string& path );
+
+private:
+    uint32_t intern( const std::string& str );
+
+    std::vector<CatalogDirectory> fDirectories;
+    std::vector<CatalogBundle> fBundles;
+    std::vector<CatalogEntry> fEntries;
+    std::string fStringPool;
+    std::unordered_map<std::string, uint32_t> fStringOffsets;
+};
+
+// a catalog file, mapped read-only.
+class ComponentCatalog
+{
+public:
+    ComponentCatalog();
+    ~ComponentCatalog();
+
+    // false if the file is missing, from an incompatible version, or damaged.
+    bool open( const std::string& path );
+    void close();
+    bool isOpen() const { return fHeader != NULL; }
+
+    // false if any of the watched directories, or the bundles in them, has changed
+    // since the catalog was written.
+    bool isCurrent() const;
+
+    size_t size() const { return isOpen() ? fHeader->entryCount : 0; }
+    const CatalogEntry& operator[]( size_t i ) const { return fEntries[i]; }
+
+    // NULL if the catalog has no such component.
+    const CatalogEntry* find( uint32_t type, uint32_t subType, uint32_t manufacturer ) const;
+
+    // the entry's name, or NULL if it doesn't have one.
+    const char* getName( const CatalogEntry& entry ) const;
+
+    ComponentCatalog( const ComponentCatalog& ) = delete;
+    const ComponentCatalog& operator=( const ComponentCatalog& ) = delete;
+
+private:
+    bool validate() const;
+    const char* getString( uint32_t offset ) const;
+
+    void* fMapping;
+    size_t fMappingSize;
+    const CatalogHeader* fHeader;
+    const CatalogDirectory* fDirectories;
+    const CatalogBundle* fBundles;
+    const CatalogEntry* fEntries;
+    const char* fStringPool;
+};
+
+} // namespace AudioUnits
+
+#endif // _COMPONENTCATALOG_H_
@@ -0,0 +1,276 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "ComponentRegistry.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace AudioUnits
+{
+
+namespace
+{
+bool isWildcard( const AudioComponentDescription& desc )
+{
+    return desc.componentType == 0 or desc.componentSubType == 0 or desc.componentManufacturer == 0;
+}
+
+// fetching metadata for fewer components than this per thread isn't worth a thread.
+const size_t kMinComponentsPerThread = 16;
+
+bool copyUTF8( CFStringRef str, std::string& out )
+{
+    // most names are stored in a form that can be read directly.
+    const char* direct = CFStringGetCStringPtr( str, kCFStringEncodingUTF8 );
+    if ( direct )
+    {
+        out = direct;
+        return true;
+    }
+
+    // otherwise measure the conversion first, so the buffer is exactly the right size.
+    CFRange range = CFRangeMake( 0, CFStringGetLength( str ) );
+    CFIndex byteCount = 0;
+    if ( CFStringGetBytes( str, range, kCFStringEncodingUTF8, 0, false, NULL, 0, &byteCount ) != range.length )
+        return false;
+
+    out.resize( byteCount );
+    if ( byteCount > 0 )
+        CFStringGetBytes( str, range, kCFStringEncodingUTF8, 0, false, (UInt8*)&out[0], byteCount, NULL );
+    return true;
+}
+}
+
+ComponentRegistry& ComponentRegistry::Get()
+{
+    static ComponentRegistry registry;
+    return registry;
+}
+
+ComponentRegistry::ComponentRegistry() :
+    fEnumerated(false)
+{
+}
+
+void ComponentRegistry::ensureEnumerated()
+{
+    if ( not fEnumerated )
+        Refresh();
+}
+
+void ComponentRegistry::Refresh()
+{
+    fEnumerated = true;
+    fEntries.clear();
+    fIndex.clear();
+
+    // all zeros matches every component.
+    AudioComponentDescription any;
+    memset( &any, 0, sizeof( any ) );
+
+    fEntries.reserve( AudioComponentCount( &any ) );
+    fIndex.reserve( fEntries.capacity() );
+
+    AudioComponent comp = AudioComponentFindNext( NULL, &any );
+    while ( comp != NULL )
+    {
+        addEntry( comp );
+        comp = AudioComponentFindNext( comp, &any );
+    }
+}
+
+bool ComponentRegistry::UseCatalog( const std::string& path )
+{
+    if ( fCatalog.open( path ) and fCatalog.isCurrent() )
+        return true;
+
+    fCatalog.close();
+    Refresh();
+    return writeCatalog( path ) and fCatalog.open( path );
+}
+
+bool ComponentRegistry::writeCatalog( const std::string& path )
+{
+    ComponentCatalogWriter writer;
+    // a catalog is out of date once any of these change.
+    for ( const std::string& dir : GetComponentDirectories() )
+        writer.addWatchedDirectory( dir );
+
+    std::vector<Entry*> entries;
+    for ( Entry& entry : fEntries )
+        entries.push_back( &entry );
+    fetchMetadata( entries );
+
+    for ( Entry& entry : fEntries )
+    {
+        writer.addComponent( entry.desc.componentType, entry.desc.componentSubType, entry.desc.componentManufacturer,
+                             entry.hasName ? &entry.name : NULL, entry.hasVersion ? &entry.version : NULL );
+    }
+    return writer.write( path );
+}
+
+ComponentRegistry::Entry* ComponentRegistry::addEntry( AudioComponent component )
+{
+    Entry entry( component );
+    if ( AudioComponentGetDescription( component, &entry.desc ) != noErr )
+        return NULL;
+
+    // like AudioComponentFindNext, the first component registered under a description wins.
+    auto inserted = fIndex.insert( std::make_pair( Key( entry.desc ), fEntries.size() ) );
+    if ( not inserted.second )
+        return &fEntries[inserted.first->second];
+
+    fEntries.push_back( entry );
+    return &fEntries.back();
+}
+
+ComponentRegistry::Entry* ComponentRegistry::findEntry( const AudioComponentDescription& desc )
+{
+    if ( not isWildcard( desc ) )
+    {
+        auto iter = fIndex.find( Key( desc ) );
+        if ( iter != fIndex.end() )
+            return &fEntries[iter->second];
+    }
+
+    // a wildcard, not enumerated yet, or a component registered since we enumerated.
+    AudioComponent comp = AudioComponentFindNext( NULL, &desc );
+    return comp ? addEntry( comp ) : NULL;
+}
+
+AudioComponent ComponentRegistry::find( const AudioComponentDescription& desc )
+{
+    Entry* entry = findEntry( desc );
+    return entry ? entry->component : NULL;
+}
+
+void ComponentRegistry::fetchName( Entry& entry )
+{
+    if ( entry.triedName )
+        return;
+    entry.triedName = true;
+
+    CFStringRef rawName;
+    if ( AudioComponentCopyName( entry.component, &rawName ) != noErr )
+        return;
+
+    ScopedCFTypeRef<CFStringRef> name( rawName ); // adopt the cfstringref
+    entry.hasName = copyUTF8( name.get(), entry.name );
+}
+
+void ComponentRegistry::fetchVersion( Entry& entry )
+{
+    if ( entry.triedVersion )
+        return;
+    entry.triedVersion = true;
+
+    UInt32 version = 0;
+    if ( AudioComponentGetVersion( entry.component, &version ) != noErr )
+        return;
+
+    entry.version = version;
+    entry.hasVersion = true;
+}
+
+void ComponentRegistry::fetchMetadata( const std::vector<Entry*>& entries )
+{
+    // each entry is only ever touched by one thread, and the results stay in the
+    // entries, so the order things finish in doesn't matter.
+    std::atomic<size_t> next( 0 );
+    auto worker = [&]()
+    {
+        for ( size_t i = next++; i < entries.size(); i = next++ )
+        {
+            fetchName( *entries[i] );
+            fetchVersion( *entries[i] );
+        }
+    };
+
+    size_t threadCount = std::min<size_t>( std::max( std::thread::hardware_concurrency(), 1u ),
+                                           entries.size() / kMinComponentsPerThread );
+
+    std::vector<std::thread> threads;
+    for ( size_t i = 1; i < threadCount; ++i )
+        threads.push_back( std::thread( worker ) );
+    worker();
+    for ( std::thread& thread : threads )
+        thread.join();
+}
+
+optional<UTF8ComponentInfo> ComponentRegistry::getInfo( const AudioComponentDescription& desc )
+{
+    const CatalogEntry* catalogEntry = fCatalog.find( desc.componentType, desc.componentSubType, desc.componentManufacturer );
+    if ( catalogEntry )
+    {
+        const char* name = fCatalog.getName( *catalogEntry );
+        if ( not name )
+            return nullptr;
+
+        UTF8ComponentInfo info;
+        info.name = name;
+        return info;
+    }
+
+    Entry* entry = findEntry( desc );
+    if ( not entry )
+        return nullptr;
+
+    fetchName( *entry );
+    if ( not entry->hasName )
+        return nullptr;
+
+    UTF8ComponentInfo info;
+    info.name = entry->name;
+    return info;
+}
+
+optional<uint32_t> ComponentRegistry::getVersion( const AudioComponentDescription& desc )
+{
+    const CatalogEntry* catalogEntry = fCatalog.find( desc.componentType, desc.componentSubType, desc.componentManufacturer );
+    if ( catalogEntry )
+    {
+        if ( not (catalogEntry->flags & CatalogEntry::kHasVersion) )
+            return nullptr;
+        return catalogEntry->version;
+    }
+
+    Entry* entry = findEntry( desc );
+    if ( not entry )
+        return nullptr;
+
+    fetchVersion( *entry );
+    if ( not entry->hasVersion )
+        return nullptr;
+
+    return entry->version;
+}
+
+std::vector<AudioComponentDescription> ComponentRegistry::getComponentsOfType( uint32_t componentType, bool requireValidName )
+{
+    ensureEnumerated();
+
+    std::vector<Entry*> matches;
+    for ( Entry& entry : fEntries )
+    {
+        if ( entry.desc.componentType == componentType )
+            matches.push_back( &entry );
+    }
+
+    if ( requireValidName )
+        fetchMetadata( matches );
+
+    std::vector<AudioComponentDescription> ret;
+    for ( const Entry* entry : matches )
+    {
+        if ( requireValidName and (not entry->hasName or entry->name.length() <= 5) )
+            continue;
+        ret.push_back( entry->desc );
+    }
+    return ret;
+}
+
+} // namespace AudioUnits
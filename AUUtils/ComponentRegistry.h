@@ -0,0 +1,123 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+#ifndef _COMPONENTREGISTRY_H_
+#define _COMPONENTREGISTRY_H_
+
+/**********************************************************************************
+
+	ComponentRegistry
+
+	Every Audio Unit component on the system, enumerated once and indexed
+	by type, subtype and manufacturer.  Looking a component up by its
+	description with AudioComponentFindNext walks the whole component
+	list each time, which made anything done for every component
+	quadratic.
+
+	Names and versions are fetched from the component the first time
+	they're asked for, and remembered; when a whole list is needed, they
+	are fetched for all of it at once, spread across threads.  With a
+	ComponentCatalog, they're answered from the catalog instead, and the
+	system's component list is only enumerated if something needs all
+	of it.
+
+**********************************************************************************/
+
+#include "AudioUnitUtils.h"
+#include "ComponentCatalog.h"
+#include <unordered_map>
+
+namespace AudioUnits
+{
+
+class ComponentRegistry
+{
+public:
+    // the registry of this process, enumerated on first use.
+    static ComponentRegistry& Get();
+
+    // re-enumerates, for when components have been added or removed.
+    void Refresh();
+
+    // answers name and version lookups from the catalog at path.  If the catalog is
+    // missing or any plug-in directory has changed since it was written, everything
+    // is enumerated and the catalog is rewritten first.
+    bool UseCatalog( const std::string& path );
+
+    // NULL if there's no such component.  Descriptions with a zero type, subtype
+    // or manufacturer are wildcards, and are looked up the slow way.
+    AudioComponent find( const AudioComponentDescription& desc );
+
+    optional<UTF8ComponentInfo> getInfo( const AudioComponentDescription& desc );
+    optional<uint32_t> getVersion( const AudioComponentDescription& desc );
+
+    // the components of the given type, in the order the system lists them.
+    std::vector<AudioComponentDescription> getComponentsOfType( uint32_t componentType, bool requireValidName );
+
+    ComponentRegistry( const ComponentRegistry& ) = delete;
+    const ComponentRegistry& operator=( const ComponentRegistry& ) = delete;
+
+private:
+    ComponentRegistry();
+
+    struct Entry
+    {
+        explicit Entry( AudioComponent c ) :
+            component(c), triedName(false), hasName(false), triedVersion(false), hasVersion(false), version(0) {}
+
+        AudioComponent component;
+        AudioComponentDescription desc;
+
+        bool triedName;
+        bool hasName;
+        std::string name;
+
+        bool triedVersion;
+        bool hasVersion;
+        uint32_t version;
+    };
+
+    struct Key
+    {
+        uint32_t type;
+        uint32_t subType;
+        uint32_t manufacturer;
+
+        explicit Key( const AudioComponentDescription& desc ) :
+            type(desc.componentType), subType(desc.componentSubType), manufacturer(desc.componentManufacturer) {}
+
+        bool operator== ( const Key& k ) const
+        {
+            return type == k.type and subType == k.subType and manufacturer == k.manufacturer;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator() ( const Key& k ) const
+        {
+            uint64_t h = (uint64_t(k.type) * 0x9E3779B97F4A7C15ull) ^ (uint64_t(k.subType) << 32 | k.manufacturer);
+            return size_t(h ^ (h >> 29));
+        }
+    };
+
+    void ensureEnumerated();
+    bool writeCatalog( const std::string& path );
+    Entry* findEntry( const AudioComponentDescription& desc );
+    Entry* addEntry( AudioComponent component );
+    // fetches names and versions for all the entries on a pool of threads.
+    void fetchMetadata( const std::vector<Entry*>& entries );
+    void fetchName( Entry& entry );
+    void fetchVersion( Entry& entry );
+
+    bool fEnumerated;
+    std::vector<Entry> fEntries;
+    std::unordered_map<Key, size_t, KeyHash> fIndex;
+    ComponentCatalog fCatalog;
+};
+
+} // namespace AudioUnits
+
+#endif // _COMPONENTREGISTRY_H_
@@ -0,0 +1,80 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "MemoryStats.h"
+
+#include <mach/mach.h>
+#include <mach/mach_vm.h>
+#include <sys/resource.h>
+
+namespace MemoryStats
+{
+    uint64_t ResidentBytes()
+    {
+        mach_task_basic_info_data_t info;
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if ( task_info( mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count ) != KERN_SUCCESS )
+            return 0;
+        return info.resident_size;
+    }
+
+    uint64_t AvailablePhysicalBytes()
+    {
+        vm_size_t pageSize;
+        if ( host_page_size( mach_host_self(), &pageSize ) != KERN_SUCCESS )
+            return 0;
+
+        vm_statistics64_data_t stats;
+        mach_msg_type_number_t count = HOST_VM_INFO64_COUNT;
+        if ( host_statistics64( mach_host_self(), HOST_VM_INFO64, (host_info64_t)&stats, &count ) != KERN_SUCCESS )
+            return 0;
+
+        // inactive pages can be reclaimed without swapping.
+        return uint64_t(stats.free_count + stats.inactive_count + stats.speculative_count) * pageSize;
+    }
+
+    uint64_t MappedFileBytes()
+    {
+        vm_size_t pageSize;
+        if ( host_page_size( mach_host_self(), &pageSize ) != KERN_SUCCESS )
+            return 0;
+
+        uint64_t total = 0;
+        mach_vm_address_t address = 0;
+        for ( ;; )
+        {
+            mach_vm_size_t size = 0;
+            vm_region_extended_info_data_t info;
+            mach_msg_type_number_t count = VM_REGION_EXTENDED_INFO_COUNT;
+            mach_port_t object;
+            if ( mach_vm_region( mach_task_self(), &address, &size, VM_REGION_EXTENDED_INFO, (vm_region_info_t)&info, &count, &object ) != KERN_SUCCESS )
+                break;
+
+            // regions backed by a pager other than the default one are mapped files.
+            if ( info.external_pager )
+                total += uint64_t(info.pages_resident) * pageSize;
+            address += size;
+        }
+        return total;
+    }
+
+    PageFaults PageFaultCounts()
+    {
+        PageFaults faults = { 0, 0 };
+        struct rusage usage;
+#ifdef RUSAGE_THREAD
+        int who = RUSAGE_THREAD;
+#else
+        int who = RUSAGE_SELF;
+#endif
+        if ( getrusage( who, &usage ) == 0 )
+        {
+            faults.minor = uint64_t(usage.ru_minflt);
+            faults.major = uint64_t(usage.ru_majflt);
+        }
+        return faults;
+    }
+}
@@ -0,0 +1,36 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#ifndef _MEMORYSTATS_H_
+#define _MEMORYSTATS_H_
+
+#include <stdint.h>
+
+// what the OS says about our memory use.  Each returns 0 if the OS won't say.
+namespace MemoryStats
+{
+    // physical memory in use by this process.
+    uint64_t ResidentBytes();
+
+    // physical memory that could be handed out without paging anything else out.
+    uint64_t AvailablePhysicalBytes();
+
+    // the part of ResidentBytes that is mapped from files (code, and samples
+    // a plug-in maps instead of reading).
+    uint64_t MappedFileBytes();
+
+    struct PageFaults
+    {
+        uint64_t minor;     // resolved without I/O
+        uint64_t major;     // had to read from disk
+    };
+
+    // the page faults taken so far by the calling thread where the OS
+    // counts them per thread, and by the whole process where it doesn't.
+    PageFaults PageFaultCounts();
+}
+
+#endif // _MEMORYSTATS_H_
@@ -0,0 +1,119 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "ParameterCatalog.h"
+#include "AudioUnitUtils.h"
+
+#include <string.h>
+
+namespace AudioUnits
+{
+
+void ParameterCatalog::clear()
+{
+    fIDs.clear();
+    fMinValues.clear();
+    fMaxValues.clear();
+    fDefaultValues.clear();
+    fFlags.clear();
+    fUnits.clear();
+    fNameOffsets.clear();
+    fFirstValueString.assign( 1, 0 );
+    fValueStringOffsets.clear();
+    fIndices.clear();
+
+    // offset 0 is the empty string, for parameters without a name.
+    fStringPool.assign( 1, '\0' );
+}
+
+uint32_t ParameterCatalog::addString( const char* str )
+{
+    if ( str[0] == 0 )
+        return 0;
+
+    uint32_t offset = uint32_t( fStringPool.size() );
+    fStringPool.append( str, strlen( str ) + 1 );
+    return offset;
+}
+
+uint32_t ParameterCatalog::addString( CFStringRef str )
+{
+    const char* direct = CFStringGetCStringPtr( str, kCFStringEncodingUTF8 );
+    if ( direct )
+        return addString( direct );
+
+    std::vector<char> buffer( CFStringGetMaximumSizeForEncoding( CFStringGetLength( str ), kCFStringEncodingUTF8 ) + 1 );
+    if ( not CFStringGetCString( str, buffer.data(), buffer.size(), kCFStringEncodingUTF8 ) )
+        return 0;
+    return addString( buffer.data() );
+}
+
+void ParameterCatalog::build( Base& unit, AudioUnitScope scope )
+{
+    clear();
+
+    std::vector<AudioUnitParameterID> ids = unit.getParameterList( scope );
+    size_t count = ids.size();
+    fMinValues.reserve( count );
+    fMaxValues.reserve( count );
+    fDefaultValues.reserve( count );
+    fFlags.reserve( count );
+    fUnits.reserve( count );
+    fNameOffsets.reserve( count );
+    fFirstValueString.reserve( count + 1 );
+    fIndices.reserve( count );
+
+    for ( AudioUnitParameterID id : ids )
+    {
+        AudioUnitParameterInfo info;
+        memset( &info, 0, sizeof( info ) );
+        unit.getParameterInfo( scope, id, info );
+
+        uint32_t nameOffset;
+        if ( (info.flags & kAudioUnitParameterFlag_HasCFNameString) and info.cfNameString )
+        {
+            nameOffset = addString( info.cfNameString );
+            if ( info.flags & kAudioUnitParameterFlag_CFNameRelease )
+                CFRelease( info.cfNameString );
+        }
+        else
+        {
+            info.name[sizeof( info.name ) - 1] = 0;
+            nameOffset = addString( info.name );
+        }
+
+        if ( info.unit == kAudioUnitParameterUnit_Indexed )
+        {
+            CFArrayRef strings;
+            unit.getParameterValueStrings( scope, id, strings );
+            if ( strings )
+            {
+                CFIndex numStrings = CFArrayGetCount( strings );
+                for ( CFIndex j = 0; j < numStrings; ++j )
+                    fValueStringOffsets.push_back( addString( (CFStringRef)CFArrayGetValueAtIndex( strings, j ) ) );
+                CFRelease( strings );
+            }
+        }
+
+        fIndices[id] = uint32_t( fIDs.size() );
+        fIDs.push_back( id );
+        fMinValues.push_back( info.minValue );
+        fMaxValues.push_back( info.maxValue );
+        fDefaultValues.push_back( info.defaultValue );
+        fFlags.push_back( info.flags );
+        fUnits.push_back( info.unit );
+        fNameOffsets.push_back( nameOffset );
+        fFirstValueString.push_back( uint32_t( fValueStringOffsets.size() ) );
+    }
+}
+
+int ParameterCatalog::indexOf( AudioUnitParameterID id ) const
+{
+    std::unordered_map<AudioUnitParameterID, uint32_t>::const_iterator found = fIndices.find( id );
+    return (found == fIndices.end()) ? -1 : int( found->second );
+}
+
+} // namespace AudioUnits
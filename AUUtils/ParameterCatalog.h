@@ -0,0 +1,95 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+#ifndef _PARAMETERCATALOG_H_
+#define _PARAMETERCATALOG_H_
+
+/**********************************************************************************
+
+	ParameterCatalog
+
+	A snapshot of one scope's parameters: IDs, ranges, flags, units, names
+	and (for indexed parameters) value strings, taken from the plug-in in
+	one pass.  Plug-ins with thousands of parameters make asking for them
+	one at a time, over and over, expensive.
+
+	Each field is kept in an array of its own, all indexed alike, so a scan
+	over one field (looking for a parameter that can ramp, say) only touches
+	that field.  Names and value strings are NUL-terminated UTF-8 in a
+	string pool, referred to by offset.
+
+	Base keeps one for the global scope (see Base::getParameterCatalog), and
+	takes a new snapshot after the plug-in reports that its parameter list
+	changed.
+
+**********************************************************************************/
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <AudioUnit/AudioUnit.h>
+
+namespace AudioUnits
+{
+
+class Base;
+
+class ParameterCatalog
+{
+public:
+    ParameterCatalog() {}
+
+    // replaces whatever was there.  Throws AudioUnitError if the plug-in
+    // fails to describe a parameter it listed.
+    void build( Base& unit, AudioUnitScope scope );
+
+    size_t size() const { return fIDs.size(); }
+    bool empty() const { return fIDs.empty(); }
+
+    const std::vector<AudioUnitParameterID>& ids() const { return fIDs; }
+    const std::vector<AudioUnitParameterOptions>& flags() const { return fFlags; }
+
+    // the index of the parameter, or -1 if there is no such parameter.
+    int indexOf( AudioUnitParameterID id ) const;
+
+    AudioUnitParameterID id( size_t i ) const { return fIDs[i]; }
+    AudioUnitParameterValue minValue( size_t i ) const { return fMinValues[i]; }
+    AudioUnitParameterValue maxValue( size_t i ) const { return fMaxValues[i]; }
+    AudioUnitParameterValue defaultValue( size_t i ) const { return fDefaultValues[i]; }
+    AudioUnitParameterOptions flags( size_t i ) const { return fFlags[i]; }
+    AudioUnitParameterUnit unit( size_t i ) const { return fUnits[i]; }
+
+    // empty if the parameter has no name.
+    const char* name( size_t i ) const { return &fStringPool[fNameOffsets[i]]; }
+
+    // only indexed parameters have value strings.
+    size_t numValueStrings( size_t i ) const { return fFirstValueString[i + 1] - fFirstValueString[i]; }
+    const char* valueString( size_t i, size_t j ) const { return &fStringPool[fValueStringOffsets[fFirstValueString[i] + j]]; }
+
+    ParameterCatalog( const ParameterCatalog& ) = delete;
+    const ParameterCatalog& operator=( const ParameterCatalog& ) = delete;
+
+private:
+    void clear();
+    uint32_t addString( const char* str );
+    uint32_t addString( CFStringRef str );
+
+    std::vector<AudioUnitParameterID> fIDs;
+    std::vector<AudioUnitParameterValue> fMinValues;
+    std::vector<AudioUnitParameterValue> fMaxValues;
+    std::vector<AudioUnitParameterValue> fDefaultValues;
+    std::vector<AudioUnitParameterOptions> fFlags;
+    std::vector<AudioUnitParameterUnit> fUnits;
+    std::vector<uint32_t> fNameOffsets;
+    std::vector<uint32_t> fFirstValueString;    // into fValueStringOffsets, one more than there are parameters
+    std::vector<uint32_t> fValueStringOffsets;
+    std::string fStringPool;
+    std::unordered_map<AudioUnitParameterID, uint32_t> fIndices;
+};
+
+} // namespace AudioUnits
+
+#endif // _PARAMETERCATALOG_H_
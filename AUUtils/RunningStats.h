@@ -0,0 +1,80 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#ifndef _RUNNINGSTATS_H_
+#define _RUNNINGSTATS_H_
+
+#include <math.h>
+#include <stdint.h>
+
+// Accumulates the mean and variance of a series of measurements in one pass
+// (Welford's method), so a measurement can be repeated until it is precise enough.
+class RunningStats
+{
+public:
+    RunningStats() : fCount(0), fMean(0), fM2(0), fMin(0), fMax(0) {}
+
+    void add( double x )
+    {
+        ++fCount;
+        double delta = x - fMean;
+        fMean += delta / fCount;
+        fM2 += delta * (x - fMean);
+
+        if ( fCount == 1 or x < fMin ) fMin = x;
+        if ( fCount == 1 or x > fMax ) fMax = x;
+    }
+
+    uint32_t count() const { return fCount; }
+    double mean() const { return fMean; }
+    double min() const { return fMin; }
+    double max() const { return fMax; }
+    double variance() const { return (fCount > 1) ? fM2 / (fCount - 1) : 0; }
+    double standardDeviation() const { return sqrt( variance() ); }
+
+    // half the width of the 95% confidence interval of the mean.
+    double halfWidth95() const
+    {
+        if ( fCount < 2 )
+            return HUGE_VAL;
+        return studentT95( fCount - 1 ) * standardDeviation() / sqrt( double(fCount) );
+    }
+
+    // the confidence interval relative to the mean; 0.05 means "within 5%".
+    double relativeHalfWidth95() const
+    {
+        if ( fMean == 0 )
+            return (fCount > 1 and fM2 == 0) ? 0 : HUGE_VAL;
+        return halfWidth95() / fabs( fMean );
+    }
+
+private:
+    // two-sided 95% critical values of Student's t distribution.
+    static double studentT95( uint32_t degreesOfFreedom )
+    {
+        static const double kTable[] =
+        {
+            12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+            2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+            2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+        };
+        const uint32_t kTableSize = sizeof( kTable ) / sizeof( kTable[0] );
+
+        if ( degreesOfFreedom == 0 )
+            return HUGE_VAL;
+        if ( degreesOfFreedom <= kTableSize )
+            return kTable[degreesOfFreedom - 1];
+        return 1.960;
+    }
+
+    uint32_t fCount;
+    double fMean;
+    double fM2;
+    double fMin;
+    double fMax;
+};
+
+#endif // _RUNNINGSTATS_H_
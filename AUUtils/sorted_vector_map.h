@@ -17,11 +17,20 @@
 //	invalidate any existing iterators.  sorted_vector_map does not have this property, so
 //	make sure you're not relying on it.
 //
+// Inserting elements one at a time costs O(n) each.  To build a large map, use the range
+// constructor, insert (first, last) or adopt_sorted, which sort once.  The benchmark in
+// tests/SortedVectorMapBenchmark.cpp compares building and lookups with std::map and
+// std::unordered_map.
+//
+// If Compare has an is_transparent member type, find, count, lower_bound and upper_bound
+// also accept any type the comparator can compare against a key, without converting it.
+//
 
 #ifndef sorted_vector_map_DJS061902_h__
 #define sorted_vector_map_DJS061902_h__
 
 #include <algorithm>
+#include <assert.h>
 #include <functional>
 #include <utility>
 #include <vector>
@@ -53,9 +62,13 @@ public:
 	typedef typename container_type::reverse_iterator			reverse_iterator;
 	typedef typename container_type::const_reverse_iterator	const_reverse_iterator;
 		
-	class value_compare : public std::binary_function<value_type, value_type, bool>
+	class value_compare
 	{
 	public:
+		typedef value_type	first_argument_type;
+		typedef value_type	second_argument_type;
+		typedef bool		result_type;
+
 		bool operator() (const value_type& x, const value_type& y)
 		{
 			return comp (x.first, y.first);
@@ -75,8 +88,10 @@ public:
 		sorted_vector_map (InputIterator first, InputIterator last,
 			   	   		const Compare& comp = Compare(), const Allocator& = Allocator());	   
 	sorted_vector_map (const sorted_vector_map& rhs);
+	sorted_vector_map (sorted_vector_map&& rhs);
 	~sorted_vector_map () {}
 	sorted_vector_map& operator= (const sorted_vector_map& rhs);
+	sorted_vector_map& operator= (sorted_vector_map&& rhs);
 	
 	// ITERATOR ACCESS:
 	
@@ -95,6 +110,9 @@ public:
 	size_type				size () const				{ return fContainer.size(); }
 	size_type				max_size () const			{ return fContainer.max_size(); }
 	allocator_type			get_allocator () const		{ return fContainer.get_allocator(); }
+	size_type				capacity () const			{ return fContainer.capacity(); }
+	void					reserve (size_type n)		{ fContainer.reserve (n); }
+	void					shrink_to_fit ()			{ fContainer.shrink_to_fit (); }
 	
 	// MAP OPERATIONS:
 	
@@ -110,16 +128,46 @@ public:
 	std::pair<iterator, iterator> 			equal_range (const key_type& x);
 	std::pair<const_iterator, const_iterator>	equal_range (const key_type& x) const;
 	
+	// heterogeneous lookup, only with a transparent comparator.
+	template<class K, class C = Compare, class = typename C::is_transparent>
+		iterator			find (const K& x);
+	template<class K, class C = Compare, class = typename C::is_transparent>
+		const_iterator		find (const K& x) const;
+	template<class K, class C = Compare, class = typename C::is_transparent>
+		size_type			count (const K& x) const				{ return (find (x) == end()) ? 0 : 1; }
+	template<class K, class C = Compare, class = typename C::is_transparent>
+		iterator			lower_bound (const K& x)				{ return std::lower_bound (begin(), end(), x, value_key_comp (fComp)); }
+	template<class K, class C = Compare, class = typename C::is_transparent>
+		const_iterator		lower_bound (const K& x) const		{ return std::lower_bound (begin(), end(), x, value_key_comp (fComp)); }
+	template<class K, class C = Compare, class = typename C::is_transparent>
+		iterator			upper_bound (const K& x)				{ return std::upper_bound (begin(), end(), x, value_key_comp (fComp)); }
+	template<class K, class C = Compare, class = typename C::is_transparent>
+		const_iterator		upper_bound (const K& x) const		{ return std::upper_bound (begin(), end(), x, value_key_comp (fComp)); }
+	
 	// ELEMENT ACCESS:
 	
 	mapped_type&			operator[] (const key_type& key);
+	mapped_type&			operator[] (key_type&& key);
 	
 	// MODIFYING:
 	
 	std::pair<iterator, bool>		insert (const value_type& value);
+	std::pair<iterator, bool>		insert (value_type&& value);
 	iterator					insert (iterator position, const value_type& value);
+	template<class... Args>
+		std::pair<iterator, bool>	emplace (Args&&... args)		{ return insert (value_type (std::forward<Args> (args)...)); }
+	
+	// bulk insertion: appends everything, sorts once and drops duplicates.  As with
+	// single inserts, an element whose key is already in the map is ignored, and of
+	// several new elements with the same key, the first wins.
 	template<class InputIterator>
 		void					insert (InputIterator first, InputIterator last);
+	template<class InputIterator>
+		void					insert_range (InputIterator first, InputIterator last)	{ insert (first, last); }
+	
+	// replaces the contents with a container that is already sorted by key, with no
+	// duplicates, without copying or sorting anything.
+	void					adopt_sorted (container_type&& sorted);
 				
 	iterator	erase (iterator pos)					{ return fContainer.erase (pos); }
 	size_type	erase (const key_type& key);
@@ -134,15 +182,21 @@ public:
 	value_compare		value_comp () const			{ return value_compare (fComp); }
 	
 private:
-	class value_key_comp : public std::binary_function<value_type, key_type, bool>
+	class value_key_comp
 	{
 	public:
+		typedef value_type	first_argument_type;
+		typedef key_type	second_argument_type;
+		typedef bool		result_type;
+
 		value_key_comp (key_compare c) : fComp (c) {}
-		bool operator() (const value_type& x, const key_type& y) const 
+		template<class K>
+		bool operator() (const value_type& x, const K& y) const 
 		{
 			return fComp (x.first, y);
 		}
-		bool operator() (const key_type& x, const value_type& y) const
+		template<class K>
+		bool operator() (const K& x, const value_type& y) const
 		{
 			return fComp (x, y.first);
 		}
@@ -150,6 +204,10 @@ private:
 		key_compare fComp;
 	};
 
+	// sorts [first, end()) and merges it into the sorted elements before it.
+	void merge_tail (iterator first);
+	bool keys_equal (const value_type& x, const value_type& y) const	{ return ! fComp (x.first, y.first) && ! fComp (y.first, x.first); }
+
 	container_type	fContainer;
 	key_compare		fComp;
 };
@@ -167,10 +225,10 @@ template <class InputIterator>
 inline
 sorted_vector_map<Key, T, Compare, Allocator>::sorted_vector_map (InputIterator first, InputIterator last,
 												  	     const Compare& comp, const Allocator& allocator) :
-	fContainer (first, last, allocator),
+	fContainer (allocator),
 	fComp (comp)
 {
-	std::sort (fContainer.begin(), fContainer.end(), value_comp ());
+	insert (first, last);
 }
 	
 template <class Key, class T, class Compare, class Allocator>
@@ -181,6 +239,23 @@ sorted_vector_map<Key, T, Compare, Allocator>::sorted_vector_map (const sorted_v
 {
 }
 
+template <class Key, class T, class Compare, class Allocator>
+inline
+sorted_vector_map<Key, T, Compare, Allocator>::sorted_vector_map (sorted_vector_map&& rhs) :
+	fContainer (std::move (rhs.fContainer)),
+	fComp (std::move (rhs.fComp))
+{
+}
+
+template <class Key, class T, class Compare, class Allocator>
+inline sorted_vector_map<Key, T, Compare, Allocator>&
+sorted_vector_map<Key, T, Compare, Allocator>::operator= (sorted_vector_map&& rhs)
+{
+	fContainer = std::move (rhs.fContainer);
+	fComp = std::move (rhs.fComp);
+	return *this;
+}
+
 template <class Key, class T, class Compare, class Allocator>
 inline sorted_vector_map<Key, T, Compare, Allocator>&
 sorted_vector_map<Key, T, Compare, Allocator>::operator= (const sorted_vector_map& rhs)
@@ -234,6 +309,24 @@ sorted_vector_map<Key, T, Compare, Allocator>::find (const key_type& x) const
 	return (iter == end() || fComp (x, iter->first)) ? end () : iter;
 }
 
+template <class Key, class T, class Compare, class Allocator>
+template <class K, class C, class>
+inline typename sorted_vector_map<Key, T, Compare, Allocator>::iterator
+sorted_vector_map<Key, T, Compare, Allocator>::find (const K& x)
+{
+	iterator iter = lower_bound (x);
+	return (iter == end() || fComp (x, iter->first)) ? end() : iter;
+}
+
+template <class Key, class T, class Compare, class Allocator>
+template <class K, class C, class>
+inline typename sorted_vector_map<Key, T, Compare, Allocator>::const_iterator
+sorted_vector_map<Key, T, Compare, Allocator>::find (const K& x) const
+{
+	const_iterator iter = lower_bound (x);
+	return (iter == end() || fComp (x, iter->first)) ? end () : iter;
+}
+
 template <class Key, class T, class Compare, class Allocator>
 inline std::pair<typename sorted_vector_map<Key, T, Compare, Allocator>::iterator,
 			typename sorted_vector_map<Key, T, Compare, Allocator>::iterator>
@@ -268,6 +361,17 @@ sorted_vector_map<Key, T, Compare, Allocator>::operator[] (const key_type& key)
 	return iter->second;
 }
 
+template <class Key, class T, class Compare, class Allocator>
+inline typename sorted_vector_map<Key, T, Compare, Allocator>::mapped_type&
+sorted_vector_map<Key, T, Compare, Allocator>::operator[] (key_type&& key)
+{
+	iterator iter = lower_bound (key);
+	if ((iter == end()) || fComp (key, iter->first))
+		iter = fContainer.insert (iter, value_type (std::move (key), mapped_type ()));
+	
+	return iter->second;
+}
+
 template <class Key, class T, class Compare, class Allocator>
 std::pair<typename sorted_vector_map<Key, T, Compare, Allocator>::iterator, bool>
 sorted_vector_map<Key, T, Compare, Allocator>::insert (const value_type& value)
@@ -282,6 +386,20 @@ sorted_vector_map<Key, T, Compare, Allocator>::insert (const value_type& value)
 	return std::make_pair (iter, doInsert);
 }
 
+template <class Key, class T, class Compare, class Allocator>
+std::pair<typename sorted_vector_map<Key, T, Compare, Allocator>::iterator, bool>
+sorted_vector_map<Key, T, Compare, Allocator>::insert (value_type&& value)
+{
+	value_compare valComp = value_comp();
+
+	iterator iter = std::lower_bound (begin(), end(), value, valComp);
+	bool doInsert = (iter == end()) || valComp (value, *iter);
+	
+	if (doInsert)
+		iter = fContainer.insert (iter, std::move (value));
+	return std::make_pair (iter, doInsert);
+}
+
 template <class Key, class T, class Compare, class Allocator>
 typename sorted_vector_map<Key, T, Compare, Allocator>::iterator
 sorted_vector_map<Key, T, Compare, Allocator>::insert (iterator iter, const value_type& value)
@@ -305,14 +423,29 @@ template <class InputIterator>
 void
 sorted_vector_map<Key, T, Compare, Allocator>::insert (InputIterator first, InputIterator last)
 {
-	value_compare valComp = value_comp ();
+	size_type oldSize = size ();
+	fContainer.insert (fContainer.end(), first, last);
+	merge_tail (begin() + oldSize);
+}
+
+template <class Key, class T, class Compare, class Allocator>
+void
+sorted_vector_map<Key, T, Compare, Allocator>::merge_tail (iterator first)
+{
+	// stable throughout, so that of equal keys, the earliest element is the one kept.
+	std::stable_sort (first, end(), value_comp ());
+	std::inplace_merge (begin(), first, end(), value_comp ());
 	
-	for (; first != last; ++first)
-	{
-		iterator iter = std::lower_bound (begin(), end(), *first, valComp);
-		if ((iter == end()) || valComp (*first, *iter))
-			fContainer.insert (iter, *first);
-	}
+	auto equalKeys = [this] (const value_type& x, const value_type& y) { return keys_equal (x, y); };
+	fContainer.erase (std::unique (begin(), end(), equalKeys), end());
+}
+
+template <class Key, class T, class Compare, class Allocator>
+inline void
+sorted_vector_map<Key, T, Compare, Allocator>::adopt_sorted (container_type&& sorted)
+{
+	fContainer = std::move (sorted);
+	assert (std::adjacent_find (begin(), end(), [this] (const value_type& x, const value_type& y) { return ! fComp (x.first, y.first); }) == end());
 }
 
 template <class Key, class T, class Compare, class Allocator>
@@ -0,0 +1,79 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "AUValAllocProfile.h"
+#include "AudioUnitUtils.h"
+#include "FakeNew.h"
+
+#include <stdio.h>
+
+namespace
+{
+    static_assert( AudioUnits::kNumLifecyclePhases <= kFakeNewMaxPhases, "FakeNew needs a phase for each lifecycle phase" );
+
+    const char* phaseName( int phase )
+    {
+        switch ( phase )
+        {
+            case AudioUnits::kPhaseConstruction:   return "construction";
+            case AudioUnits::kPhaseInitialize:     return "initialize";
+            case AudioUnits::kPhasePropertyQuery:  return "property queries";
+            case AudioUnits::kPhasePresetLoad:     return "preset loads";
+            case AudioUnits::kPhaseRender:         return "render";
+            case AudioUnits::kPhaseTeardown:       return "teardown";
+            default:                               return "other";
+        }
+    }
+
+    void phaseChanged( AudioUnits::LifecyclePhase phase )
+    {
+        FakeNewSetPhase( phase );
+    }
+}
+
+namespace AUValAllocProfile
+{
+    void Start()
+    {
+        FakeNewResetPhaseStats();
+        FakeNewEnableProfiling( true );
+        AudioUnits::SetLifecyclePhaseHook( phaseChanged );
+    }
+
+    void Reset()
+    {
+        FakeNewResetPhaseStats();
+    }
+
+    void Report( const std::string& label )
+    {
+        for ( int phase = 0; phase < AudioUnits::kNumLifecyclePhases; ++phase )
+        {
+            FakeNewPhaseStats stats;
+            FakeNewGetPhaseStats( phase, stats );
+            if ( stats.allocations == 0 and stats.frees == 0 )
+                continue;
+
+            printf( "allocations in %s: %s %llu (%llu bytes), %llu freed (%llu bytes), peak %lld bytes live; sizes",
+                    label.c_str(), phaseName( phase ),
+                    (unsigned long long)stats.allocations, (unsigned long long)stats.bytesAllocated,
+                    (unsigned long long)stats.frees, (unsigned long long)stats.bytesFreed,
+                    (long long)stats.peakLiveBytes );
+
+            for ( int bucket = 0; bucket < kFakeNewHistogramBuckets; ++bucket )
+            {
+                if ( stats.histogram[bucket] == 0 )
+                    continue;
+                if ( bucket == kFakeNewHistogramBuckets - 1 )
+                    printf( " >%u:%llu", 16u << (bucket - 1), (unsigned long long)stats.histogram[bucket] );
+                else
+                    printf( " <=%u:%llu", 16u << bucket, (unsigned long long)stats.histogram[bucket] );
+            }
+            printf( "\n" );
+        }
+        fflush( stdout );
+    }
+}
@@ -0,0 +1,39 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#ifndef _AUVAL_ALLOCPROFILE_H_
+#define _AUVAL_ALLOCPROFILE_H_
+/****************************************************************************
+
+	AUValAllocProfile
+
+	Attributes the plug-in's operator new and delete calls to the stage
+	of its life they happen in: construction, Initialize, property
+	queries, preset loads, render and teardown.  Anything else (the
+	tests' own work, for instance) is counted as "other".
+
+	A report is one line per stage that allocated or freed anything:
+
+		allocations in <test>: <stage> <count> (<bytes>), <count> freed (<bytes>),
+			peak <bytes> live; sizes <=16:<count> <=32:<count> ...
+
+****************************************************************************/
+
+#include <string>
+
+namespace AUValAllocProfile
+{
+    // turns profiling on, and starts following the stages of AudioUnits::Base.
+    void Start();
+
+    // starts counting from zero.
+    void Reset();
+
+    // prints what was counted since the last Reset.
+    void Report( const std::string& label );
+}
+
+#endif // _AUVAL_ALLOCPROFILE_H_
@@ -0,0 +1,138 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "AUValCheckpoint.h"
+#include "AUValStatus.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+AUValCheckpoint::AUValCheckpoint() :
+    fFd(-1),
+    fConfirmedCrashStatus(kAUValStatusNotRunning)
+{
+}
+
+bool IsCrashStatus( int status )
+{
+    return status == kAUValStatusCrashed or status == kAUValStatusHung or status == kAUValStatusBufferOverrun;
+}
+
+namespace
+{
+    bool isSuccessStatus( int status )
+    {
+        return status == kAUValStatusSuccessDoesNotRequireInit or status == kAUValStatusSuccessRequiresInit;
+    }
+}
+
+AUValCheckpoint::~AUValCheckpoint()
+{
+    if ( fFd >= 0 )
+        close( fFd );
+}
+
+bool AUValCheckpoint::Open( const std::string& path )
+{
+    fCompleted.clear();
+    fInFlight.clear();
+    fConfirmedCrashStatus = kAUValStatusNotRunning;
+
+    bool finished = false;
+    FILE* file = fopen( path.c_str(), "r" );
+    if ( file )
+    {
+        char line[1024];
+        while ( fgets( line, sizeof( line ), file ) )
+        {
+            char event[32];
+            char testName[960];
+            int status;
+
+            if ( sscanf( line, "start %959s", testName ) == 1 )
+                fInFlight = testName;
+            else if ( sscanf( line, "pass %959s", testName ) == 1 )
+            {
+                fCompleted[testName] = true;
+                fInFlight.clear();
+            }
+            else if ( sscanf( line, "fail %959s", testName ) == 1 )
+            {
+                fCompleted[testName] = false;
+                fInFlight.clear();
+            }
+            else if ( sscanf( line, "crash %959s %d", testName, &status ) == 2 )
+            {
+                if ( IsCrashStatus( status ) )
+                    fConfirmedCrashStatus = status;
+                fCompleted[testName] = isSuccessStatus( status );
+                fInFlight.clear();
+            }
+            else if ( sscanf( line, "%31s", event ) == 1 and strcmp( event, "done" ) == 0 )
+                finished = true;
+        }
+        fclose( file );
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_APPEND;
+    if ( finished )
+    {
+        // start over.
+        fCompleted.clear();
+        fInFlight.clear();
+        fConfirmedCrashStatus = kAUValStatusNotRunning;
+        flags |= O_TRUNC;
+    }
+
+    if ( fFd >= 0 )
+        close( fFd );
+    fFd = open( path.c_str(), flags, 0644 );
+    return fFd >= 0;
+}
+
+void AUValCheckpoint::writeLine( const std::string& line )
+{
+    if ( fFd < 0 )
+        return;
+
+    // unbuffered, so the line is with the OS before the plug-in gets a chance to crash us.
+    std::string data = line + "\n";
+    ssize_t written = write( fFd, data.data(), data.size() );
+    (void)written;
+}
+
+void AUValCheckpoint::TestStarted( const std::string& testName )
+{
+    writeLine( "start " + testName );
+}
+
+void AUValCheckpoint::TestFinished( const std::string& testName, bool passed )
+{
+    writeLine( (passed ? "pass " : "fail ") + testName );
+    fCompleted[testName] = passed;
+    if ( testName == fInFlight )
+        fInFlight.clear();
+}
+
+void AUValCheckpoint::CrashRerun( const std::string& testName, int status )
+{
+    char statusStr[16];
+    snprintf( statusStr, sizeof( statusStr ), " %d", status );
+    writeLine( "crash " + testName + statusStr );
+
+    if ( IsCrashStatus( status ) )
+        fConfirmedCrashStatus = status;
+    fCompleted[testName] = isSuccessStatus( status );
+    if ( testName == fInFlight )
+        fInFlight.clear();
+}
+
+void AUValCheckpoint::RunFinished()
+{
+    writeLine( "done" );
+}
@@ -0,0 +1,72 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#ifndef _AUVAL_CHECKPOINT_H_
+#define _AUVAL_CHECKPOINT_H_
+/****************************************************************************
+
+	AUValCheckpoint
+
+	Records the progress of a validation run, one line per event, so a
+	run that crashes part way through can pick up where it left off.
+
+	Each line is written straight to the file as it happens, so it
+	survives the process dying right afterwards:
+
+		start <test>			the test is about to run
+		pass <test>				the test finished and passed
+		fail <test>				the test finished and failed
+		crash <test> <status>	the test a crashed run died in was re-run on
+								its own, and exited with this AUValStatus
+								(which is also its result)
+		done					the run finished; the next one starts over
+
+****************************************************************************/
+
+#include <map>
+#include <string>
+
+// true for kAUValStatusCrashed, kAUValStatusHung and kAUValStatusBufferOverrun.
+bool IsCrashStatus( int status );
+
+class AUValCheckpoint
+{
+public:
+    AUValCheckpoint();
+    ~AUValCheckpoint();
+
+    // reads back what an earlier, unfinished run got through, and opens the file to
+    // record this run.  The progress of a finished run is discarded.
+    bool Open( const std::string& path );
+    bool IsOpen() const { return fFd >= 0; }
+
+    // tests that an earlier run finished; full test name -> passed
+    const std::map<std::string, bool>& Completed() const { return fCompleted; }
+    // the test an earlier run was in the middle of when it died, if any.
+    const std::string& InFlight() const { return fInFlight; }
+    // a crash status (see IsCrashStatus) if an earlier run confirmed a crash
+    // by re-running the test on its own; kAUValStatusNotRunning otherwise.
+    int ConfirmedCrashStatus() const { return fConfirmedCrashStatus; }
+
+    void TestStarted( const std::string& testName );
+    void TestFinished( const std::string& testName, bool passed );
+    // records the exit status of re-running the test an earlier run died in.
+    void CrashRerun( const std::string& testName, int status );
+    void RunFinished();
+
+    AUValCheckpoint( const AUValCheckpoint& ) = delete;
+    const AUValCheckpoint& operator=( const AUValCheckpoint& ) = delete;
+
+private:
+    void writeLine( const std::string& line );
+
+    int fFd;
+    std::map<std::string, bool> fCompleted;
+    std::string fInFlight;
+    int fConfirmedCrashStatus;
+};
+
+#endif // _AUVAL_CHECKPOINT_H_
@@ -0,0 +1,123 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "AUValChildProcess.h"
+#include "AUValStatus.h"
+
+#include <errno.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+extern char** environ;
+
+namespace
+{
+    std::vector<std::string> gCommandLine;
+
+    std::string executablePath()
+    {
+#ifdef __APPLE__
+        char path[4096];
+        uint32_t size = sizeof( path );
+        if ( _NSGetExecutablePath( path, &size ) == 0 )
+            return path;
+#endif
+        return gCommandLine.empty() ? std::string() : gCommandLine[0];
+    }
+
+    bool startsWithAny( const std::string& str, const std::vector<std::string>& prefixes )
+    {
+        for ( const std::string& prefix : prefixes )
+        {
+            if ( str.compare( 0, prefix.size(), prefix ) == 0 )
+                return true;
+        }
+        return false;
+    }
+
+    std::vector<char*> toArgv( std::vector<std::string>& strings )
+    {
+        std::vector<char*> argv;
+        for ( std::string& str : strings )
+            argv.push_back( &str[0] );
+        argv.push_back( NULL );
+        return argv;
+    }
+}
+
+void SetValidatorCommandLine( int argc, char** argv )
+{
+    gCommandLine.assign( argv, argv + argc );
+}
+
+std::vector<std::string> GetValidatorArguments( const std::vector<std::string>& dropPrefixes )
+{
+    std::vector<std::string> args;
+    for ( size_t i = 1; i < gCommandLine.size(); ++i )
+    {
+        if ( not startsWithAny( gCommandLine[i], dropPrefixes ) )
+            args.push_back( gCommandLine[i] );
+    }
+    return args;
+}
+
+pid_t SpawnValidator( const std::vector<std::string>& args, const std::vector<std::string>& extraEnvironment, int outputFd )
+{
+    std::vector<std::string> argStrings;
+    argStrings.push_back( executablePath() );
+    argStrings.insert( argStrings.end(), args.begin(), args.end() );
+
+    // the extra variables replace any of ours with the same name.
+    std::vector<std::string> overridden;
+    for ( const std::string& extra : extraEnvironment )
+        overridden.push_back( extra.substr( 0, extra.find( '=' ) + 1 ) );
+
+    std::vector<std::string> envStrings;
+    for ( char** env = environ; *env; ++env )
+    {
+        if ( not startsWithAny( *env, overridden ) )
+            envStrings.push_back( *env );
+    }
+    envStrings.insert( envStrings.end(), extraEnvironment.begin(), extraEnvironment.end() );
+
+    std::vector<char*> childArgv = toArgv( argStrings );
+    std::vector<char*> childEnv = toArgv( envStrings );
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init( &actions );
+    if ( outputFd >= 0 )
+    {
+        posix_spawn_file_actions_adddup2( &actions, outputFd, STDOUT_FILENO );
+        posix_spawn_file_actions_adddup2( &actions, outputFd, STDERR_FILENO );
+    }
+
+    pid_t pid;
+    int err = posix_spawn( &pid, childArgv[0], &actions, NULL, childArgv.data(), childEnv.data() );
+    posix_spawn_file_actions_destroy( &actions );
+
+    return (err == 0) ? pid : -1;
+}
+
+int WaitForValidator( pid_t pid )
+{
+    int status;
+    while ( waitpid( pid, &status, 0 ) < 0 )
+    {
+        if ( errno != EINTR )
+            return kAUValStatusCouldNotRun;
+    }
+
+    if ( WIFEXITED( status ) )
+        return WEXITSTATUS( status );
+    return kAUValStatusCrashed;
+}
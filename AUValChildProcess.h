@@ -0,0 +1,38 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#ifndef _AUVAL_CHILDPROCESS_H_
+#define _AUVAL_CHILDPROCESS_H_
+/****************************************************************************
+
+	AUValChildProcess
+
+	Starts fresh copies of the validator, for work that has to happen
+	in a process of its own (re-running a test that crashed us, for
+	instance).
+
+****************************************************************************/
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// remembers the arguments this process was started with.  Call before anything edits argv.
+void SetValidatorCommandLine( int argc, char** argv );
+
+// the original arguments (without argv[0]), minus any that start with one of the given prefixes.
+std::vector<std::string> GetValidatorArguments( const std::vector<std::string>& dropPrefixes );
+
+// starts a copy of the validator with the given arguments, and extra "NAME=value"
+// environment variables on top of our own.  If outputFd isn't -1, the copy's stdout
+// and stderr go there instead of sharing ours.  Returns -1 if it couldn't be started.
+pid_t SpawnValidator( const std::vector<std::string>& args, const std::vector<std::string>& extraEnvironment, int outputFd = -1 );
+
+// waits for a copy started with SpawnValidator, and returns its exit code, which is an
+// AUValStatus.  A copy that was killed by a signal is reported as kAUValStatusCrashed.
+int WaitForValidator( pid_t pid );
+
+#endif // _AUVAL_CHILDPROCESS_H_
@@ -0,0 +1,64 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "AUValCostHistory.h"
+#include <stdio.h>
+#include <unistd.h>
+
+namespace
+{
+    // how much a new measurement counts against the old average.
+    const double kNewMeasurementWeight = 0.3;
+}
+
+CostHistory LoadCostHistory( const std::string& path )
+{
+    CostHistory history;
+
+    FILE* file = fopen( path.c_str(), "r" );
+    if ( file == NULL )
+        return history;
+
+    char name[256];
+    double milliseconds;
+    while ( fscanf( file, "%255s %lf", name, &milliseconds ) == 2 )
+        history[name] = milliseconds;
+
+    fclose( file );
+    return history;
+}
+
+bool SaveCostHistory( const std::string& path, const CostHistory& history )
+{
+    // write to the side and rename, so a crash never leaves a half-written file.
+    // The temp file is named for this process, since shards all save at the end.
+    char suffix[32];
+    snprintf( suffix, sizeof( suffix ), ".%d.tmp", int( getpid() ) );
+    std::string tempPath = path + suffix;
+
+    FILE* file = fopen( tempPath.c_str(), "w" );
+    if ( file == NULL )
+        return false;
+
+    for ( const auto& entry : history )
+        fprintf( file, "%s %.3f\n", entry.first.c_str(), entry.second );
+
+    if ( fclose( file ) != 0 )
+    {
+        unlink( tempPath.c_str() );
+        return false;
+    }
+    return rename( tempPath.c_str(), path.c_str() ) == 0;
+}
+
+void UpdateCostHistory( CostHistory& history, const std::string& testName, double milliseconds )
+{
+    auto iter = history.find( testName );
+    if ( iter == history.end() )
+        history[testName] = milliseconds;
+    else
+        iter->second += kNewMeasurementWeight * (milliseconds - iter->second);
+}
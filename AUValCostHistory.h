@@ -0,0 +1,34 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#ifndef _AUVAL_COSTHISTORY_H_
+#define _AUVAL_COSTHISTORY_H_
+/****************************************************************************
+
+	AUValCostHistory
+
+	Remembers how long each test took on previous runs, so the cheap
+	tests can be scheduled ahead of the expensive ones.
+
+	The file is plain text, one "<test name> <milliseconds per run>"
+	line per test.
+
+****************************************************************************/
+
+#include <map>
+#include <string>
+
+// test name -> average milliseconds for a single run of the test
+typedef std::map<std::string, double> CostHistory;
+
+// a missing or unreadable file gives an empty history.
+CostHistory LoadCostHistory( const std::string& path );
+bool SaveCostHistory( const std::string& path, const CostHistory& history );
+
+// folds a new measurement into the history, weighting recent runs more heavily.
+void UpdateCostHistory( CostHistory& history, const std::string& testName, double milliseconds );
+
+#endif // _AUVAL_COSTHISTORY_H_
@@ -26,71 +26,168 @@
 ****************************************************************************/
 
 #include "AUValExcptList.h"
-#include "sorted_vector_map.h"
+#include "AUValExcptTable.h"
 #include "AudioUnitUtils.h"
 #include "AUTortureTest.h"
 #include "MotuTargetFlags.h"
 #include <stdio.h>
 
-struct AU_Ref
+enum ValidVal
 {
-	AudioComponentDescription fDesc;
+	kAllVersionsValid,
+	kAllVersionsInvalid,
+	kVersionsLTorEQ_Invalid
+};
 
-	AU_Ref(){}
-	AU_Ref(const AudioComponentDescription& desc ):
-		fDesc(desc) {}
-	AU_Ref( int32_t auType, int32_t auSubT, int32_t auManu )
-	{
- 		fDesc.componentType = auType;
- 		fDesc.componentSubType = auSubT;
- 		fDesc.componentManufacturer = auManu;
-	}
+struct BuiltInException
+{
+	uint32_t componentType;
+	uint32_t componentSubType;
+	uint32_t componentManufacturer;
+	ValidVal valid;
+	int32_t componentVersion;
+	const char* message;
+};
+
+// the built-in lists.  These have to be kept sorted by type, then manufacturer, then
+// subtype; the compiler checks (see below), so the lookup can be a binary search over
+// a table that's built into the binary and needs no setting up.
+constexpr BuiltInException kBuiltInExceptions[] =
+{
+	// Black list -----------------
+#if !MOTU_TARGET_RT_64_BIT
+	// MOTU: BeatInc & BeatSampler
+	{ 'aufx', 'BPMS', 'MOTU', kAllVersionsInvalid, 0, "Use the MAS version of this AU" },
+
+	// Rumblence
+	{ 1635083896, 1383422001, 1430808152, kVersionsLTorEQ_Invalid, 65536, "Contact the manufacturer for an updated version of this Audio Unit" },
+
+	// TC
+	{ 1635083896, 842282819, 1448301600, kVersionsLTorEQ_Invalid, 500, "Contact the manufacturer for an updated version of this Audio Unit" },
+	{ 1635083896, 842282861, 1448301600, kVersionsLTorEQ_Invalid, 500, "Contact the manufacturer for an updated version of this Audio Unit" },
+	{ 1635083896, 1129738850, 1448301600, kVersionsLTorEQ_Invalid, 500, "Contact the manufacturer for an updated version of this Audio Unit" },
+	{ 1635083896, 1346585715, 1448301600, kVersionsLTorEQ_Invalid, 500, "Contact the manufacturer for an updated version of this Audio Unit" },
+	{ 1635083896, 1346587757, 1448301600, kVersionsLTorEQ_Invalid, 500, "Contact the manufacturer for an updated version of this Audio Unit" },
+	{ 1635083896, 1346587763, 1448301600, kVersionsLTorEQ_Invalid, 500, "Contact the manufacturer for an updated version of this Audio Unit" },
+	{ 1635083896, 1346596723, 1448301600, kVersionsLTorEQ_Invalid, 500, "Contact the manufacturer for an updated version of this Audio Unit" },
+	{ 1635083896, 1346720115, 1448301600, kVersionsLTorEQ_Invalid, 500, "Contact the manufacturer for an updated version of this Audio Unit" },
+	{ 1635083896, 1347236723, 1448301600, kVersionsLTorEQ_Invalid, 500, "Contact the manufacturer for an updated version of this Audio Unit" },
+	{ 1635083896, 1347244659, 1448301600, kVersionsLTorEQ_Invalid, 500, "Contact the manufacturer for an updated version of this Audio Unit" },
+	{ 1635083896, 1347834733, 1448301600, kVersionsLTorEQ_Invalid, 500, "Contact the manufacturer for an updated version of this Audio Unit" },
+	{ 1635083896, 1347834739, 1448301600, kVersionsLTorEQ_Invalid, 500, "Contact the manufacturer for an updated version of this Audio Unit" },
+
+	// Unity
+	{ 1635085685, 1433302137, 1114207304, kVersionsLTorEQ_Invalid, 65536, "Contact the manufacturer for an updated version of this Audio Unit" },
+
+	// MOTU: BeatInc & BeatSampler
+	{ 'aumu', 'BPM ', 'MOTU', kAllVersionsInvalid, 0, "Use the MAS version of this AU" },
+
+	// ElectricKeys
+	{ 'aumu', 'EKEY', 'MOTU', kAllVersionsInvalid, 0, "Use the MAS version of ElectricKeys" },
+
+	// Ethno
+	{ 'aumu', 'ETHN', 'MOTU', kAllVersionsInvalid, 0, "Use the MAS version of Ethno" },
+
+	// Mach-5
+	{ 1635085685, 1163555664, 1297044565, kAllVersionsInvalid, 0, "Use the MAS version of Mach-5" },
+
+	// Mach-5 2
+	{ 'aumu', 'M5II', 'MOTU', kAllVersionsInvalid, 0, "Use the MAS version of Mach-5" },
+
+	// MSI
+	{ 'aumu', 'MVO ', 'MOTU', kAllVersionsInvalid, 0, "Use the MAS version of MSI" },
+
+	// MX-4
+	{ 'aumu', 'MX4!', 'Motu', kAllVersionsInvalid, 0, "Use the MAS version of MX4" },
 
+	// Volta
+	{ 'aumu', 'Volt', 'Motu', kAllVersionsInvalid, 0, "Use the MAS version of Volta" },
 
-	bool operator < ( const AU_Ref& p ) const;
+	// UniversalUVIPlayer
+	{ 'aumu', 'UPLA', 'USB ', kAllVersionsInvalid, 0, "Use the MAS version of this AU" },
+	{ 'aumu', 'UVIW', 'UVI ', kAllVersionsInvalid, 0, "Use the MAS version of this AU" },
+
+	// TC
+	{ 1635085685, 1345335667, 1448301600, kVersionsLTorEQ_Invalid, 500, "Contact the manufacturer for an updated version of this Audio Unit" },
+
+	// Apple's DLSMusicDevice
+	{ 1635085685, 1684828960, 1634758764, kVersionsLTorEQ_Invalid, 65536, "Contact the manufacturer for an updated version of this Audio Unit" },
+#endif
+
+	// an end marker, which sorts last.  It also keeps the table from being empty.
+	{ 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, kAllVersionsValid, 0, NULL }
 };
 
-bool AU_Ref::operator < ( const AU_Ref& p ) const
+constexpr size_t kNumBuiltInExceptions = sizeof( kBuiltInExceptions ) / sizeof( kBuiltInExceptions[0] ) - 1;
+
+constexpr bool exceptionLess( const BuiltInException& e, uint32_t type, uint32_t subType, uint32_t manufacturer )
 {
-	if ( fDesc.componentType < p.fDesc.componentType )
-		return true;
-	if ( fDesc.componentType > p.fDesc.componentType )
-		return false;
+	return (e.componentType != type) ? (e.componentType < type)
+		 : (e.componentManufacturer != manufacturer) ? (e.componentManufacturer < manufacturer)
+		 : (e.componentSubType < subType);
+}
 
-	if ( fDesc.componentManufacturer < p.fDesc.componentManufacturer )
-		return true;
-	if ( fDesc.componentManufacturer > p.fDesc.componentManufacturer )
-		return false;
+constexpr bool exceptionLess( const BuiltInException& a, const BuiltInException& b )
+{
+	return exceptionLess( a, b.componentType, b.componentSubType, b.componentManufacturer );
+}
 
-	if ( fDesc.componentSubType < p.fDesc.componentSubType )
-		return true;
-	if ( fDesc.componentSubType > p.fDesc.componentSubType )
-		return false;
+// strictly increasing, so there are no duplicates either.
+constexpr bool isSorted( size_t i = 1 )
+{
+	return (i >= sizeof( kBuiltInExceptions ) / sizeof( kBuiltInExceptions[0] ))
+		 or (exceptionLess( kBuiltInExceptions[i - 1], kBuiltInExceptions[i] ) and isSorted( i + 1 ));
+}
 
-	return false;
+static_assert( isSorted(), "kBuiltInExceptions has to be sorted by type, manufacturer and subtype, without duplicates" );
+
+// the index of the first entry in [first, last) that isn't less than the key.
+constexpr size_t lowerBound( size_t first, size_t last, uint32_t type, uint32_t subType, uint32_t manufacturer )
+{
+	return (first >= last) ? first
+		 : exceptionLess( kBuiltInExceptions[first + (last - first) / 2], type, subType, manufacturer )
+			? lowerBound( first + (last - first) / 2 + 1, last, type, subType, manufacturer )
+			: lowerBound( first, first + (last - first) / 2, type, subType, manufacturer );
 }
 
-enum ValidVal
+// the index of the entry for the component, or kNumBuiltInExceptions if there isn't one.
+constexpr size_t findBuiltInException( uint32_t type, uint32_t subType, uint32_t manufacturer )
 {
-	kAllVersionsValid,
-	kAllVersionsInvalid,
-	kVersionsLTorEQ_Invalid
-};
+	return (lowerBound( 0, kNumBuiltInExceptions, type, subType, manufacturer ) < kNumBuiltInExceptions
+			and not exceptionLess( BuiltInException{ type, subType, manufacturer, kAllVersionsValid, 0, NULL },
+								   kBuiltInExceptions[lowerBound( 0, kNumBuiltInExceptions, type, subType, manufacturer )] ))
+		 ? lowerBound( 0, kNumBuiltInExceptions, type, subType, manufacturer )
+		 : kNumBuiltInExceptions;
+}
+
+#if !MOTU_TARGET_RT_64_BIT
+static_assert( findBuiltInException( 'aumu', 'Volt', 'Motu' ) != kNumBuiltInExceptions, "Volta should be found" );
+static_assert( findBuiltInException( 'aumu', 'Volt', 'MOTU' ) == kNumBuiltInExceptions, "lookups should match all three codes" );
+#endif
 
-struct ValidState
+static const BuiltInException* findBuiltInException( const AudioComponentDescription& cd )
 {
-	ValidState(){}
-	ValidState( ValidVal v, const char* msg, int32_t version = 0 ):
-		valid(v), componentVersion(version), message(msg){}
+	size_t index = findBuiltInException( cd.componentType, cd.componentSubType, cd.componentManufacturer );
+	return (index < kNumBuiltInExceptions) ? &kBuiltInExceptions[index] : NULL;
+}
 
-	ValidVal valid;
-	int32_t componentVersion;
-	const char* message;
-};
+// the lists from a data file, when one has been loaded.
+static ExceptionTable gLoadedList;
+static bool gUseLoadedList = false;
 
-typedef sorted_vector_map< AU_Ref, ValidState > ExceptionList;
+bool LoadExceptionList( const std::string& path )
+{
+	std::string error;
+	gUseLoadedList = gLoadedList.load( path, error );
+	if ( not gUseLoadedList )
+		printf( "exception list %s not used: %s\n", path.c_str(), error.c_str() );
+	return gUseLoadedList;
+}
 
-static const ExceptionList& getExceptionList();
+static const ExceptionRule* findLoadedRule( const AudioComponentDescription& cd, uint32_t version )
+{
+	return gLoadedList.find( cd.componentType, cd.componentSubType, cd.componentManufacturer, version );
+}
 
 bool IsBlackListed( const AudioComponentDescription& cd, const std::string& name, bool& masDuplicate )
 {
@@ -109,26 +206,36 @@ bool IsBlackListed( const AudioComponentDescription& cd, const std::string& name
 	if ( cd.componentManufacturer == 1634758764 and (version.hasValue()) and *version == -1)
 		return false;
 
-	char tempStr[500];
-	const ExceptionList& excptList = getExceptionList();
-	ExceptionList::const_iterator iter = excptList.find( AU_Ref( cd ) );
+	if ( gUseLoadedList )
+	{
+		const ExceptionRule* rule = findLoadedRule( cd, *version );
+		if ( rule and rule->kind != kExceptionValid )
+		{
+			masDuplicate = (rule->kind == kExceptionDuplicate);
+			if ( gLoadedList.getMessage( *rule ) )
+				printf("!%s, %s\n", name.c_str(), gLoadedList.getMessage( *rule ) );
+			return true;
+		}
+		return false;
+	}
+
+	const BuiltInException* vs = findBuiltInException( cd );
 	bool isInvalid = false;
-	if ( iter != excptList.end() )
+	if ( vs )
 	{
-		const ValidState& vs = (*iter).second;
-		if ( vs.valid == kAllVersionsInvalid )
+		if ( vs->valid == kAllVersionsInvalid )
 		{
 			isInvalid = true;
 			masDuplicate = true;
 		}
-		else if ( vs.valid == kVersionsLTorEQ_Invalid && (*version <= vs.componentVersion) )
+		else if ( vs->valid == kVersionsLTorEQ_Invalid && (*version <= vs->componentVersion) )
 			isInvalid = true;
 
 		if ( isInvalid )
 		{
-			if ( vs.message )
+			if ( vs->message )
 			{
-				printf("!%s, %s\n", name.c_str(), vs.message );
+				printf("!%s, %s\n", name.c_str(), vs->message );
 			}
 
 			return true;
@@ -139,17 +246,29 @@ bool IsBlackListed( const AudioComponentDescription& cd, const std::string& name
 
 bool IsWhiteListed(  const AudioComponentDescription& cd  )
 {
-	char tempStr[500];
-	const ExceptionList& excptList = getExceptionList();
-	ExceptionList::const_iterator iter = excptList.find( AU_Ref( cd ) );
-	if ( iter != excptList.end() )
+	if ( gUseLoadedList )
 	{
-		const ValidState& vs = (*iter).second;
-		if ( vs.valid == kAllVersionsValid )
+		auto version = AudioUnits::GetComponentVersion(cd);
+		if ( not version.hasValue() )
+			return false;
+
+		const ExceptionRule* rule = findLoadedRule( cd, *version );
+		if ( not rule or rule->kind != kExceptionValid )
+			return false;
+
+		if ( gLoadedList.getMessage( *rule ) )
+			printf("!%s\n", gLoadedList.getMessage( *rule ) );
+		return true;
+	}
+
+	const BuiltInException* vs = findBuiltInException( cd );
+	if ( vs )
+	{
+		if ( vs->valid == kAllVersionsValid )
 		{
-			if ( vs.message )
+			if ( vs->message )
 			{
-				printf("!%s\n", vs.message);
+				printf("!%s\n", vs->message);
 			}
 
 			return true;
@@ -157,73 +276,3 @@ bool IsWhiteListed(  const AudioComponentDescription& cd  )
 	}
 	return false;
 }
-
-static const ExceptionList& getExceptionList()
-{
-	static bool inited = false;
-	static ExceptionList exceptionList;
-	if ( not inited )
-	{
-		inited = true;
-
-		// Black list -----------------
-#if !MOTU_TARGET_RT_64_BIT
-
-		// Volta
-		exceptionList[ AU_Ref( 'aumu', 'Volt', 'Motu' ) ] = ValidState( kAllVersionsInvalid, "Use the MAS version of Volta" );
-
- 		// Mach-5
-		exceptionList[ AU_Ref( 1635085685, 1163555664, 1297044565 ) ] = ValidState( kAllVersionsInvalid, "Use the MAS version of Mach-5" );
-
- 		// ElectricKeys
-		exceptionList[ AU_Ref( 'aumu', 'EKEY', 'MOTU' ) ] = ValidState( kAllVersionsInvalid, "Use the MAS version of ElectricKeys" );
-
- 		// Mach-5 2
-		exceptionList[ AU_Ref( 'aumu', 'M5II', 'MOTU' ) ] = ValidState( kAllVersionsInvalid, "Use the MAS version of Mach-5" );
-
-		// MX-4
-		exceptionList[ AU_Ref( 'aumu', 'MX4!', 'Motu' ) ] = ValidState( kAllVersionsInvalid, "Use the MAS version of MX4" );
-
-		// Ethno
-		exceptionList[ AU_Ref( 'aumu', 'ETHN', 'MOTU' ) ] = ValidState( kAllVersionsInvalid, "Use the MAS version of Ethno" );
-
-		// MSI
-		exceptionList[ AU_Ref( 'aumu', 'MVO ', 'MOTU' ) ] = ValidState( kAllVersionsInvalid, "Use the MAS version of MSI" );
-
-		// UniversalUVIPlayer
-		exceptionList[ AU_Ref( 'aumu', 'UPLA', 'USB ' ) ] = ValidState( kAllVersionsInvalid, "Use the MAS version of this AU" );
-		exceptionList[ AU_Ref( 'aumu', 'UVIW', 'UVI ' ) ] = ValidState( kAllVersionsInvalid, "Use the MAS version of this AU" );
-
-
-		// MOTU: BeatInc & BeatSampler
-		exceptionList[ AU_Ref( 'aumu', 'BPM ', 'MOTU' ) ] = ValidState( kAllVersionsInvalid, "Use the MAS version of this AU" );
-		exceptionList[ AU_Ref( 'aufx', 'BPMS', 'MOTU' ) ] = ValidState( kAllVersionsInvalid, "Use the MAS version of this AU" );
-
-		// TC
-		exceptionList[ AU_Ref( 1635083896, 842282819, 1448301600 ) ] = ValidState( kVersionsLTorEQ_Invalid, "Contact the manufacturer for an updated version of this Audio Unit", 500);
-		exceptionList[ AU_Ref( 1635083896, 842282861, 1448301600 ) ] = ValidState( kVersionsLTorEQ_Invalid, "Contact the manufacturer for an updated version of this Audio Unit", 500);
-		exceptionList[ AU_Ref( 1635083896, 1129738850, 1448301600) ] = ValidState( kVersionsLTorEQ_Invalid, "Contact the manufacturer for an updated version of this Audio Unit", 500);
-		exceptionList[ AU_Ref( 1635083896, 1346585715, 1448301600) ] = ValidState( kVersionsLTorEQ_Invalid, "Contact the manufacturer for an updated version of this Audio Unit", 500);
-		exceptionList[ AU_Ref( 1635083896, 1346587757, 1448301600) ] = ValidState( kVersionsLTorEQ_Invalid, "Contact the manufacturer for an updated version of this Audio Unit", 500);
-		exceptionList[ AU_Ref( 1635083896, 1346587763, 1448301600) ] = ValidState( kVersionsLTorEQ_Invalid, "Contact the manufacturer for an updated version of this Audio Unit", 500);
-		exceptionList[ AU_Ref( 1635083896, 1346596723, 1448301600) ] = ValidState( kVersionsLTorEQ_Invalid, "Contact the manufacturer for an updated version of this Audio Unit", 500);
-		exceptionList[ AU_Ref( 1635083896, 1346720115, 1448301600) ] = ValidState( kVersionsLTorEQ_Invalid, "Contact the manufacturer for an updated version of this Audio Unit", 500);
-		exceptionList[ AU_Ref( 1635083896, 1347236723, 1448301600) ] = ValidState( kVersionsLTorEQ_Invalid, "Contact the manufacturer for an updated version of this Audio Unit", 500);
-		exceptionList[ AU_Ref( 1635083896, 1347244659, 1448301600) ] = ValidState( kVersionsLTorEQ_Invalid, "Contact the manufacturer for an updated version of this Audio Unit", 500);
-		exceptionList[ AU_Ref( 1635083896, 1347834733, 1448301600) ] = ValidState( kVersionsLTorEQ_Invalid, "Contact the manufacturer for an updated version of this Audio Unit", 500);
-		exceptionList[ AU_Ref( 1635083896, 1347834739, 1448301600) ] = ValidState( kVersionsLTorEQ_Invalid, "Contact the manufacturer for an updated version of this Audio Unit", 500);
-		exceptionList[ AU_Ref( 1635085685, 1345335667, 1448301600) ] = ValidState( kVersionsLTorEQ_Invalid, "Contact the manufacturer for an updated version of this Audio Unit", 500);
-
-
-		// Unity
-		exceptionList[ AU_Ref( 1635085685, 1433302137, 1114207304) ] = ValidState( kVersionsLTorEQ_Invalid, "Contact the manufacturer for an updated version of this Audio Unit", 65536);
-
-		// Rumblence
-		exceptionList[ AU_Ref( 1635083896, 1383422001, 1430808152) ] = ValidState( kVersionsLTorEQ_Invalid, "Contact the manufacturer for an updated version of this Audio Unit", 65536);
-
-		// Apple's DLSMusicDevice
-		exceptionList[ AU_Ref( 1635085685, 1684828960, 1634758764) ] = ValidState( kVersionsLTorEQ_Invalid, "Contact the manufacturer for an updated version of this Audio Unit", 65536);
-#endif
-	}
-	return exceptionList;
-}
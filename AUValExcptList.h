@@ -31,6 +31,10 @@
 #include <string>
 struct ComponentDescription;
 
+// replaces the built-in lists with the rules in a data file (see AUValExcptTable.h).
+// If the file can't be used, says why and keeps the built-in lists.
+bool LoadExceptionList( const std::string& path );
+
 bool IsBlackListed( const AudioComponentDescription& cd, const std::string& name, bool& masDuplicate );
 bool IsWhiteListed(  const AudioComponentDescription& cd );
 
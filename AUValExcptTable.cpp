@@ -0,0 +1,555 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "AUValExcptTable.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    const uint32_t kCacheMagic = 'AUex';
+    const uint32_t kCacheFormatVersion = 2;
+
+    // give up on a bucket after this many seeds; with one bucket per component it never gets close.
+    const int32_t kMaxSeed = 1 << 20;
+
+    struct CacheHeader
+    {
+        uint32_t magic;
+        uint32_t formatVersion;
+        int64_t sourceStamp[3];     // modification seconds, nanoseconds, and size of the data file
+        uint32_t componentCount;
+        uint32_t ruleCount;
+        uint32_t messageBytes;
+    };
+
+    uint64_t mix( uint64_t h )
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    uint64_t hashKey( uint32_t type, uint32_t subType, uint32_t manufacturer, int32_t seed )
+    {
+        return mix( ((uint64_t(type) << 32) | subType) ^ mix( manufacturer ^ (uint64_t(seed) * 0x9E3779B97F4A7C15ull) ) );
+    }
+
+    bool componentLess( const ExceptionRule& a, const ExceptionRule& b )
+    {
+        if ( a.type != b.type )
+            return a.type < b.type;
+        if ( a.subType != b.subType )
+            return a.subType < b.subType;
+        return a.manufacturer < b.manufacturer;
+    }
+
+    bool sameComponent( const ExceptionRule& a, const ExceptionRule& b )
+    {
+        return a.type == b.type and a.subType == b.subType and a.manufacturer == b.manufacturer;
+    }
+
+    // by component, then by version.
+    bool ruleLess( const ExceptionRule& a, const ExceptionRule& b )
+    {
+        if ( not sameComponent( a, b ) )
+            return componentLess( a, b );
+        return a.minVersion < b.minVersion;
+    }
+
+    bool getSourceStamp( const std::string& path, int64_t stamp[3] )
+    {
+        struct stat info;
+        if ( stat( path.c_str(), &info ) != 0 )
+            return false;
+#ifdef __APPLE__
+        stamp[0] = info.st_mtimespec.tv_sec;
+        stamp[1] = info.st_mtimespec.tv_nsec;
+#else
+        stamp[0] = info.st_mtim.tv_sec;
+        stamp[1] = info.st_mtim.tv_nsec;
+#endif
+        stamp[2] = info.st_size;
+        return true;
+    }
+
+    // splits a line into whitespace-separated tokens; a token in single quotes keeps its
+    // spaces (and its quotes).
+    class Tokenizer
+    {
+    public:
+        explicit Tokenizer( const char* line ) : fPos(line) {}
+
+        bool next( std::string& token )
+        {
+            skipSpace();
+            if ( *fPos == 0 )
+                return false;
+
+            token.clear();
+            if ( *fPos == '\'' )
+            {
+                const char* end = strchr( fPos + 1, '\'' );
+                if ( not end )
+                    return false;
+                token.assign( fPos, end + 1 );
+                fPos = end + 1;
+                return true;
+            }
+
+            while ( *fPos and not isspace( (unsigned char)*fPos ) )
+                token += *fPos++;
+            return true;
+        }
+
+        // everything left, without surrounding whitespace.
+        std::string rest()
+        {
+            skipSpace();
+            std::string str( fPos );
+            while ( not str.empty() and isspace( (unsigned char)str[str.size() - 1] ) )
+                str.erase( str.size() - 1 );
+            return str;
+        }
+
+    private:
+        void skipSpace()
+        {
+            while ( *fPos and isspace( (unsigned char)*fPos ) )
+                ++fPos;
+        }
+
+        const char* fPos;
+    };
+
+    bool parseNumber( const std::string& str, uint32_t& out )
+    {
+        if ( str.empty() or not isdigit( (unsigned char)str[0] ) )
+            return false;
+
+        char* end = NULL;
+        errno = 0;
+        unsigned long long value = strtoull( str.c_str(), &end, 10 );
+        if ( *end != 0 or errno != 0 or value > 0xFFFFFFFFull )
+            return false;
+        out = uint32_t( value );
+        return true;
+    }
+
+    uint32_t fourCharCode( const char* str )
+    {
+        return (uint32_t(uint8_t(str[0])) << 24) | (uint32_t(uint8_t(str[1])) << 16) |
+               (uint32_t(uint8_t(str[2])) << 8) | uint32_t(uint8_t(str[3]));
+    }
+
+    // 'xxxx', a decimal number, or any other four characters.
+    bool parseCode( const std::string& str, uint32_t& out )
+    {
+        if ( str.size() == 6 and str[0] == '\'' and str[5] == '\'' )
+        {
+            out = fourCharCode( str.c_str() + 1 );
+            return true;
+        }
+        if ( parseNumber( str, out ) )
+            return true;
+        if ( str.size() == 4 )
+        {
+            out = fourCharCode( str.c_str() );
+            return true;
+        }
+        return false;
+    }
+
+    bool parseKind( const std::string& str, uint32_t& out )
+    {
+        if ( str == "valid" )
+            out = kExceptionValid;
+        else if ( str == "duplicate" )
+            out = kExceptionDuplicate;
+        else if ( str == "incompatible" )
+            out = kExceptionIncompatible;
+        else
+            return false;
+        return true;
+    }
+
+    bool parseVersions( const std::string& str, uint32_t& minVersion, uint32_t& maxVersion )
+    {
+        minVersion = 0;
+        maxVersion = 0xFFFFFFFF;
+
+        if ( str == "*" )
+            return true;
+        if ( str.compare( 0, 2, "<=" ) == 0 )
+            return parseNumber( str.substr( 2 ), maxVersion );
+        if ( str.compare( 0, 2, ">=" ) == 0 )
+            return parseNumber( str.substr( 2 ), minVersion );
+
+        size_t dash = str.find( '-' );
+        if ( dash == std::string::npos )
+        {
+            if ( not parseNumber( str, minVersion ) )
+                return false;
+            maxVersion = minVersion;
+            return true;
+        }
+        return parseNumber( str.substr( 0, dash ), minVersion )
+               and parseNumber( str.substr( dash + 1 ), maxVersion )
+               and minVersion <= maxVersion;
+    }
+
+    std::string lineError( int lineNumber, const char* what )
+    {
+        char str[64];
+        snprintf( str, sizeof( str ), "line %d: ", lineNumber );
+        return str + std::string( what );
+    }
+}
+
+bool ExceptionTable::load( const std::string& path, std::string& error )
+{
+    int64_t sourceStamp[3];
+    if ( not getSourceStamp( path, sourceStamp ) )
+    {
+        error = "can't read " + path;
+        return false;
+    }
+
+    const std::string cachePath = path + ".cache";
+    if ( readCache( cachePath, sourceStamp ) )
+        return true;
+
+    if ( not parse( path, error ) )
+        return false;
+
+    // a cache that can't be written just means parsing again next time.
+    writeCache( cachePath, sourceStamp );
+    return true;
+}
+
+bool ExceptionTable::parse( const std::string& path, std::string& error )
+{
+    FILE* file = fopen( path.c_str(), "r" );
+    if ( not file )
+    {
+        error = "can't read " + path;
+        return false;
+    }
+
+    std::vector<ExceptionRule> rules;
+    std::vector<int> ruleLines;
+    fMessages.clear();
+
+    char line[1024];
+    int lineNumber = 0;
+    bool ok = true;
+    while ( ok and fgets( line, sizeof( line ), file ) )
+    {
+        ++lineNumber;
+        if ( strchr( line, '\n' ) == NULL and not feof( file ) )
+        {
+            error = lineError( lineNumber, "too long" );
+            ok = false;
+            break;
+        }
+
+        char* comment = strchr( line, '#' );
+        if ( comment )
+            *comment = 0;
+
+        Tokenizer tokens( line );
+        std::string kind;
+        if ( not tokens.next( kind ) )
+            continue;   // blank
+
+        ExceptionRule rule;
+        std::string type, subType, manufacturer, versions;
+        if ( not parseKind( kind, rule.kind ) )
+            error = lineError( lineNumber, "unknown kind (expected valid, duplicate or incompatible)" );
+        else if ( not tokens.next( type ) or not tokens.next( subType ) or not tokens.next( manufacturer ) or not tokens.next( versions ) )
+            error = lineError( lineNumber, "expected <kind> <type> <subtype> <manufacturer> <versions> [message]" );
+        else if ( not parseCode( type, rule.type ) or not parseCode( subType, rule.subType ) or not parseCode( manufacturer, rule.manufacturer ) )
+            error = lineError( lineNumber, "bad component code" );
+        else if ( not parseVersions( versions, rule.minVersion, rule.maxVersion ) )
+            error = lineError( lineNumber, "bad version range" );
+        else
+        {
+            std::string message = tokens.rest();
+            rule.messageOffset = ExceptionRule::kNoMessage;
+            if ( not message.empty() )
+            {
+                rule.messageOffset = uint32_t( fMessages.size() );
+                fMessages.append( message.c_str(), message.size() + 1 );
+            }
+            rules.push_back( rule );
+            ruleLines.push_back( lineNumber );
+            continue;
+        }
+        ok = false;
+    }
+    fclose( file );
+    if ( not ok )
+        return false;
+
+    // which of two overlapping rules applied would depend on the order they were read in.
+    std::vector<size_t> order( rules.size() );
+    for ( size_t i = 0; i < order.size(); ++i )
+        order[i] = i;
+    std::stable_sort( order.begin(), order.end(), [&]( size_t a, size_t b ) { return ruleLess( rules[a], rules[b] ); } );
+    for ( size_t i = 1; i < order.size(); ++i )
+    {
+        const size_t a = order[i - 1], b = order[i];
+        if ( sameComponent( rules[a], rules[b] ) and rules[b].minVersion <= rules[a].maxVersion )
+        {
+            char what[80];
+            snprintf( what, sizeof( what ), "versions overlap line %d's, for the same component", std::min( ruleLines[a], ruleLines[b] ) );
+            error = lineError( std::max( ruleLines[a], ruleLines[b] ), what );
+            return false;
+        }
+    }
+
+    return build( rules, error );
+}
+
+bool ExceptionTable::build( std::vector<ExceptionRule>& rules, std::string& error )
+{
+    std::stable_sort( rules.begin(), rules.end(), ruleLess );
+    fRules = rules;
+
+    // the first of each component's rules.
+    std::vector<size_t> components;
+    for ( size_t i = 0; i < rules.size(); ++i )
+    {
+        if ( i == 0 or not sameComponent( rules[i - 1], rules[i] ) )
+            components.push_back( i );
+    }
+
+    const size_t n = components.size();
+    fRuns.assign( n, RuleRun() );
+    fDisplacements.assign( n, 0 );
+    if ( n == 0 )
+        return true;
+
+    std::vector<std::vector<size_t> > buckets( n );
+    for ( size_t c = 0; c < n; ++c )
+    {
+        const ExceptionRule& rule = rules[components[c]];
+        buckets[hashKey( rule.type, rule.subType, rule.manufacturer, 0 ) % n].push_back( c );
+    }
+
+    // place the biggest buckets first, while there's the most room.
+    std::vector<size_t> order( n );
+    for ( size_t i = 0; i < n; ++i )
+        order[i] = i;
+    std::stable_sort( order.begin(), order.end(), [&]( size_t a, size_t b ) { return buckets[a].size() > buckets[b].size(); } );
+
+    auto runOf = [&]( size_t c ) {
+        RuleRun run;
+        run.first = uint32_t( components[c] );
+        run.count = uint32_t( ((c + 1 < n) ? components[c + 1] : rules.size()) - components[c] );
+        return run;
+    };
+
+    std::vector<bool> taken( n, false );
+    size_t nextFree = 0;
+    for ( size_t b : order )
+    {
+        const std::vector<size_t>& bucket = buckets[b];
+        if ( bucket.empty() )
+            break;
+
+        if ( bucket.size() == 1 )
+        {
+            while ( taken[nextFree] )
+                ++nextFree;
+            taken[nextFree] = true;
+            fRuns[nextFree] = runOf( bucket[0] );
+            fDisplacements[b] = -int32_t( nextFree + 1 );
+            continue;
+        }
+
+        std::vector<size_t> slots( bucket.size() );
+        int32_t seed = 1;
+        for ( ; seed < kMaxSeed; ++seed )
+        {
+            bool fits = true;
+            for ( size_t i = 0; i < bucket.size() and fits; ++i )
+            {
+                const ExceptionRule& rule = rules[components[bucket[i]]];
+                slots[i] = hashKey( rule.type, rule.subType, rule.manufacturer, seed ) % n;
+                fits = not taken[slots[i]] and std::find( slots.begin(), slots.begin() + i, slots[i] ) == slots.begin() + i;
+            }
+            if ( fits )
+                break;
+        }
+        if ( seed == kMaxSeed )
+        {
+            error = "couldn't build the hash table";
+            return false;
+        }
+
+        for ( size_t i = 0; i < bucket.size(); ++i )
+        {
+            taken[slots[i]] = true;
+            fRuns[slots[i]] = runOf( bucket[i] );
+        }
+        fDisplacements[b] = seed;
+    }
+    return true;
+}
+
+const ExceptionRule* ExceptionTable::find( uint32_t type, uint32_t subType, uint32_t manufacturer, uint32_t version ) const
+{
+    const size_t n = fRuns.size();
+    if ( n == 0 )
+        return NULL;
+
+    int32_t displacement = fDisplacements[hashKey( type, subType, manufacturer, 0 ) % n];
+    size_t slot = (displacement < 0)
+                  ? size_t( -(displacement + 1) )
+                  : size_t( hashKey( type, subType, manufacturer, displacement ) % n );
+
+    const RuleRun& run = fRuns[slot];
+    const ExceptionRule& first = fRules[run.first];
+    if ( first.type != type or first.subType != subType or first.manufacturer != manufacturer )
+        return NULL;
+
+    // a component rarely has more than one or two.
+    for ( uint32_t i = run.first; i < run.first + run.count; ++i )
+    {
+        if ( fRules[i].appliesTo( version ) )
+            return &fRules[i];
+    }
+    return NULL;
+}
+
+const char* ExceptionTable::getMessage( const ExceptionRule& rule ) const
+{
+    if ( rule.messageOffset == ExceptionRule::kNoMessage or rule.messageOffset >= fMessages.size() )
+        return NULL;
+    return fMessages.c_str() + rule.messageOffset;
+}
+
+// checks that a table read from a cache can't send find or getMessage outside
+// of it, whatever was in the file.
+bool ExceptionTable::validateCache() const
+{
+    const int64_t n = int64_t( fRuns.size() );
+    for ( int32_t displacement : fDisplacements )
+    {
+        if ( displacement < 0 and -(int64_t( displacement ) + 1) >= n )
+            return false;
+    }
+
+    for ( const RuleRun& run : fRuns )
+    {
+        if ( run.count == 0 or run.first >= fRules.size() or run.count > fRules.size() - run.first )
+            return false;
+    }
+
+    // every message ends at a NUL, the last one at the end.
+    if ( not fMessages.empty() and fMessages[fMessages.size() - 1] != 0 )
+        return false;
+
+    for ( const ExceptionRule& rule : fRules )
+    {
+        if ( rule.kind > kExceptionIncompatible )
+            return false;
+        if ( rule.messageOffset != ExceptionRule::kNoMessage and rule.messageOffset >= fMessages.size() )
+            return false;
+    }
+    return true;
+}
+
+bool ExceptionTable::readCache( const std::string& cachePath, const int64_t sourceStamp[3] )
+{
+    FILE* file = fopen( cachePath.c_str(), "rb" );
+    if ( not file )
+        return false;
+
+    CacheHeader header;
+    struct stat info;
+    bool ok = fread( &header, sizeof( header ), 1, file ) == 1
+              and header.magic == kCacheMagic
+              and header.formatVersion == kCacheFormatVersion
+              and memcmp( header.sourceStamp, sourceStamp, sizeof( header.sourceStamp ) ) == 0
+              and fstat( fileno( file ), &info ) == 0
+              and uint64_t( info.st_size ) == sizeof( header )
+                                              + uint64_t( header.componentCount ) * (sizeof( int32_t ) + sizeof( RuleRun ))
+                                              + uint64_t( header.ruleCount ) * sizeof( ExceptionRule )
+                                              + header.messageBytes;
+
+    if ( ok )
+    {
+        fDisplacements.resize( header.componentCount );
+        fRuns.resize( header.componentCount );
+        fRules.resize( header.ruleCount );
+        fMessages.resize( header.messageBytes );
+
+        ok = (header.componentCount == 0 or
+                (fread( fDisplacements.data(), sizeof( int32_t ), header.componentCount, file ) == header.componentCount and
+                 fread( fRuns.data(), sizeof( RuleRun ), header.componentCount, file ) == header.componentCount))
+             and (header.ruleCount == 0 or fread( fRules.data(), sizeof( ExceptionRule ), header.ruleCount, file ) == header.ruleCount)
+             and (header.messageBytes == 0 or fread( &fMessages[0], 1, header.messageBytes, file ) == header.messageBytes)
+             and fgetc( file ) == EOF
+             and validateCache();
+    }
+    fclose( file );
+
+    // a damaged cache is thrown away, and the data file parsed again.
+    if ( not ok )
+    {
+        fDisplacements.clear();
+        fRuns.clear();
+        fRules.clear();
+        fMessages.clear();
+    }
+    return ok;
+}
+
+bool ExceptionTable::writeCache( const std::string& cachePath, const int64_t sourceStamp[3] ) const
+{
+    CacheHeader header;
+    memset( &header, 0, sizeof( header ) );
+    header.magic = kCacheMagic;
+    header.formatVersion = kCacheFormatVersion;
+    memcpy( header.sourceStamp, sourceStamp, sizeof( header.sourceStamp ) );
+    header.componentCount = uint32_t( fRuns.size() );
+    header.ruleCount = uint32_t( fRules.size() );
+    header.messageBytes = uint32_t( fMessages.size() );
+
+    char suffix[32];
+    snprintf( suffix, sizeof( suffix ), ".%d.tmp", int(getpid()) );
+    std::string tempPath = cachePath + suffix;
+
+    FILE* file = fopen( tempPath.c_str(), "wb" );
+    if ( not file )
+        return false;
+
+    bool ok = fwrite( &header, sizeof( header ), 1, file ) == 1
+              and fwrite( fDisplacements.data(), sizeof( int32_t ), fDisplacements.size(), file ) == fDisplacements.size()
+              and fwrite( fRuns.data(), sizeof( RuleRun ), fRuns.size(), file ) == fRuns.size()
+              and fwrite( fRules.data(), sizeof( ExceptionRule ), fRules.size(), file ) == fRules.size()
+              and fwrite( fMessages.data(), 1, fMessages.size(), file ) == fMessages.size();
+    ok = (fclose( file ) == 0) and ok;
+
+    if ( not ok )
+    {
+        unlink( tempPath.c_str() );
+        return false;
+    }
+    return rename( tempPath.c_str(), cachePath.c_str() ) == 0;
+}
@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#ifndef _AUVAL_EXCEPTIONTABLE_H_
+#define _AUVAL_EXCEPTIONTABLE_H_
+/****************************************************************************
+
+	AUValExceptionTable
+
+	The black and white lists, loaded from a data file so they can be
+	updated without rebuilding the validator.
+
+	The data file has one rule per line; '#' starts a comment:
+
+		<kind> <type> <subtype> <manufacturer> <versions> [message]
+
+	kind is one of
+		valid			always pass, without testing (white list)
+		duplicate		always reject; the MAS version should be used instead
+		incompatible	always reject
+	type, subtype and manufacturer are decimal numbers or four-character
+	codes.  A code with a space in it, or that is all digits, has to be
+	quoted: 'MVO '.  versions is '*' for all
+	versions, or N, <=N, >=N or N-M (inclusive), and limits the rule to
+	those component versions.  message is the rest of the line.
+
+	A component can have several rules, as long as their version ranges
+	don't overlap; the one whose range holds the component's version
+	applies.  A file with any error is rejected as a whole.
+
+	The rules are compiled into a minimal perfect hash table (hash and
+	displace) over the components, so a lookup hashes the component once
+	or twice and checks exactly one slot, which holds the component's
+	rules, in version order.  The compiled table is cached next to the data
+	file, in <path>.cache, and reused until the data file changes.  A
+	cache that is damaged (a slot or message outside the table, say) is
+	ignored and rewritten.
+
+****************************************************************************/
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+enum ExceptionKind
+{
+    kExceptionValid,
+    kExceptionDuplicate,
+    kExceptionIncompatible
+};
+
+struct ExceptionRule
+{
+    uint32_t type;
+    uint32_t subType;
+    uint32_t manufacturer;
+    uint32_t kind;              // an ExceptionKind
+    uint32_t minVersion;        // inclusive
+    uint32_t maxVersion;        // inclusive
+    uint32_t messageOffset;     // kNoMessage if there isn't one
+
+    static const uint32_t kNoMessage = 0xFFFFFFFF;
+
+    bool appliesTo( uint32_t version ) const { return version >= minVersion and version <= maxVersion; }
+};
+
+class ExceptionTable
+{
+public:
+    ExceptionTable() {}
+
+    // loads from the compiled cache if it is up to date, otherwise parses the data file
+    // and rewrites the cache.  On failure, error says what was wrong.
+    bool load( const std::string& path, std::string& error );
+
+    bool empty() const { return fRules.empty(); }
+
+    // NULL if there's no rule for this version of the component.
+    const ExceptionRule* find( uint32_t type, uint32_t subType, uint32_t manufacturer, uint32_t version ) const;
+
+    // NULL if the rule has no message.
+    const char* getMessage( const ExceptionRule& rule ) const;
+
+private:
+    // a component's rules, fRules[first] to fRules[first + count - 1].
+    struct RuleRun
+    {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    bool parse( const std::string& path, std::string& error );
+    bool build( std::vector<ExceptionRule>& rules, std::string& error );
+    bool readCache( const std::string& cachePath, const int64_t sourceStamp[3] );
+    bool validateCache() const;
+    bool writeCache( const std::string& cachePath, const int64_t sourceStamp[3] ) const;
+
+    // for each first-level bucket: >= 0 is the seed to rehash the key with,
+    // < 0 is -(slot + 1) for a bucket with a single key.
+    std::vector<int32_t> fDisplacements;
+    // a slot per component.
+    std::vector<RuleRun> fRuns;
+    // sorted by component, then version.
+    std::vector<ExceptionRule> fRules;
+    std::string fMessages;
+};
+
+#endif // _AUVAL_EXCEPTIONTABLE_H_
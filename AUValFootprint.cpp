@@ -0,0 +1,103 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "AUValFootprint.h"
+#include "FakeNew.h"
+#include "MemoryStats.h"
+
+#include <stdio.h>
+
+namespace
+{
+    using AUValFootprint::Point;
+    using AUValFootprint::Sample;
+
+    // the least-squares slope of one measurement against the number of instances.
+    double slope( const std::vector<Point>& points, int64_t Sample::* member )
+    {
+        double n = points.size();
+        double sumX = 0, sumY = 0, sumXY = 0, sumXX = 0;
+        for ( const Point& point : points )
+        {
+            double x = point.instances;
+            double y = double( point.footprint.*member );
+            sumX += x;
+            sumY += y;
+            sumXY += x * y;
+            sumXX += x * x;
+        }
+        double denominator = n * sumXX - sumX * sumX;
+        if ( denominator > 0 )
+            return (n * sumXY - sumX * sumY) / denominator;
+
+        // a single point: all we can say is the average.
+        return (sumX > 0) ? sumY / sumX : 0;
+    }
+
+    Sample marginal( const std::vector<Point>& points )
+    {
+        Sample sample;
+        sample.residentBytes = int64_t( slope( points, &Sample::residentBytes ) );
+        sample.heapBytes = int64_t( slope( points, &Sample::heapBytes ) );
+        sample.mappedFileBytes = int64_t( slope( points, &Sample::mappedFileBytes ) );
+        return sample;
+    }
+
+    std::string sampleFields( const Sample& sample )
+    {
+        char fields[128];
+        snprintf( fields, sizeof( fields ), "\"resident\": %lld, \"heap\": %lld, \"mapped_files\": %lld",
+                  (long long)sample.residentBytes, (long long)sample.heapBytes, (long long)sample.mappedFileBytes );
+        return fields;
+    }
+
+    std::string stateJSON( const std::vector<Point>& points, const Sample& firstInstance, bool sharedKnown )
+    {
+        Sample perInstance = marginal( points );
+        std::string json = "{\n    \"marginal\": { " + sampleFields( perInstance ) + " },\n";
+        if ( sharedKnown )
+            json += "    \"shared\": { " + sampleFields( firstInstance - perInstance ) + " },\n";
+
+        json += "    \"points\": [";
+        for ( size_t i = 0; i < points.size(); ++i )
+        {
+            char instances[32];
+            snprintf( instances, sizeof( instances ), "\"instances\": %d, ", points[i].instances );
+            json += std::string( i ? ",\n" : "\n" ) + "      { " + instances + sampleFields( points[i].footprint ) + " }";
+        }
+        return json + "\n    ]\n  }";
+    }
+}
+
+namespace AUValFootprint
+{
+    Sample Measure()
+    {
+        Sample sample;
+        sample.residentBytes = int64_t( MemoryStats::ResidentBytes() );
+        sample.heapBytes = FakeNewLiveBytes();
+        sample.mappedFileBytes = int64_t( MemoryStats::MappedFileBytes() );
+        return sample;
+    }
+
+    Sample operator-( const Sample& a, const Sample& b )
+    {
+        Sample difference;
+        difference.residentBytes = a.residentBytes - b.residentBytes;
+        difference.heapBytes = a.heapBytes - b.heapBytes;
+        difference.mappedFileBytes = a.mappedFileBytes - b.mappedFileBytes;
+        return difference;
+    }
+
+    std::string ToJSON( const Report& report )
+    {
+        // the first instance was either initialized or not, so the shared cost
+        // is only known for that state.
+        return "{\n  \"first_instance\": { " + sampleFields( report.firstInstance ) + " },\n" +
+               "  \"uninitialized\": " + stateJSON( report.uninitialized, report.firstInstance, not report.firstInstanceInitialized ) + ",\n" +
+               "  \"initialized\": " + stateJSON( report.initialized, report.firstInstance, report.firstInstanceInitialized ) + "\n}\n";
+    }
+}
@@ -0,0 +1,67 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#ifndef _AUVAL_FOOTPRINT_H_
+#define _AUVAL_FOOTPRINT_H_
+/****************************************************************************
+
+	AUValFootprint
+
+	How much memory instances of a plug-in take, for working out how many
+	fit on a machine.  The FootprintScaling test measures 1, 2, 4 ... N
+	instances, uninitialized and initialized, and fits a line through the
+	measurements: its slope is what each further instance costs.  What the
+	first instance cost beyond that is shared by all of them (statics,
+	samples and the like).
+
+	The summary is JSON:
+
+		{ "first_instance": <sample>,
+		  "uninitialized": { "marginal": <sample>, "shared": <sample>,
+		                     "points": [ { "instances": n, <sample> }, ... ] },
+		  "initialized": { ... } }
+
+	where each <sample> is "resident", "heap" and "mapped_files", in bytes.
+	"shared" is only given for the state the first instance was in.
+
+****************************************************************************/
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace AUValFootprint
+{
+    struct Sample
+    {
+        Sample() : residentBytes(0), heapBytes(0), mappedFileBytes(0) {}
+
+        int64_t residentBytes;
+        int64_t heapBytes;          // only counted while FakeNew's profiling is on
+        int64_t mappedFileBytes;
+    };
+
+    Sample Measure();
+    Sample operator-( const Sample& a, const Sample& b );
+
+    struct Point
+    {
+        int instances;
+        Sample footprint;           // above what was in use before the first of them
+    };
+
+    struct Report
+    {
+        Sample firstInstance;       // what creating the first instance in the process took
+        bool firstInstanceInitialized;
+        std::vector<Point> uninitialized;
+        std::vector<Point> initialized;
+    };
+
+    std::string ToJSON( const Report& report );
+}
+
+#endif // _AUVAL_FOOTPRINT_H_
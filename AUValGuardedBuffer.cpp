@@ -0,0 +1,182 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "AUValGuardedBuffer.h"
+#include "AUValStatus.h"
+
+#include <mutex>
+#include <new>
+
+#include <execinfo.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+    #define MAP_ANONYMOUS MAP_ANON
+#endif
+
+namespace
+{
+    const unsigned char kCanary = 0xcd;
+    // at least this much of the mapping in front of the buffer is canaries.
+    const size_t kMinCanaryBytes = 256;
+    // render buffers are often read with vector loads, so they stay aligned this much.
+    const size_t kAlignment = 16;
+    const int kMaxGuards = 512;
+    const int kMaxStackFrames = 64;
+
+    size_t pageSize()
+    {
+        static const size_t size = size_t( sysconf( _SC_PAGESIZE ) );
+        return size;
+    }
+
+    // the guard pages, for the fault handler.  Slots are claimed under the
+    // mutex, but the handler only reads them.
+    std::mutex gGuardsMutex;
+    char* volatile gGuards[kMaxGuards];
+
+    struct sigaction gPreviousSegv;
+    struct sigaction gPreviousBus;
+
+    bool inGuardPage( const char* address )
+    {
+        for ( int i = 0; i < kMaxGuards; ++i )
+        {
+            const char* guard = gGuards[i];
+            if ( guard and address >= guard and address < guard + pageSize() )
+                return true;
+        }
+        return false;
+    }
+
+    void writeString( const char* str )
+    {
+        ssize_t ignored = write( STDOUT_FILENO, str, strlen( str ) );
+        (void)ignored;
+    }
+
+    extern "C" void faultHandler( int sig, siginfo_t* info, void* )
+    {
+        if ( inGuardPage( static_cast<const char*>( info->si_addr ) ) )
+        {
+            // the fault came from the plug-in's render code, not from inside stdio,
+            // so it's safe enough to get out what the tests printed so far.
+            fflush( stdout );
+            writeString( "!render buffer overrun: the plug-in wrote past the end of a render buffer\n" );
+            void* frames[kMaxStackFrames];
+            int count = backtrace( frames, kMaxStackFrames );
+            backtrace_symbols_fd( frames, count, STDOUT_FILENO );
+
+            // the plug-in was in the middle of rendering, so don't run any destructors.
+            _exit( kAUValStatusBufferOverrun );
+        }
+
+        // not ours: put back whatever was handling the fault before, and let
+        // the faulting instruction run again.
+        sigaction( sig, (sig == SIGBUS) ? &gPreviousBus : &gPreviousSegv, NULL );
+    }
+
+    size_t roundUp( size_t size, size_t multiple )
+    {
+        return (size + multiple - 1) / multiple * multiple;
+    }
+
+    bool allCanaries( const char* begin, const char* end )
+    {
+        for ( const char* p = begin; p < end; ++p )
+        {
+            if ( static_cast<unsigned char>( *p ) != kCanary )
+                return false;
+        }
+        return true;
+    }
+}
+
+void AUValGuardedBuffer::InstallFaultHandler()
+{
+    static std::once_flag once;
+    std::call_once( once, []
+    {
+        struct sigaction action;
+        memset( &action, 0, sizeof( action ) );
+        action.sa_sigaction = faultHandler;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset( &action.sa_mask );
+
+        // a write to a PROT_NONE page is a SIGBUS on some versions of Mac OS X.
+        sigaction( SIGSEGV, &action, &gPreviousSegv );
+        sigaction( SIGBUS, &action, &gPreviousBus );
+    } );
+}
+
+AUValGuardedBuffer::AUValGuardedBuffer( size_t capacity ) :
+    fBase(NULL),
+    fLength(0),
+    fGuard(NULL),
+    fData(NULL),
+    fBytes(0),
+    fSlot(-1)
+{
+    fLength = roundUp( capacity + kMinCanaryBytes, pageSize() ) + pageSize();
+    void* mapping = mmap( NULL, fLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if ( mapping == MAP_FAILED )
+        throw std::bad_alloc();
+
+    fBase = static_cast<char*>( mapping );
+    fGuard = fBase + fLength - pageSize();
+    if ( mprotect( fGuard, pageSize(), PROT_NONE ) != 0 )
+    {
+        munmap( fBase, fLength );
+        throw std::bad_alloc();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( gGuardsMutex );
+        for ( int i = 0; i < kMaxGuards; ++i )
+        {
+            if ( not gGuards[i] )
+            {
+                gGuards[i] = fGuard;
+                fSlot = i;
+                break;
+            }
+        }
+    }
+    // with every slot taken, an overrun still faults; it just isn't reported as one.
+
+    Place( capacity );
+}
+
+AUValGuardedBuffer::~AUValGuardedBuffer()
+{
+    if ( fSlot >= 0 )
+    {
+        std::lock_guard<std::mutex> lock( gGuardsMutex );
+        gGuards[fSlot] = NULL;
+    }
+    munmap( fBase, fLength );
+}
+
+void* AUValGuardedBuffer::Place( size_t bytes )
+{
+    // the end of the buffer sits on the guard page unless the size isn't a
+    // multiple of the alignment; the few bytes between are canaries too.
+    fBytes = bytes;
+    fData = reinterpret_cast<char*>( uintptr_t( fGuard - bytes ) & ~uintptr_t( kAlignment - 1 ) );
+    memset( fBase, kCanary, fData - fBase );
+    memset( fData + fBytes, kCanary, fGuard - (fData + fBytes) );
+    return fData;
+}
+
+bool AUValGuardedBuffer::CanariesIntact() const
+{
+    return allCanaries( fBase, fData ) and allCanaries( fData + fBytes, fGuard );
+}
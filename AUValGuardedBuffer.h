@@ -0,0 +1,60 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#ifndef _AUVAL_GUARDEDBUFFER_H_
+#define _AUVAL_GUARDEDBUFFER_H_
+/****************************************************************************
+
+	AUValGuardedBuffer
+
+	A render buffer that ends right against an inaccessible guard page, so
+	a plug-in that writes past the end of it faults on the spot instead of
+	quietly corrupting the heap.  The bytes in front of the buffer are
+	filled with a canary pattern, so writes in front of it can be caught
+	too, though only after the fact.
+
+	Once AUValGuardedBuffer::InstallFaultHandler has been called, a fault
+	in a guard page reports the overrun and its stack on stdout and exits
+	with kAUValStatusBufferOverrun.  Any other fault crashes as it would
+	have anyway.
+
+****************************************************************************/
+
+#include <stddef.h>
+
+class AUValGuardedBuffer
+{
+public:
+    static void InstallFaultHandler();
+
+    // room for up to capacity bytes.
+    explicit AUValGuardedBuffer( size_t capacity );
+    ~AUValGuardedBuffer();
+
+    // moves the buffer so that it has the given size (no more than the
+    // capacity) and still ends against the guard page, and refills the
+    // canaries in front of it.  Returns the start of the buffer.
+    void* Place( size_t bytes );
+
+    void* Data() const { return fData; }
+    size_t Size() const { return fBytes; }
+
+    // false if anything around the buffer, other than the guard page, was written.
+    bool CanariesIntact() const;
+
+private:
+    AUValGuardedBuffer( const AUValGuardedBuffer& );
+    AUValGuardedBuffer& operator=( const AUValGuardedBuffer& );
+
+    char* fBase;        // the start of the mapping
+    size_t fLength;     // including the guard page
+    char* fGuard;
+    char* fData;
+    size_t fBytes;
+    int fSlot;          // where the guard page is registered for the fault handler
+};
+
+#endif // _AUVAL_GUARDEDBUFFER_H_
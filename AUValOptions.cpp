@@ -0,0 +1,276 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "AUValOptions.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+AUValOptions::AUValOptions() :
+    watchdog(true),
+    testTimeout(60),
+    adaptiveRepeat(false),
+    repeatPrecision(0.05),
+    maxRepetitions(20),
+    repeatBudget(120),
+    tieredSchedule(false),
+    failFast(false),
+    shards(1),
+    errorStats(false),
+    allocatorStats(false),
+    allocProfile(false),
+    leakCycles(10),
+    leakThreshold(1024),
+    allocDiagnostics(kAllocDiagnosticsOff),
+    guardBuffers(false),
+    footprintInstances(8),
+    faultSlices(64),
+    faultFirstSlices(4),
+    prefaultBuffers(false),
+    policyInstances(0),
+    sweepSteps(8),
+    sweepBudget(0.5)
+{
+    for ( int i = 0; i < kNumRenderMemoryPolicies; ++i )
+        renderMemoryPolicies.push_back( RenderMemoryPolicy( i ) );
+}
+
+namespace
+{
+    const char kOptionPrefix[] = "--auexamine_";
+
+    AUValOptions gOptions;
+
+    bool parseDouble( const std::string& str, double& out )
+    {
+        char* end = NULL;
+        out = strtod( str.c_str(), &end );
+        return (end != str.c_str()) and (*end == 0);
+    }
+
+    bool parseInt( const std::string& str, int& out )
+    {
+        char* end = NULL;
+        out = int(strtol( str.c_str(), &end, 10 ));
+        return (end != str.c_str()) and (*end == 0);
+    }
+
+    bool parseBool( const std::string& str, bool& out )
+    {
+        // a bare flag (--auexamine_foo) means "on".
+        if ( str.empty() or str == "1" or str == "true" )
+            out = true;
+        else if ( str == "0" or str == "false" )
+            out = false;
+        else
+            return false;
+        return true;
+    }
+
+    // parses "Name:30,Other:120"
+    bool parseTimeoutList( const std::string& str, std::map<std::string, double>& out )
+    {
+        size_t pos = 0;
+        while ( pos < str.size() )
+        {
+            size_t comma = str.find( ',', pos );
+            if ( comma == std::string::npos )
+                comma = str.size();
+
+            std::string entry = str.substr( pos, comma - pos );
+            size_t colon = entry.find( ':' );
+            double seconds;
+            if ( colon == std::string::npos or not parseDouble( entry.substr( colon + 1 ), seconds ) or seconds < 0 )
+                return false;
+
+            out[entry.substr( 0, colon )] = seconds;
+            pos = comma + 1;
+        }
+        return true;
+    }
+
+    // parses "heap,first_touch"
+    bool parsePolicyList( const std::string& str, std::vector<RenderMemoryPolicy>& out )
+    {
+        out.clear();
+        size_t pos = 0;
+        while ( pos < str.size() )
+        {
+            size_t comma = str.find( ',', pos );
+            if ( comma == std::string::npos )
+                comma = str.size();
+
+            RenderMemoryPolicy policy;
+            if ( not ParseRenderMemoryPolicy( str.substr( pos, comma - pos ), policy ) )
+                return false;
+
+            out.push_back( policy );
+            pos = comma + 1;
+        }
+        return not out.empty();
+    }
+
+    // parses "Name,Other"
+    bool parseNameList( const std::string& str, std::set<std::string>& out )
+    {
+        out.clear();
+        size_t pos = 0;
+        while ( pos < str.size() )
+        {
+            size_t comma = str.find( ',', pos );
+            if ( comma == std::string::npos )
+                comma = str.size();
+
+            if ( comma == pos )
+                return false;
+            out.insert( str.substr( pos, comma - pos ) );
+            pos = comma + 1;
+        }
+        return not out.empty();
+    }
+
+    bool parseOption( const std::string& name, const std::string& value )
+    {
+        if ( name == "watchdog" )
+            return parseBool( value, gOptions.watchdog );
+        if ( name == "test_timeout" )
+            return parseDouble( value, gOptions.testTimeout ) and gOptions.testTimeout > 0;
+        if ( name == "test_timeouts" )
+            return parseTimeoutList( value, gOptions.testTimeouts );
+        if ( name == "adaptive_repeat" )
+            return parseBool( value, gOptions.adaptiveRepeat );
+        if ( name == "repeat_precision" )
+            return parseDouble( value, gOptions.repeatPrecision ) and gOptions.repeatPrecision > 0;
+        if ( name == "max_repetitions" )
+            return parseInt( value, gOptions.maxRepetitions ) and gOptions.maxRepetitions > 0;
+        if ( name == "repeat_budget" )
+            return parseDouble( value, gOptions.repeatBudget ) and gOptions.repeatBudget >= 0;
+        if ( name == "tiered_schedule" )
+            return parseBool( value, gOptions.tieredSchedule );
+        if ( name == "fail_fast" )
+            return parseBool( value, gOptions.failFast );
+        if ( name == "cost_history" )
+        {
+            gOptions.costHistory = value;
+            return not value.empty();
+        }
+        if ( name == "shards" )
+        {
+            // 0 means "auto".
+            if ( value == "auto" )
+            {
+                gOptions.shards = 0;
+                return true;
+            }
+            return parseInt( value, gOptions.shards ) and gOptions.shards > 0;
+        }
+        if ( name == "catalog" )
+        {
+            gOptions.catalog = value;
+            return not value.empty();
+        }
+        if ( name == "exception_list" )
+        {
+            gOptions.exceptionList = value;
+            return not value.empty();
+        }
+        if ( name == "result_store" )
+        {
+            gOptions.resultStore = value;
+            return not value.empty();
+        }
+        if ( name == "error_stats" )
+            return parseBool( value, gOptions.errorStats );
+        if ( name == "allocator_stats" )
+            return parseBool( value, gOptions.allocatorStats );
+        if ( name == "alloc_profile" )
+            return parseBool( value, gOptions.allocProfile );
+        if ( name == "leak_cycles" )
+            return parseInt( value, gOptions.leakCycles ) and gOptions.leakCycles >= 4;
+        if ( name == "leak_threshold" )
+            return parseDouble( value, gOptions.leakThreshold ) and gOptions.leakThreshold >= 0;
+        if ( name == "alloc_diagnostics" )
+        {
+            if ( value == "0" or value == "off" )
+                gOptions.allocDiagnostics = AUValOptions::kAllocDiagnosticsOff;
+            else if ( value.empty() or value == "1" or value == "report" )
+                gOptions.allocDiagnostics = AUValOptions::kAllocDiagnosticsReport;
+            else if ( value == "fail" )
+                gOptions.allocDiagnostics = AUValOptions::kAllocDiagnosticsFail;
+            else
+                return false;
+            return true;
+        }
+        if ( name == "guard_buffers" )
+            return parseBool( value, gOptions.guardBuffers );
+        if ( name == "footprint_instances" )
+            return parseInt( value, gOptions.footprintInstances ) and gOptions.footprintInstances > 0;
+        if ( name == "footprint_report" )
+        {
+            gOptions.footprintReport = value;
+            return not value.empty();
+        }
+        if ( name == "fault_slices" )
+            return parseInt( value, gOptions.faultSlices ) and gOptions.faultSlices > 0;
+        if ( name == "fault_first_slices" )
+            return parseInt( value, gOptions.faultFirstSlices ) and gOptions.faultFirstSlices >= 0;
+        if ( name == "prefault_buffers" )
+            return parseBool( value, gOptions.prefaultBuffers );
+        if ( name == "extra_tests" )
+            return parseNameList( value, gOptions.extraTests );
+        if ( name == "policy_instances" )
+            return parseInt( value, gOptions.policyInstances ) and gOptions.policyInstances >= 0;
+        if ( name == "render_memory_policies" )
+            return parsePolicyList( value, gOptions.renderMemoryPolicies );
+        if ( name == "sweep_steps" )
+            return parseInt( value, gOptions.sweepSteps ) and gOptions.sweepSteps >= 2;
+        if ( name == "sweep_budget" )
+            return parseDouble( value, gOptions.sweepBudget ) and gOptions.sweepBudget > 0;
+        if ( name == "checkpoint" )
+        {
+            gOptions.checkpoint = value;
+            return not value.empty();
+        }
+
+        return false;
+    }
+}
+
+const AUValOptions& GetAUValOptions()
+{
+    return gOptions;
+}
+
+bool ParseAUValOptions( int& argc, char** argv )
+{
+    const size_t prefixLen = strlen( kOptionPrefix );
+    bool ok = true;
+
+    int kept = 1;
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( strncmp( argv[i], kOptionPrefix, prefixLen ) != 0 )
+        {
+            argv[kept++] = argv[i];
+            continue;
+        }
+
+        std::string option( argv[i] + prefixLen );
+        size_t equals = option.find( '=' );
+        std::string name = option.substr( 0, equals );
+        std::string value = (equals == std::string::npos) ? std::string() : option.substr( equals + 1 );
+
+        if ( not parseOption( name, value ) )
+        {
+            printf( "!bad option %s\n", argv[i] );
+            ok = false;
+        }
+    }
+
+    argc = kept;
+    argv[argc] = NULL;
+    return ok;
+}
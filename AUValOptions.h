@@ -0,0 +1,151 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#ifndef _AUVAL_OPTIONS_H_
+#define _AUVAL_OPTIONS_H_
+/****************************************************************************
+
+	AUValOptions
+
+	Optional settings for a validation run.  These are passed on the
+	command line as --auexamine_<name>=<value>, and are removed from
+	argv before the positional arguments are parsed, the same way
+	InitGoogleTest removes the --gtest_ options.
+
+****************************************************************************/
+
+#include "AUValRenderMemory.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+struct AUValOptions
+{
+    AUValOptions();
+
+    // watchdog=0 turns off hang detection entirely.
+    bool watchdog;
+    // the time budget, in seconds, for any test without a budget of its own.
+    double testTimeout;
+    // per-test budgets in seconds, keyed by test name (test_timeouts=Name:120,Other:30).
+    std::map<std::string, double> testTimeouts;
+
+    // adaptive_repeat runs structural tests once, and repeats timing-sensitive
+    // tests until their timing is known to within repeat_precision (0.05 = 5%),
+    // up to max_repetitions each.  Once repeat_budget seconds have gone into
+    // repetitions, every remaining test runs just once.
+    bool adaptiveRepeat;
+    double repeatPrecision;
+    int maxRepetitions;
+    double repeatBudget;
+
+    // tiered_schedule runs the tests tier by tier (smoke, structural, render,
+    // stress) instead of shuffled, cheapest first within each tier according
+    // to the timings kept in cost_history.  With fail_fast, no further tiers
+    // are run once a tier has a failure.
+    bool tieredSchedule;
+    bool failFast;
+    std::string costHistory;
+
+    // checkpoint=path records each test as it starts and finishes.  If the
+    // run dies, running again with the same path skips the tests that already
+    // finished and re-runs the one it died in by itself, to confirm the crash.
+    std::string checkpoint;
+
+    // shards=N splits the tests across N copies of the validator running side
+    // by side, each with its own instance; shards=auto picks N from the number
+    // of cores and the memory an instance takes.  1 (the default) runs them all here.
+    int shards;     // 0 for auto
+
+    // catalog=path keeps a snapshot of the system's components there, so
+    // component names and versions can be looked up without enumerating
+    // every component.  It is rebuilt when a plug-in directory changes.
+    std::string catalog;
+
+    // result_store=path remembers each component's result, and reuses it
+    // as long as the component's bundle hasn't changed.
+    std::string resultStore;
+
+    // exception_list=path replaces the built-in black and white lists with
+    // the rules in a data file (see AUValExcptTable.h for the format).
+    std::string exceptionList;
+
+    // error_stats prints how often each Audio Unit call failed, and with
+    // which error, once the tests have run.
+    bool errorStats;
+
+    // allocator_stats prints, for each size class of the validator's
+    // allocator, how many blocks were allocated and freed.
+    bool allocatorStats;
+
+    // alloc_profile prints, after each test, the plug-in's allocations in each
+    // stage of its life (see AUValAllocProfile.h).
+    bool allocProfile;
+
+    // the LeakCheckLifecycle extra test creates, initializes, renders with and
+    // destroys a fresh instance leak_cycles times (default 10), and fails if
+    // the plug-in's heap grows by more than leak_threshold bytes a cycle
+    // (default 1024).
+    int leakCycles;
+    double leakThreshold;
+
+    // alloc_diagnostics=report reports each block the plug-in hands to the
+    // wrong deallocator, and each block it deletes twice, with the call stack
+    // and the test it happened in.  alloc_diagnostics=fail also fails the test.
+    enum AllocDiagnostics
+    {
+        kAllocDiagnosticsOff,
+        kAllocDiagnosticsReport,
+        kAllocDiagnosticsFail
+    };
+    AllocDiagnostics allocDiagnostics;
+
+    // guard_buffers puts each render buffer against a guard page, so a plug-in
+    // that writes past the end of one is stopped on the spot and reported
+    // with kAUValStatusBufferOverrun (see AUValGuardedBuffer.h).
+    bool guardBuffers;
+
+    // the FootprintScaling extra test measures 1, 2, 4 ... up to
+    // footprint_instances instances (default 8), and writes its summary to
+    // footprint_report, or prints it if there is no path (see AUValFootprint.h).
+    int footprintInstances;
+    std::string footprintReport;
+
+    // the RenderPageFaults extra test renders fault_slices slices (default 64)
+    // with a fresh instance, and reports the page faults in each of the first
+    // fault_first_slices (default 4) and the average over the rest.
+    // prefault_buffers touches and wires the host's render buffers first, so
+    // the faults that are left are the plug-in's.
+    int faultSlices;
+    int faultFirstSlices;
+    bool prefaultBuffers;
+
+    // extra_tests=Name,Other (or extra_tests=all) runs those of the tests that
+    // only run when asked for (see kTestTraits in AUTortureTest.cpp), once each.
+    std::set<std::string> extraTests;
+
+    // the RenderMemoryPolicies extra test renders policy_instances instances
+    // side by side (default 0, one per core) under each of
+    // render_memory_policies (default all of them; see AUValRenderMemory.h).
+    int policyInstances;
+    std::vector<RenderMemoryPolicy> renderMemoryPolicies;
+
+    // the ParameterSweep extra test steps each parameter through sweep_steps
+    // values (default 8; indexed parameters through all of theirs), and lists
+    // the ones where a change and the slice after it take more than
+    // sweep_budget of the slice's duration (default 0.5).
+    int sweepSteps;
+    double sweepBudget;
+};
+
+const AUValOptions& GetAUValOptions();
+
+// returns false (and prints the offending option) if an option is malformed.
+bool ParseAUValOptions( int& argc, char** argv );
+
+#endif // _AUVAL_OPTIONS_H_
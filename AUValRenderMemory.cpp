@@ -0,0 +1,236 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "AUValRenderMemory.h"
+
+#include <new>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+    #include <mach/mach.h>
+    #include <mach/thread_policy.h>
+    #include <mach/vm_statistics.h>
+#else
+    #include <sched.h>
+    #include <sys/syscall.h>
+#endif
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+    #define MAP_ANONYMOUS MAP_ANON
+#endif
+
+namespace
+{
+    const size_t kHugePageSize = 2 * 1024 * 1024;
+
+    const char* const kPolicyNames[kNumRenderMemoryPolicies] = { "heap", "first_touch", "huge_pages", "interleave" };
+
+    size_t roundUp( size_t size, size_t multiple )
+    {
+        return (size + multiple - 1) / multiple * multiple;
+    }
+
+    void* mapAnonymous( size_t length, int tag = -1 )
+    {
+        void* mapping = mmap( NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, tag, 0 );
+        return (mapping == MAP_FAILED) ? NULL : mapping;
+    }
+
+#if defined(__linux__)
+    // from <linux/mempolicy.h>, which is called through syscall() rather
+    // than take a dependency on libnuma.
+    const int kMPolInterleave = 3;
+
+    // the memory nodes that are online, from a list like "0-1,3"; zero if
+    // there's no telling.  Only the first 64 nodes are used.
+    uint64_t onlineNodes()
+    {
+        FILE* file = fopen( "/sys/devices/system/node/online", "r" );
+        if ( not file )
+            return 0;
+
+        uint64_t nodes = 0;
+        int first, last;
+        while ( fscanf( file, "%d", &first ) == 1 )
+        {
+            last = first;
+            if ( fscanf( file, "-%d", &last ) < 0 )
+                last = first;
+            for ( int node = first; node <= last and node < 64; ++node )
+                nodes |= uint64_t( 1 ) << node;
+            if ( fgetc( file ) != ',' )
+                break;
+        }
+        fclose( file );
+        return nodes;
+    }
+
+    // spreads the pages across the nodes; false if there aren't two to spread them across.
+    bool interleave( void* data, size_t length )
+    {
+        unsigned long nodes = (unsigned long)onlineNodes();
+        if ( __builtin_popcountll( nodes ) < 2 )
+            return false;
+        // the kernel takes one more than the number of bits in the mask.
+        return syscall( SYS_mbind, data, length, kMPolInterleave, &nodes, sizeof( nodes ) * 8 + 1, 0 ) == 0;
+    }
+
+    // the bytes of the mapping that contains data that are on huge pages.
+    size_t hugePageBytes( const void* data )
+    {
+        FILE* file = fopen( "/proc/self/smaps", "r" );
+        if ( not file )
+            return 0;
+
+        // each mapping starts with a "start-end perms ..." line, and its
+        // "AnonHugePages: N kB" line comes somewhere after.
+        size_t bytes = 0;
+        bool inMapping = false;
+        char line[256];
+        while ( fgets( line, sizeof( line ), file ) )
+        {
+            unsigned long long start, end, kilobytes;
+            if ( sscanf( line, "%llx-%llx ", &start, &end ) == 2 )
+            {
+                if ( inMapping )
+                    break;
+                inMapping = uintptr_t( data ) >= start and uintptr_t( data ) < end;
+            }
+            else if ( inMapping and sscanf( line, "AnonHugePages: %llu kB", &kilobytes ) == 1 )
+            {
+                bytes = size_t( kilobytes * 1024 );
+                break;
+            }
+        }
+        fclose( file );
+        return bytes;
+    }
+#endif
+}
+
+const char* RenderMemoryPolicyName( RenderMemoryPolicy policy )
+{
+    return (policy >= 0 and policy < kNumRenderMemoryPolicies) ? kPolicyNames[policy] : "unknown";
+}
+
+bool ParseRenderMemoryPolicy( const std::string& name, RenderMemoryPolicy& policy )
+{
+    for ( int i = 0; i < kNumRenderMemoryPolicies; ++i )
+    {
+        if ( name == kPolicyNames[i] )
+        {
+            policy = RenderMemoryPolicy( i );
+            return true;
+        }
+    }
+    return false;
+}
+
+AUValRenderMemory::AUValRenderMemory( size_t bytes, RenderMemoryPolicy policy ) :
+    fPolicy(policy),
+    fData(NULL),
+    fMapping(NULL),
+    fLength(0),
+    fApplied(true)
+{
+    if ( policy == kRenderMemoryHeap )
+    {
+        fData = malloc( bytes );
+        if ( not fData )
+            throw std::bad_alloc();
+        memset( fData, 0, bytes );
+        return;
+    }
+
+    if ( policy == kRenderMemoryHugePages )
+    {
+#ifdef __APPLE__
+        // for an anonymous mapping, the Mac takes VM flags in place of the file.
+        fLength = roundUp( bytes, kHugePageSize );
+        fMapping = mapAnonymous( fLength, VM_FLAGS_SUPERPAGE_SIZE_2MB );
+        fData = fMapping;
+#else
+        // map a huge page more than asked for, so the start can be aligned to one.
+        fLength = roundUp( bytes, kHugePageSize ) + kHugePageSize;
+        fMapping = mapAnonymous( fLength );
+        if ( fMapping )
+        {
+            fData = reinterpret_cast<void*>( roundUp( uintptr_t( fMapping ), kHugePageSize ) );
+    #ifdef MADV_HUGEPAGE
+            if ( madvise( fData, roundUp( bytes, kHugePageSize ), MADV_HUGEPAGE ) != 0 )
+                fData = NULL;
+    #else
+            fData = NULL;
+    #endif
+            if ( not fData )
+            {
+                munmap( fMapping, fLength );
+                fMapping = NULL;
+            }
+        }
+#endif
+        fApplied = (fData != NULL);
+    }
+
+    // first touch, interleave, or huge pages the OS wouldn't give us.
+    if ( not fData )
+    {
+        fLength = roundUp( bytes, size_t( sysconf( _SC_PAGESIZE ) ) );
+        fMapping = mapAnonymous( fLength );
+        fData = fMapping;
+    }
+    if ( not fData )
+        throw std::bad_alloc();
+
+    if ( policy == kRenderMemoryInterleave )
+    {
+#if defined(__linux__)
+        fApplied = interleave( fMapping, fLength );
+#else
+        // no control over where pages go; Macs have a single memory node anyway.
+        fApplied = false;
+#endif
+    }
+}
+
+bool AUValRenderMemory::Applied() const
+{
+#if defined(__linux__)
+    // madvise only makes the pages eligible; whether they're huge is up to the kernel.
+    if ( fPolicy == kRenderMemoryHugePages and fApplied )
+        return hugePageBytes( fData ) > 0;
+#endif
+    return fApplied;
+}
+
+AUValRenderMemory::~AUValRenderMemory()
+{
+    if ( fPolicy == kRenderMemoryHeap )
+        free( fData );
+    else
+        munmap( fMapping, fLength );
+}
+
+void PinThreadToCore( int core )
+{
+#ifdef __APPLE__
+    // tag 0 means "no affinity".
+    thread_affinity_policy_data_t policy = { core + 1 };
+    thread_policy_set( pthread_mach_thread_np( pthread_self() ), THREAD_AFFINITY_POLICY, (thread_policy_t)&policy, THREAD_AFFINITY_POLICY_COUNT );
+#else
+    cpu_set_t cores;
+    CPU_ZERO( &cores );
+    CPU_SET( core, &cores );
+    pthread_setaffinity_np( pthread_self(), sizeof( cores ), &cores );
+#endif
+}
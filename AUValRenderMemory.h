@@ -0,0 +1,80 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#ifndef _AUVAL_RENDERMEMORY_H_
+#define _AUVAL_RENDERMEMORY_H_
+/****************************************************************************
+
+	AUValRenderMemory
+
+	Where the host's render buffers come from, when many instances render
+	side by side on their own threads.
+
+		heap		allocated and cleared by whichever thread sets up the
+					test, the way most hosts do it
+		first_touch	mapped, but left untouched until the thread that
+					renders into them first writes them, so the OS puts
+					the pages near that thread's core
+		huge_pages	like first_touch, but on 2MB pages where the OS will
+					give them, to save TLB misses
+		interleave	mapped with its pages spread evenly across the memory
+					nodes, on machines with more than one (Linux only;
+					elsewhere it's the same as first_touch)
+
+	With any policy but heap, the RenderMemoryPolicies test also
+	initializes each instance on the thread that renders it, so the
+	plug-in's own buffers are first touched there too.
+
+****************************************************************************/
+
+#include <stddef.h>
+#include <string>
+
+enum RenderMemoryPolicy
+{
+    kRenderMemoryHeap,
+    kRenderMemoryFirstTouch,
+    kRenderMemoryHugePages,
+    kRenderMemoryInterleave,
+
+    kNumRenderMemoryPolicies
+};
+
+const char* RenderMemoryPolicyName( RenderMemoryPolicy policy );
+
+// takes the names above; false if it's none of them.
+bool ParseRenderMemoryPolicy( const std::string& name, RenderMemoryPolicy& policy );
+
+class AUValRenderMemory
+{
+public:
+    // throws std::bad_alloc if there isn't the memory.
+    AUValRenderMemory( size_t bytes, RenderMemoryPolicy policy );
+    ~AUValRenderMemory();
+
+    void* Data() const { return fData; }
+
+    // false if the OS didn't do what the policy asks for: huge pages it
+    // didn't give (on Linux, checked in /proc/self/smaps, so only meaningful
+    // once the memory has been touched), or interleaving with a single node.
+    bool Applied() const;
+
+private:
+    AUValRenderMemory( const AUValRenderMemory& );
+    AUValRenderMemory& operator=( const AUValRenderMemory& );
+
+    RenderMemoryPolicy fPolicy;
+    void* fData;
+    void* fMapping;
+    size_t fLength;
+    bool fApplied;
+};
+
+// keeps the calling thread on one core.  On the Mac this is only a hint:
+// threads with different tags are kept on cores that don't share a cache.
+void PinThreadToCore( int core );
+
+#endif // _AUVAL_RENDERMEMORY_H_
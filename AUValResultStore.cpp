@@ -0,0 +1,192 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "AUValResultStore.h"
+#include "BundleTracker.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <map>
+#include <stdio.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+using AudioUnits::ComponentKey;
+
+namespace
+{
+    // once the file has this many times more lines than results, it is rewritten.
+    const size_t kCompactionRatio = 4;
+
+    struct StoredResult
+    {
+        uint32_t version;
+        uint64_t fingerprint;
+        int status;
+    };
+
+    std::string gPath;
+    std::map<ComponentKey, StoredResult> gResults;
+
+    std::vector<ComponentKey> readBundleComponents( const std::string& bundlePath )
+    {
+        std::vector<ComponentKey> keys;
+        for ( const AudioComponentDescription& desc : AudioUnits::GetBundleComponents( bundlePath ) )
+            keys.push_back( ComponentKey( desc.componentType, desc.componentSubType, desc.componentManufacturer ) );
+        return keys;
+    }
+
+    AudioUnits::BundleTracker gBundles( readBundleComponents );
+
+    ComponentKey keyFor( const AudioComponentDescription& cd )
+    {
+        return ComponentKey( cd.componentType, cd.componentSubType, cd.componentManufacturer );
+    }
+
+    // a hang, a crash, a buffer overrun or a run that couldn't start may not happen
+    // again (or may be the machine's fault), so only the verdicts of complete runs are kept.
+    bool isStoredStatus( int status )
+    {
+        return status == kAUValStatusFailure or
+               status == kAUValStatusSuccessDoesNotRequireInit or
+               status == kAUValStatusSuccessRequiresInit;
+    }
+
+    std::string formatLine( const ComponentKey& key, const StoredResult& result )
+    {
+        char line[128];
+        snprintf( line, sizeof( line ), "%" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu64 " %d\n",
+                  key.type, key.subType, key.manufacturer, result.version, result.fingerprint, result.status );
+        return line;
+    }
+
+    // an exclusive lock on <path>.lock, held while the store is read, compacted or
+    // appended to.  The lock is on a file of its own because compacting renames a
+    // new file over the store; a validator waiting on the old one would go on to
+    // append to a file that is no longer there.
+    class StoreLock
+    {
+    public:
+        StoreLock() : mFD( open( ( gPath + ".lock" ).c_str(), O_RDWR | O_CREAT, 0644 ) )
+        {
+            if ( mFD >= 0 )
+                flock( mFD, LOCK_EX );
+        }
+        ~StoreLock()
+        {
+            if ( mFD >= 0 )
+                close( mFD );
+        }
+
+    private:
+        StoreLock( const StoreLock& );
+        StoreLock& operator=( const StoreLock& );
+
+        int mFD;
+    };
+
+    // must be called with the store locked.
+    void compact()
+    {
+        char suffix[32];
+        snprintf( suffix, sizeof( suffix ), ".%d.tmp", int( getpid() ) );
+        std::string tempPath = gPath + suffix;
+        FILE* file = fopen( tempPath.c_str(), "w" );
+        if ( not file )
+            return;
+
+        for ( const auto& entry : gResults )
+            fputs( formatLine( entry.first, entry.second ).c_str(), file );
+
+        if ( fclose( file ) == 0 )
+            rename( tempPath.c_str(), gPath.c_str() );
+        else
+            unlink( tempPath.c_str() );
+    }
+}
+
+bool OpenResultStore( const std::string& path )
+{
+    gPath = path;
+    gResults.clear();
+
+    {
+        StoreLock lock;
+        size_t lines = 0;
+        FILE* file = fopen( path.c_str(), "r" );
+        if ( file )
+        {
+            ComponentKey key;
+            StoredResult result;
+            while ( fscanf( file, "%" SCNu32 " %" SCNu32 " %" SCNu32 " %" SCNu32 " %" SCNu64 " %d",
+                            &key.type, &key.subType, &key.manufacturer, &result.version, &result.fingerprint, &result.status ) == 6 )
+            {
+                if ( isStoredStatus( result.status ) )
+                    gResults[key] = result;
+                ++lines;
+            }
+            fclose( file );
+        }
+
+        if ( lines > kCompactionRatio * gResults.size() )
+            compact();
+    }
+
+    std::string bundleStatePath = path + ".bundles";
+    gBundles.load( bundleStatePath );
+    AudioUnits::BundleChanges changes = gBundles.scan( AudioUnits::GetComponentDirectories() );
+    if ( not changes.empty() )
+    {
+        // results for changed bundles would be ignored anyway (the fingerprint won't match);
+        // dropping them just keeps the store from growing.
+        for ( const ComponentKey& key : changes.components )
+            gResults.erase( key );
+        return gBundles.save( bundleStatePath );
+    }
+    return true;
+}
+
+bool FindStoredResult( const AudioComponentDescription& cd, AUValStatus& status )
+{
+    ComponentKey key = keyFor( cd );
+    uint64_t fingerprint = gBundles.getFingerprint( key );
+    auto version = AudioUnits::GetComponentVersion( cd );
+    if ( fingerprint == 0 or not version.hasValue() )
+        return false;
+
+    auto iter = gResults.find( key );
+    if ( iter == gResults.end() or iter->second.fingerprint != fingerprint or iter->second.version != *version )
+        return false;
+
+    status = AUValStatus( iter->second.status );
+    return true;
+}
+
+void StoreResult( const AudioComponentDescription& cd, AUValStatus status )
+{
+    ComponentKey key = keyFor( cd );
+    auto version = AudioUnits::GetComponentVersion( cd );
+    if ( gPath.empty() or not isStoredStatus( status ) or not version.hasValue() )
+        return;
+
+    StoredResult result;
+    result.version = *version;
+    result.fingerprint = gBundles.getFingerprint( key );
+    result.status = status;
+    if ( result.fingerprint == 0 )
+        return;
+    gResults[key] = result;
+
+    // a single append, under the lock so it can't land in a file that's being compacted.
+    StoreLock lock;
+    int fd = open( gPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644 );
+    if ( fd < 0 )
+        return;
+    std::string line = formatLine( key, result );
+    ssize_t written = write( fd, line.data(), line.size() );
+    (void)written;
+    close( fd );
+}
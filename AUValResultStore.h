@@ -0,0 +1,45 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#ifndef _AUVAL_RESULTSTORE_H_
+#define _AUVAL_RESULTSTORE_H_
+/****************************************************************************
+
+	AUValResultStore
+
+	Remembers the result of validating each component, so a rescan
+	after installing one plug-in only has to validate what changed.
+
+	A result is tied to the version of the component and a fingerprint
+	of the bundle it came from (see BundleTracker).  Components whose
+	bundle can't be identified are never looked up, and only passes and
+	failures are stored: a crash or a hang is worth finding out about
+	again.  The store is only used by runs with the default settings
+	(see usesResultStore in main.cpp); a filtered run, or one with
+	extra checks turned on, neither reads it nor adds to it.
+
+	The store is a text file with a line per result,
+	"<type> <subtype> <manufacturer> <version> <fingerprint> <status>",
+	appended as each validation finishes; the last line for a component
+	wins.  The bundle state is kept next to it, in <path>.bundles, and
+	validators running side by side take turns with it through a lock
+	on <path>.lock.
+
+****************************************************************************/
+
+#include "AudioUnitUtils.h"
+#include "AUValStatus.h"
+#include <string>
+
+// loads the store, and brings the bundle state up to date with the plug-in directories.
+bool OpenResultStore( const std::string& path );
+
+// true if an earlier run validated this version of the component, from the same bundle.
+bool FindStoredResult( const AudioComponentDescription& cd, AUValStatus& status );
+
+void StoreResult( const AudioComponentDescription& cd, AUValStatus status );
+
+#endif // _AUVAL_RESULTSTORE_H_
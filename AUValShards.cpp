@@ -0,0 +1,206 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "AUValShards.h"
+#include "AUValChildProcess.h"
+#include "AUValCostHistory.h"
+#include "AUValOptions.h"
+#include "MemoryStats.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+extern bool gRequiresInit;
+
+namespace
+{
+    // leave some memory for everything else on the machine.
+    const double kUsableMemoryFraction = 0.75;
+    // even a tiny plug-in costs a process's worth of memory.
+    const uint64_t kMinFootprintBytes = 32 * 1024 * 1024;
+
+    // how much memory creating (and initializing) one instance takes, or 0 if it can't be made.
+    uint64_t measureInstanceFootprint( const AudioComponentDescription& cd )
+    {
+        uint64_t before = MemoryStats::ResidentBytes();
+        try
+        {
+            AudioUnits::Base probe( cd );
+            if ( gRequiresInit )
+                probe.Initialize();
+
+            uint64_t after = MemoryStats::ResidentBytes();
+
+            if ( gRequiresInit )
+                probe.Uninitialize();
+            return std::max( (after > before) ? after - before : 0, kMinFootprintBytes );
+        }
+        catch ( ... )
+        {
+            return 0;
+        }
+    }
+
+    // how bad a shard's exit status is; the worst one is the result of the whole run.
+    int statusSeverity( int status )
+    {
+        switch ( status )
+        {
+            case kAUValStatusSuccessDoesNotRequireInit:  return 0;
+            case kAUValStatusSuccessRequiresInit:        return 1;
+            case kAUValStatusFailure:                    return 2;
+            case kAUValStatusNotAuthorized:              return 3;
+            case kAUValStatusHung:                       return 5;
+            case kAUValStatusBufferOverrun:              return 6;
+            case kAUValStatusCrashed:                    return 7;
+            default:                                     return 4;
+        }
+    }
+
+    std::string shardPath( const std::string& path, int index )
+    {
+        char suffix[16];
+        snprintf( suffix, sizeof( suffix ), ".shard%d", index );
+        return path + suffix;
+    }
+
+    int makeOutputFile()
+    {
+        const char* tmpDir = getenv( "TMPDIR" );
+        std::string path = std::string( tmpDir ? tmpDir : "/tmp" ) + "/auexamine-shard-XXXXXX";
+        int fd = mkstemp( &path[0] );
+        if ( fd >= 0 )
+            unlink( path.c_str() );
+        return fd;
+    }
+
+    void copyOutput( int fd )
+    {
+        char buffer[4096];
+        lseek( fd, 0, SEEK_SET );
+        for ( ;; )
+        {
+            ssize_t bytes = read( fd, buffer, sizeof( buffer ) );
+            if ( bytes <= 0 )
+                break;
+            fwrite( buffer, 1, bytes, stdout );
+        }
+    }
+
+    struct Shard
+    {
+        Shard() : pid(-1), outputFd(-1), status(kAUValStatusCouldNotRun) {}
+        pid_t pid;
+        int outputFd;
+        int status;
+    };
+}
+
+int ChooseShardCount( const AudioComponentDescription& cd )
+{
+    const AUValOptions& options = GetAUValOptions();
+    if ( options.shards > 0 )
+        return options.shards;
+
+    // gtest hasn't applied the filter yet, so this counts every test.
+    int count = ::testing::UnitTest::GetInstance()->total_test_count();
+
+    long cores = sysconf( _SC_NPROCESSORS_ONLN );
+    if ( cores > 0 )
+        count = std::min( count, int(cores) );
+
+    if ( count > 1 )
+    {
+        uint64_t footprint = measureInstanceFootprint( cd );
+        uint64_t available = MemoryStats::AvailablePhysicalBytes();
+
+        // if the instance can't be made, an ordinary run will say why.
+        if ( footprint == 0 )
+            return 1;
+        if ( available > 0 )
+            count = std::min( count, int(available * kUsableMemoryFraction / footprint) );
+    }
+
+    return std::max( count, 1 );
+}
+
+AUValStatus RunShards( int shardCount )
+{
+    const AUValOptions& options = GetAUValOptions();
+
+    // each shard keeps its own checkpoint and cost history; the cost histories are merged afterwards.
+    CostHistory costHistory;
+    if ( not options.costHistory.empty() )
+        costHistory = LoadCostHistory( options.costHistory );
+
+    std::vector<Shard> shards( shardCount );
+    for ( int i = 0; i < shardCount; ++i )
+    {
+        std::vector<std::string> args = GetValidatorArguments( { "--auexamine_shards", "--auexamine_checkpoint", "--auexamine_cost_history", "--auexamine_result_store" } );
+        if ( not options.checkpoint.empty() )
+            args.push_back( "--auexamine_checkpoint=" + shardPath( options.checkpoint, i ) );
+        if ( not options.costHistory.empty() )
+        {
+            SaveCostHistory( shardPath( options.costHistory, i ), costHistory );
+            args.push_back( "--auexamine_cost_history=" + shardPath( options.costHistory, i ) );
+        }
+
+        std::vector<std::string> environment;
+        environment.push_back( "GTEST_TOTAL_SHARDS=" + std::to_string( shardCount ) );
+        environment.push_back( "GTEST_SHARD_INDEX=" + std::to_string( i ) );
+
+        shards[i].outputFd = makeOutputFile();
+        if ( shards[i].outputFd >= 0 )
+            shards[i].pid = SpawnValidator( args, environment, shards[i].outputFd );
+    }
+
+    int worst = kAUValStatusSuccessDoesNotRequireInit;
+    for ( int i = 0; i < shardCount; ++i )
+    {
+        Shard& shard = shards[i];
+        if ( shard.pid >= 0 )
+            shard.status = WaitForValidator( shard.pid );
+
+        printf( "[shard %d of %d]\n", i + 1, shardCount );
+        if ( shard.outputFd >= 0 )
+        {
+            copyOutput( shard.outputFd );
+            close( shard.outputFd );
+        }
+        else
+            printf( "!could not start shard\n" );
+
+        if ( statusSeverity( shard.status ) > statusSeverity( worst ) )
+            worst = shard.status;
+    }
+
+    for ( int i = 0; i < shardCount; ++i )
+        printf( "shard %d of %d exited with status %d\n", i + 1, shardCount, shards[i].status );
+    fflush( stdout );
+
+    if ( not options.costHistory.empty() )
+    {
+        // the shards ran different tests, so each one's changes can be taken as they are.
+        CostHistory merged = costHistory;
+        for ( int i = 0; i < shardCount; ++i )
+        {
+            std::string path = shardPath( options.costHistory, i );
+            for ( const auto& entry : LoadCostHistory( path ) )
+            {
+                auto old = costHistory.find( entry.first );
+                if ( old == costHistory.end() or old->second != entry.second )
+                    merged[entry.first] = entry.second;
+            }
+            unlink( path.c_str() );
+        }
+        SaveCostHistory( options.costHistory, merged );
+    }
+
+    return AUValStatus( worst );
+}
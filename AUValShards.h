@@ -0,0 +1,38 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#ifndef _AUVAL_SHARDS_H_
+#define _AUVAL_SHARDS_H_
+/****************************************************************************
+
+	AUValShards
+
+	Splits the tests for one plug-in across several copies of the
+	validator running side by side, each with its own instance.  The
+	copies use gtest's own sharding (GTEST_TOTAL_SHARDS and
+	GTEST_SHARD_INDEX) to pick their share of the tests; with the tiered
+	schedule, each copy takes its share of the schedule instead.
+
+	Each copy's output is collected and printed in shard order once
+	they have all finished, followed by a line per shard with its exit
+	status, and the statuses are merged into one.
+
+****************************************************************************/
+
+#include "AudioUnitUtils.h"
+#include "AUValStatus.h"
+
+// the number of copies to run for the shards option.  For "auto", that is
+// as many as there are cores, as many as fit in the available memory (from
+// the footprint of a trial instance), or as many as there are tests,
+// whichever is least.
+int ChooseShardCount( const AudioComponentDescription& cd );
+
+// runs the tests in shardCount copies of the validator, and returns the
+// worst of their exit statuses.
+AUValStatus RunShards( int shardCount );
+
+#endif // _AUVAL_SHARDS_H_
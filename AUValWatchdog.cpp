@@ -0,0 +1,123 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "AUValWatchdog.h"
+#include "AUValStatus.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace
+{
+    // the stuck thread is asked to dump its own stack with this signal.
+    const int kStackDumpSignal = SIGUSR2;
+    const int kMaxStackFrames = 128;
+
+    std::mutex gMutex;
+    std::condition_variable gCondition;
+    bool gStarted = false;
+
+    bool gArmed = false;
+    std::string gTestName;
+    double gBudget = 0;
+    pthread_t gTestThread;
+    std::chrono::steady_clock::time_point gDeadline;
+
+    volatile sig_atomic_t gStackDumped = 0;
+
+    extern "C" void dumpStackHandler( int )
+    {
+        void* frames[kMaxStackFrames];
+        int count = backtrace( frames, kMaxStackFrames );
+        backtrace_symbols_fd( frames, count, STDERR_FILENO );
+        gStackDumped = 1;
+    }
+
+    void reportHang( const std::string& testName, double budget, pthread_t thread )
+    {
+        fprintf( stderr, "watchdog: %s did not finish within %.1f seconds.  Stack of the stuck thread:\n", testName.c_str(), budget );
+        fflush( stderr );
+
+        struct sigaction action;
+        memset( &action, 0, sizeof( action ) );
+        action.sa_handler = dumpStackHandler;
+        sigemptyset( &action.sa_mask );
+        sigaction( kStackDumpSignal, &action, NULL );
+
+        if ( pthread_kill( thread, kStackDumpSignal ) == 0 )
+        {
+            // give the stuck thread a moment to write out its stack.
+            for ( int i = 0; i < 200 and not gStackDumped; ++i )
+                usleep( 10000 );
+        }
+
+        if ( not gStackDumped )
+            fprintf( stderr, "watchdog: could not capture the stack of the stuck thread.\n" );
+
+        printf( "!%s hung (no response after %.1f seconds)\n", testName.c_str(), budget );
+        fflush( stdout );
+        fflush( stderr );
+
+        // the plug-in still owns the stuck thread, so don't run any destructors.
+        _exit( kAUValStatusHung );
+    }
+
+    void watchdogThread()
+    {
+        std::unique_lock<std::mutex> lock( gMutex );
+        for ( ;; )
+        {
+            if ( gArmed and std::chrono::steady_clock::now() >= gDeadline )
+                reportHang( gTestName, gBudget, gTestThread );
+
+            if ( gArmed )
+                gCondition.wait_until( lock, gDeadline );
+            else
+                gCondition.wait( lock );
+        }
+    }
+}
+
+namespace AUValWatchdog
+{
+    void Start()
+    {
+        std::lock_guard<std::mutex> lock( gMutex );
+        if ( gStarted )
+            return;
+
+        gStarted = true;
+        std::thread( watchdogThread ).detach();
+    }
+
+    void Arm( const std::string& testName, double seconds )
+    {
+        std::lock_guard<std::mutex> lock( gMutex );
+        gArmed = (seconds > 0);
+        gTestName = testName;
+        gBudget = seconds;
+        gTestThread = pthread_self();
+        gDeadline = std::chrono::steady_clock::now() +
+                    std::chrono::duration_cast<std::chrono::steady_clock::duration>( std::chrono::duration<double>( seconds ) );
+        gCondition.notify_all();
+    }
+
+    void Disarm()
+    {
+        std::lock_guard<std::mutex> lock( gMutex );
+        gArmed = false;
+        gCondition.notify_all();
+    }
+}
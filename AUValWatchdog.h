@@ -0,0 +1,36 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#ifndef _AUVAL_WATCHDOG_H_
+#define _AUVAL_WATCHDOG_H_
+/****************************************************************************
+
+	AUValWatchdog
+
+	Enforces a time budget on each test.  Some plug-ins hang forever
+	(in render, for instance), which would otherwise stall the validator
+	until the host gives up and kills it.
+
+	When a budget runs out, the watchdog dumps the stack of the stuck
+	thread to stderr, reports the hang on stdout and exits with
+	kAUValStatusHung.
+
+****************************************************************************/
+
+#include <string>
+
+namespace AUValWatchdog
+{
+    // starts the watchdog thread.  Safe to call more than once.
+    void Start();
+
+    // starts timing a test that runs on the calling thread.
+    // A budget of zero or less means no limit.
+    void Arm( const std::string& testName, double seconds );
+    void Disarm();
+}
+
+#endif // _AUVAL_WATCHDOG_H_
@@ -11,11 +11,32 @@
 //	Description: Checks that plug-ins do not incorrectly mix new and delete with
 //    malloc/free.
 //
+//    Small blocks come from a size-class slab allocator.  Its arena is one
+//    reserved range of address space, split into a region per size class, so
+//    a block's class is known from its address and blocks need no header.
+//    Each thread keeps a cache of free blocks per class, and only takes a
+//    lock to move a batch of them to or from the class's central list.
+//
+//    Passing one of our blocks to free() still fails loudly, since malloc
+//    doesn't own the arena, and delete on a block from malloc is still
+//    recognized by its missing magic number.
+//
 ////////////////////////////////////////////////////////////////////////////////
 
+#include "FakeNew.h"
+#include <algorithm>
+#include <atomic>
 #include <new>
+#include <execinfo.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#ifdef __APPLE__
+	#include <malloc/malloc.h>
+#endif
 
 // If we're using microsoft's compiler, we export this from a
 // .def file to avoid compiler errors, hence we don't want to use
@@ -23,10 +44,12 @@
 #ifdef _MSC_VER
 	#undef EXPORT
 	#define EXPORT
+	#define NOINLINE __declspec(noinline)
 #endif
 
 #if (__GNUC__) || (__clang__)
 	#define EXPORT __attribute__((used, __visibility__("default")))
+	#define NOINLINE __attribute__((noinline))
 #endif
 
 
@@ -43,32 +66,1046 @@ namespace std {
 #define MAGIC_NUMERO	0xdeceaced
 #define HEADER_SIZE		16
 
-static void* doAllocate( std::size_t size )
+// a headered block's header: the magic number at 0, whether it came from
+// new[] at 4, and its size at 8, whatever the size of size_t.
+#define HEADER_KIND_OFFSET	4
+#define HEADER_SIZE_OFFSET	8
+#define HEADER_KIND(header)		(*((int32_t*)((char*)(header) + HEADER_KIND_OFFSET)))
+#define HEADER_BLOCK_SIZE(header)	(*((size_t*)((char*)(header) + HEADER_SIZE_OFFSET)))
+
+static_assert( HEADER_KIND_OFFSET >= sizeof( uint32_t ) and HEADER_SIZE_OFFSET >= HEADER_KIND_OFFSET + sizeof( int32_t ), "header fields overlap" );
+static_assert( HEADER_SIZE_OFFSET % sizeof( size_t ) == 0 and HEADER_SIZE_OFFSET + sizeof( size_t ) <= HEADER_SIZE, "header doesn't fit the size" );
+
+namespace
+{
+	const size_t kClassSizes[] =
+	{
+		16, 32, 48, 64, 80, 96, 112, 128,
+		160, 192, 224, 256, 320, 384, 448, 512,
+		640, 768, 896, 1024, 1280, 1536, 1792, 2048
+	};
+	const int kNumClasses = sizeof( kClassSizes ) / sizeof( kClassSizes[0] );
+	const size_t kMaxSmallSize = 2048;
+	const size_t kGranule = 16;
+
+	// address space only; pages are committed as blocks are first used.  The
+	// tests build with a small region, so they can run a class out of it.
+#ifdef FAKENEW_REGION_SIZE
+	const size_t kRegionSize = FAKENEW_REGION_SIZE;
+#else
+	const size_t kRegionSize = (sizeof( void* ) == 8) ? (size_t( 1 ) << 30) : (size_t( 4 ) << 20);
+#endif
+
+	// blocks moved between a thread's cache and the central list at a time.
+	const uint32_t kBatchSize = 32;
+
+	// a block on a free list.  The marker, its address scrambled, says it's
+	// already free, so deleting it again (with or without the diagnostics)
+	// leaves it alone instead of putting it on a list twice, which would
+	// later hand it to two owners at once.  Blocks are cleared of it as
+	// they're handed out.
+	struct FreeBlock
+	{
+		FreeBlock* next;
+		uintptr_t marker;
+	};
+
+	static_assert( sizeof( FreeBlock ) <= 16, "a free block doesn't fit the smallest class" );
+
+	const uintptr_t kFreedSalt = uintptr_t( 0x5a17f7eef7eed5a1ULL );
+
+	uintptr_t freedMarker( const FreeBlock* block )
+	{
+		return reinterpret_cast<uintptr_t>( block ) ^ kFreedSalt;
+	}
+
+	struct CentralList
+	{
+		pthread_mutex_t mutex;
+		FreeBlock* freeList;
+		size_t numFree;
+		char* unused;		// the rest of the region, never handed out yet
+		char* end;
+
+		// counts from threads that have exited.
+		uint64_t allocations;
+		uint64_t frees;
+	};
+
+	struct ThreadCache
+	{
+		FreeBlock* freeList[kNumClasses];
+		uint32_t numFree[kNumClasses];
+		uint64_t allocations[kNumClasses];
+		uint64_t frees[kNumClasses];
+
+		ThreadCache* prev;
+		ThreadCache* next;
+	};
+
+	char* gArena = NULL;
+	CentralList gCentral[kNumClasses];
+	uint8_t gClassOfGranules[kMaxSmallSize / kGranule + 1];
+
+	pthread_once_t gInitOnce = PTHREAD_ONCE_INIT;
+	pthread_key_t gCacheKey;
+
+	// every live thread cache, for the statistics.
+	pthread_mutex_t gCachesMutex = PTHREAD_MUTEX_INITIALIZER;
+	ThreadCache* gCaches = NULL;
+
+	// moves count blocks off the cache's list onto the central one.
+	void flushCache( ThreadCache* cache, int sizeClass, uint32_t count )
+	{
+		FreeBlock* first = cache->freeList[sizeClass];
+		if ( first == NULL or count == 0 )
+			return;
+
+		FreeBlock* last = first;
+		uint32_t moved = 1;
+		while ( moved < count and last->next )
+		{
+			last = last->next;
+			++moved;
+		}
+		cache->freeList[sizeClass] = last->next;
+		cache->numFree[sizeClass] -= moved;
+
+		CentralList& central = gCentral[sizeClass];
+		pthread_mutex_lock( &central.mutex );
+		last->next = central.freeList;
+		central.freeList = first;
+		central.numFree += moved;
+		pthread_mutex_unlock( &central.mutex );
+	}
+
+	// fills an empty cache list with up to a batch of blocks, reused ones first.
+	bool refillCache( ThreadCache* cache, int sizeClass )
+	{
+		CentralList& central = gCentral[sizeClass];
+		FreeBlock* list = NULL;
+		uint32_t count = 0;
+
+		pthread_mutex_lock( &central.mutex );
+		while ( count < kBatchSize and central.freeList )
+		{
+			FreeBlock* block = central.freeList;
+			central.freeList = block->next;
+			block->next = list;
+			list = block;
+			++count;
+		}
+		central.numFree -= count;
+
+		const size_t blockSize = kClassSizes[sizeClass];
+		while ( count < kBatchSize and central.unused + blockSize <= central.end )
+		{
+			FreeBlock* block = reinterpret_cast<FreeBlock*>( central.unused );
+			central.unused += blockSize;
+			block->next = list;
+			list = block;
+			++count;
+		}
+		pthread_mutex_unlock( &central.mutex );
+
+		cache->freeList[sizeClass] = list;
+		cache->numFree[sizeClass] = count;
+		return count > 0;
+	}
+
+	extern "C" void releaseCache( void* value )
+	{
+		ThreadCache* cache = static_cast<ThreadCache*>( value );
+		for ( int i = 0; i < kNumClasses; ++i )
+			flushCache( cache, i, cache->numFree[i] );
+
+		pthread_mutex_lock( &gCachesMutex );
+		for ( int i = 0; i < kNumClasses; ++i )
+		{
+			pthread_mutex_lock( &gCentral[i].mutex );
+			gCentral[i].allocations += cache->allocations[i];
+			gCentral[i].frees += cache->frees[i];
+			pthread_mutex_unlock( &gCentral[i].mutex );
+		}
+		if ( cache->prev )
+			cache->prev->next = cache->next;
+		else
+			gCaches = cache->next;
+		if ( cache->next )
+			cache->next->prev = cache->prev;
+		pthread_mutex_unlock( &gCachesMutex );
+
+		free( cache );
+	}
+
+	void initArena()
+	{
+		int sizeClass = 0;
+		for ( size_t granules = 0; granules <= kMaxSmallSize / kGranule; ++granules )
+		{
+			while ( kClassSizes[sizeClass] < granules * kGranule )
+				++sizeClass;
+			gClassOfGranules[granules] = uint8_t( sizeClass );
+		}
+
+		if ( pthread_key_create( &gCacheKey, releaseCache ) != 0 )
+			return;
+
+		int flags = MAP_PRIVATE | MAP_ANON;
+	#ifdef MAP_NORESERVE
+		flags |= MAP_NORESERVE;
+	#endif
+		void* arena = mmap( NULL, kRegionSize * kNumClasses, PROT_READ | PROT_WRITE, flags, -1, 0 );
+		if ( arena == MAP_FAILED )
+			return;
+
+		for ( int i = 0; i < kNumClasses; ++i )
+		{
+			CentralList& central = gCentral[i];
+			pthread_mutex_init( &central.mutex, NULL );
+			central.unused = static_cast<char*>( arena ) + i * kRegionSize;
+			central.end = central.unused + kRegionSize;
+		}
+		gArena = static_cast<char*>( arena );
+	}
+
+	ThreadCache* getCache()
+	{
+		ThreadCache* cache = static_cast<ThreadCache*>( pthread_getspecific( gCacheKey ) );
+		if ( cache )
+			return cache;
+
+		// from malloc, since operator new would come straight back here.
+		cache = static_cast<ThreadCache*>( calloc( 1, sizeof( ThreadCache ) ) );
+		if ( cache == NULL )
+			return NULL;
+		if ( pthread_setspecific( gCacheKey, cache ) != 0 )
+		{
+			free( cache );
+			return NULL;
+		}
+
+		pthread_mutex_lock( &gCachesMutex );
+		cache->next = gCaches;
+		if ( gCaches )
+			gCaches->prev = cache;
+		gCaches = cache;
+		pthread_mutex_unlock( &gCachesMutex );
+		return cache;
+	}
+
+	bool inArena( void* mem )
+	{
+		return gArena and static_cast<char*>( mem ) >= gArena and static_cast<char*>( mem ) < gArena + kRegionSize * kNumClasses;
+	}
+
+	// NULL if the block has to come from malloc instead.
+	void* allocateSmall( std::size_t size )
+	{
+		pthread_once( &gInitOnce, initArena );
+		if ( gArena == NULL )
+			return NULL;
+
+		ThreadCache* cache = getCache();
+		if ( cache == NULL )
+			return NULL;
+
+		int sizeClass = gClassOfGranules[(size + kGranule - 1) / kGranule];
+		if ( cache->freeList[sizeClass] == NULL and not refillCache( cache, sizeClass ) )
+			return NULL;
+
+		FreeBlock* block = cache->freeList[sizeClass];
+		cache->freeList[sizeClass] = block->next;
+		block->marker = 0;
+		--cache->numFree[sizeClass];
+		++cache->allocations[sizeClass];
+		return block;
+	}
+
+	// false if the block was already free, and so was left alone.
+	bool deallocateSmall( void* mem )
+	{
+		int sizeClass = int( (static_cast<char*>( mem ) - gArena) / kRegionSize );
+		FreeBlock* block = static_cast<FreeBlock*>( mem );
+		if ( block->marker == freedMarker( block ) )
+			return false;
+		block->marker = freedMarker( block );
+
+		ThreadCache* cache = getCache();
+		if ( cache == NULL )
+		{
+			CentralList& central = gCentral[sizeClass];
+			pthread_mutex_lock( &central.mutex );
+			block->next = central.freeList;
+			central.freeList = block;
+			++central.numFree;
+			++central.frees;
+			pthread_mutex_unlock( &central.mutex );
+			return true;
+		}
+
+		block->next = cache->freeList[sizeClass];
+		cache->freeList[sizeClass] = block;
+		++cache->numFree[sizeClass];
+		++cache->frees[sizeClass];
+
+		// keep a thread that only frees (a consumer) from hoarding blocks.
+		if ( cache->numFree[sizeClass] > 2 * kBatchSize )
+			flushCache( cache, sizeClass, kBatchSize );
+		return true;
+	}
+}
+
+namespace
+{
+	struct PhaseCounters
+	{
+		std::atomic<uint64_t> allocations;
+		std::atomic<uint64_t> frees;
+		std::atomic<uint64_t> bytesAllocated;
+		std::atomic<uint64_t> bytesFreed;
+		std::atomic<int64_t> peakLiveBytes;
+		std::atomic<int64_t> liveBytesOnEntry;
+		std::atomic<uint64_t> histogram[kFakeNewHistogramBuckets];
+	};
+
+	std::atomic<bool> gProfiling( false );
+	std::atomic<int> gPhase( 0 );
+	std::atomic<int64_t> gLiveBytes( 0 );
+	PhaseCounters gPhases[kFakeNewMaxPhases];
+
+	int histogramBucket( size_t size )
+	{
+		int bucket = 0;
+		for ( size_t limit = 16; bucket < kFakeNewHistogramBuckets - 1 and size > limit; limit <<= 1 )
+			++bucket;
+		return bucket;
+	}
+
+	void profileAllocation( size_t size )
+	{
+		PhaseCounters& phase = gPhases[gPhase.load( std::memory_order_relaxed )];
+		phase.allocations.fetch_add( 1, std::memory_order_relaxed );
+		phase.bytesAllocated.fetch_add( size, std::memory_order_relaxed );
+		phase.histogram[histogramBucket( size )].fetch_add( 1, std::memory_order_relaxed );
+
+		int64_t live = gLiveBytes.fetch_add( int64_t( size ), std::memory_order_relaxed ) + int64_t( size );
+		live -= phase.liveBytesOnEntry.load( std::memory_order_relaxed );
+		int64_t peak = phase.peakLiveBytes.load( std::memory_order_relaxed );
+		while ( live > peak and not phase.peakLiveBytes.compare_exchange_weak( peak, live, std::memory_order_relaxed ) )
+			;
+	}
+
+	void profileFree( size_t size )
+	{
+		PhaseCounters& phase = gPhases[gPhase.load( std::memory_order_relaxed )];
+		phase.frees.fetch_add( 1, std::memory_order_relaxed );
+		phase.bytesFreed.fetch_add( size, std::memory_order_relaxed );
+		gLiveBytes.fetch_sub( int64_t( size ), std::memory_order_relaxed );
+	}
+}
+
+void FakeNewEnableProfiling( bool enable )
+{
+	gProfiling = enable;
+}
+
+int FakeNewSetPhase( int phase )
+{
+	if ( phase < 0 or phase >= kFakeNewMaxPhases )
+		phase = 0;
+
+	gPhases[phase].liveBytesOnEntry = gLiveBytes.load();
+	return gPhase.exchange( phase );
+}
+
+void FakeNewGetPhaseStats( int phase, FakeNewPhaseStats& stats )
+{
+	const PhaseCounters& counters = gPhases[(phase < 0 or phase >= kFakeNewMaxPhases) ? 0 : phase];
+	stats.allocations = counters.allocations;
+	stats.frees = counters.frees;
+	stats.bytesAllocated = counters.bytesAllocated;
+	stats.bytesFreed = counters.bytesFreed;
+	stats.peakLiveBytes = counters.peakLiveBytes;
+	for ( int i = 0; i < kFakeNewHistogramBuckets; ++i )
+		stats.histogram[i] = counters.histogram[i];
+}
+
+void FakeNewResetPhaseStats()
 {
+	int64_t live = gLiveBytes.load();
+	for ( int i = 0; i < kFakeNewMaxPhases; ++i )
+	{
+		PhaseCounters& counters = gPhases[i];
+		counters.allocations = 0;
+		counters.frees = 0;
+		counters.bytesAllocated = 0;
+		counters.bytesFreed = 0;
+		counters.peakLiveBytes = 0;
+		counters.liveBytesOnEntry = live;
+		for ( int j = 0; j < kFakeNewHistogramBuckets; ++j )
+			counters.histogram[j] = 0;
+	}
+}
+
+int64_t FakeNewLiveBytes()
+{
+	return gLiveBytes.load();
+}
+
+namespace
+{
+	// open-addressed tables, allocated with calloc so that tracking never
+	// comes back into operator new.  If either fills up, new blocks go untracked.
+	const size_t kMaxSites = 16384;
+	const size_t kMaxTrackedBlocks = 1 << 20;
+
+	// a block's slot in the table once it's been freed, so later probes go past it.
+	void* const kFreedSlot = reinterpret_cast<void*>( 1 );
+
+	struct TrackedBlock
+	{
+		void* address;
+		uint32_t site;
+		uint32_t size;
+	};
+
+	std::atomic<bool> gTrackingSites( false );
+	pthread_mutex_t gSitesMutex = PTHREAD_MUTEX_INITIALIZER;
+	FakeNewSite* gSites = NULL;
+	TrackedBlock* gTrackedBlocks = NULL;
+
+	size_t hashPointer( const void* p )
+	{
+		uintptr_t x = reinterpret_cast<uintptr_t>( p );
+		x ^= x >> 17;
+		x *= uintptr_t( 0x9E3779B97F4A7C15ULL );
+		return size_t( x ^ (x >> 29) );
+	}
+
+	size_t findSite( void* const* frames, int numFrames )
+	{
+		size_t hash = size_t( numFrames );
+		for ( int i = 0; i < numFrames; ++i )
+			hash = hash * 31 + hashPointer( frames[i] );
+
+		for ( size_t probe = 0; probe < kMaxSites; ++probe )
+		{
+			size_t index = (hash + probe) % kMaxSites;
+			FakeNewSite& site = gSites[index];
+			if ( site.numFrames == 0 )
+			{
+				memcpy( site.frames, frames, numFrames * sizeof( void* ) );
+				site.numFrames = numFrames;
+				return index;
+			}
+			if ( site.numFrames == numFrames and memcmp( site.frames, frames, numFrames * sizeof( void* ) ) == 0 )
+				return index;
+		}
+		return kMaxSites;
+	}
+
+	NOINLINE void trackBlock( void* block, size_t size )
+	{
+		// skip this frame.  The next few are doAllocate and operator new,
+		// unless they were inlined.
+		void* frames[kFakeNewSiteFrames + 1];
+		int numFrames = backtrace( frames, kFakeNewSiteFrames + 1 ) - 1;
+		if ( numFrames <= 0 )
+			return;
+
+		pthread_mutex_lock( &gSitesMutex );
+		if ( gTrackedBlocks )
+		{
+			size_t site = findSite( frames + 1, numFrames );
+			if ( site < kMaxSites )
+			{
+				size_t hash = hashPointer( block );
+				for ( size_t probe = 0; probe < kMaxTrackedBlocks; ++probe )
+				{
+					TrackedBlock& slot = gTrackedBlocks[(hash + probe) % kMaxTrackedBlocks];
+					if ( slot.address == NULL or slot.address == kFreedSlot )
+					{
+						slot.address = block;
+						slot.site = uint32_t( site );
+						slot.size = uint32_t( std::min<size_t>( size, UINT32_MAX ) );
+						++gSites[site].liveBlocks;
+						gSites[site].liveBytes += slot.size;
+						break;
+					}
+				}
+			}
+		}
+		pthread_mutex_unlock( &gSitesMutex );
+	}
+
+	void untrackBlock( void* block )
+	{
+		pthread_mutex_lock( &gSitesMutex );
+		if ( gTrackedBlocks )
+		{
+			size_t hash = hashPointer( block );
+			for ( size_t probe = 0; probe < kMaxTrackedBlocks; ++probe )
+			{
+				TrackedBlock& slot = gTrackedBlocks[(hash + probe) % kMaxTrackedBlocks];
+				if ( slot.address == NULL )
+					break;
+				if ( slot.address == block )
+				{
+					--gSites[slot.site].liveBlocks;
+					gSites[slot.site].liveBytes -= slot.size;
+					slot.address = kFreedSlot;
+					break;
+				}
+			}
+		}
+		pthread_mutex_unlock( &gSitesMutex );
+	}
+
+	bool moreLiveBytes( const FakeNewSite& a, const FakeNewSite& b )
+	{
+		return a.liveBytes > b.liveBytes;
+	}
+}
+
+void FakeNewTrackSites( bool track )
+{
+	pthread_mutex_lock( &gSitesMutex );
+	if ( track )
+	{
+		if ( gSites == NULL )
+			gSites = static_cast<FakeNewSite*>( calloc( kMaxSites, sizeof( FakeNewSite ) ) );
+		if ( gTrackedBlocks == NULL )
+			gTrackedBlocks = static_cast<TrackedBlock*>( calloc( kMaxTrackedBlocks, sizeof( TrackedBlock ) ) );
+
+		if ( gSites and gTrackedBlocks )
+		{
+			memset( gSites, 0, kMaxSites * sizeof( FakeNewSite ) );
+			memset( gTrackedBlocks, 0, kMaxTrackedBlocks * sizeof( TrackedBlock ) );
+		}
+		else
+		{
+			free( gSites );
+			free( gTrackedBlocks );
+			gSites = NULL;
+			gTrackedBlocks = NULL;
+			track = false;
+		}
+	}
+	gTrackingSites = track;
+	pthread_mutex_unlock( &gSitesMutex );
+}
+
+int FakeNewTopSites( FakeNewSite* sites, int maxSites )
+{
+	pthread_mutex_lock( &gSitesMutex );
+	int count = 0;
+	for ( size_t i = 0; gSites and i < kMaxSites; ++i )
+	{
+		if ( gSites[i].liveBlocks == 0 )
+			continue;
+
+		// keep the best maxSites so far in a heap with the smallest on top.
+		if ( count < maxSites )
+		{
+			sites[count++] = gSites[i];
+			std::push_heap( sites, sites + count, moreLiveBytes );
+		}
+		else if ( maxSites > 0 and gSites[i].liveBytes > sites[0].liveBytes )
+		{
+			std::pop_heap( sites, sites + count, moreLiveBytes );
+			sites[count - 1] = gSites[i];
+			std::push_heap( sites, sites + count, moreLiveBytes );
+		}
+	}
+	pthread_mutex_unlock( &gSitesMutex );
+
+	std::sort_heap( sites, sites + count, moreLiveBytes );
+	return count;
+}
+
+namespace
+{
+	// how a small block was last handed out, one byte per block so that
+	// threads never share a byte.  Blocks handed out before diagnostics were
+	// turned on are unknown.
+	enum BlockState
+	{
+		kBlockUnknown,
+		kBlockScalar,
+		kBlockArray,
+		kBlockFreed
+	};
+
+	std::atomic<bool> gDiagnostics( false );
+	uint8_t* gBlockStates[kNumClasses];
+
+	// the same for large blocks, by address, so that deleting one twice is
+	// caught without reading a header malloc already has back.  A freed
+	// block keeps its entry until malloc hands out the address again.  The
+	// table is from calloc; if it fills up, new blocks go unchecked.
+	const size_t kMaxLargeBlocks = 1 << 18;
+
+	struct LargeBlock
+	{
+		void* address;
+		uint32_t state;
+	};
+
+	pthread_mutex_t gLargeBlocksMutex = PTHREAD_MUTEX_INITIALIZER;
+	LargeBlock* gLargeBlocks = NULL;
+	size_t gNumLargeBlocks = 0;
+
+	pthread_mutex_t gProblemsMutex = PTHREAD_MUTEX_INITIALIZER;
+	std::atomic<uint64_t> gProblemCount( 0 );
+	FakeNewProblem gProblems[kFakeNewMaxProblems];
+	char gContext[sizeof( gProblems[0].context )];
+
+	uint8_t* blockState( void* block )
+	{
+		size_t offset = static_cast<char*>( block ) - gArena;
+		size_t sizeClass = offset / kRegionSize;
+		return gBlockStates[sizeClass] + (offset % kRegionSize) / kClassSizes[sizeClass];
+	}
+
+	// NULL if the block has no entry.  With add, makes one if there's room.
+	LargeBlock* findLargeBlock( void* block, bool add )
+	{
+		size_t hash = hashPointer( block );
+		for ( size_t probe = 0; probe < kMaxLargeBlocks; ++probe )
+		{
+			LargeBlock& entry = gLargeBlocks[(hash + probe) % kMaxLargeBlocks];
+			if ( entry.address == block )
+				return &entry;
+			if ( entry.address == NULL )
+			{
+				if ( not add or gNumLargeBlocks >= kMaxLargeBlocks / 4 * 3 )
+					return NULL;
+				++gNumLargeBlocks;
+				entry.address = block;
+				return &entry;
+			}
+		}
+		return NULL;
+	}
+
+	void trackLargeBlock( void* block, bool array )
+	{
+		pthread_mutex_lock( &gLargeBlocksMutex );
+		LargeBlock* entry = findLargeBlock( block, true );
+		if ( entry )
+			entry->state = array ? kBlockArray : kBlockScalar;
+		pthread_mutex_unlock( &gLargeBlocksMutex );
+	}
+
+	// the stack starts inside FakeNew (or malloc, for free), with the caller
+	// below; how many frames that is depends on how the compiler inlined things.
+	NOINLINE void recordProblem( FakeNewProblemKind kind, void* address )
+	{
+		// skip this frame.
+		void* frames[kFakeNewProblemFrames + 1];
+		int numFrames = backtrace( frames, kFakeNewProblemFrames + 1 ) - 1;
+
+		pthread_mutex_lock( &gProblemsMutex );
+		uint64_t index = gProblemCount;
+		if ( index < kFakeNewMaxProblems )
+		{
+			FakeNewProblem& problem = gProblems[index];
+			problem.kind = kind;
+			problem.address = address;
+			problem.numFrames = std::max( numFrames, 0 );
+			memcpy( problem.frames, frames + 1, problem.numFrames * sizeof( void* ) );
+			memcpy( problem.context, gContext, sizeof( gContext ) );
+		}
+		gProblemCount = index + 1;
+		pthread_mutex_unlock( &gProblemsMutex );
+	}
+
+#ifdef __APPLE__
+	// a malloc zone that owns the arena, so free() and realloc() on one of our
+	// blocks come to us instead of failing in malloc.
+
+	malloc_zone_t gArenaZone;
+	malloc_introspection_t gArenaIntrospection;
+
+	size_t zoneSize( malloc_zone_t*, const void* ptr )
+	{
+		void* block = const_cast<void*>( ptr );
+		if ( not inArena( block ) )
+			return 0;
+
+		size_t offset = static_cast<char*>( block ) - gArena;
+		size_t blockSize = kClassSizes[offset / kRegionSize];
+		return ((offset % kRegionSize) % blockSize == 0) ? blockSize : 0;
+	}
+
+	void* zoneNoAllocation( malloc_zone_t*, size_t )
+	{
+		return NULL;
+	}
+
+	void* zoneNoCalloc( malloc_zone_t*, size_t, size_t )
+	{
+		return NULL;
+	}
+
+	void* zoneNoMemalign( malloc_zone_t*, size_t, size_t )
+	{
+		return NULL;
+	}
+
+	void zoneFree( malloc_zone_t*, void* ptr )
+	{
+		recordProblem( kFakeNewFreeOfNew, ptr );
+		if ( gBlockStates[0] )
+			*blockState( ptr ) = kBlockFreed;
+		deallocateSmall( ptr );
+	}
+
+	void zoneFreeDefiniteSize( malloc_zone_t* zone, void* ptr, size_t )
+	{
+		zoneFree( zone, ptr );
+	}
+
+	void* zoneRealloc( malloc_zone_t*, void* ptr, size_t size )
+	{
+		recordProblem( kFakeNewFreeOfNew, ptr );
+
+		void* moved = malloc( size );
+		if ( moved )
+		{
+			size_t offset = static_cast<char*>( ptr ) - gArena;
+			memcpy( moved, ptr, std::min( size, kClassSizes[offset / kRegionSize] ) );
+			if ( gBlockStates[0] )
+				*blockState( ptr ) = kBlockFreed;
+			deallocateSmall( ptr );
+		}
+		return moved;
+	}
+
+	void zoneDestroy( malloc_zone_t* )
+	{
+	}
+
+	kern_return_t zoneEnumerator( task_t, void*, unsigned, vm_address_t, memory_reader_t, vm_range_recorder_t )
+	{
+		return KERN_SUCCESS;
+	}
+
+	size_t zoneGoodSize( malloc_zone_t*, size_t size )
+	{
+		return size;
+	}
+
+	boolean_t zoneCheck( malloc_zone_t* )
+	{
+		return true;
+	}
+
+	void zonePrint( malloc_zone_t*, boolean_t )
+	{
+	}
+
+	void zoneLog( malloc_zone_t*, void* )
+	{
+	}
+
+	void zoneLock( malloc_zone_t* )
+	{
+	}
+
+	void zoneStatistics( malloc_zone_t*, malloc_statistics_t* stats )
+	{
+		memset( stats, 0, sizeof( *stats ) );
+	}
+
+	boolean_t zoneLocked( malloc_zone_t* )
+	{
+		return false;
+	}
+
+	void registerArenaZone()
+	{
+		gArenaIntrospection.enumerator = zoneEnumerator;
+		gArenaIntrospection.good_size = zoneGoodSize;
+		gArenaIntrospection.check = zoneCheck;
+		gArenaIntrospection.print = zonePrint;
+		gArenaIntrospection.log = zoneLog;
+		gArenaIntrospection.force_lock = zoneLock;
+		gArenaIntrospection.force_unlock = zoneLock;
+		gArenaIntrospection.statistics = zoneStatistics;
+		gArenaIntrospection.zone_locked = zoneLocked;
+
+		gArenaZone.size = zoneSize;
+		gArenaZone.malloc = zoneNoAllocation;
+		gArenaZone.calloc = zoneNoCalloc;
+		gArenaZone.valloc = zoneNoAllocation;
+		gArenaZone.free = zoneFree;
+		gArenaZone.realloc = zoneRealloc;
+		gArenaZone.destroy = zoneDestroy;
+		gArenaZone.zone_name = "FakeNew";
+		gArenaZone.introspect = &gArenaIntrospection;
+		gArenaZone.version = 6;
+		gArenaZone.memalign = zoneNoMemalign;
+		gArenaZone.free_definite_size = zoneFreeDefiniteSize;
+
+		malloc_zone_register( &gArenaZone );
+	}
+#endif
+
+	// false if the block mustn't be deallocated (it already was).
+	bool checkSmallDelete( void* mem, bool array )
+	{
+		if ( gBlockStates[0] == NULL )
+			return true;
+
+		uint8_t* state = blockState( mem );
+		if ( *state == kBlockFreed )
+		{
+			recordProblem( kFakeNewDoubleFree, mem );
+			return false;
+		}
+		if ( *state != kBlockUnknown and (*state == kBlockArray) != array )
+			recordProblem( kFakeNewArrayMismatch, mem );
+
+		*state = kBlockFreed;
+		return true;
+	}
+
+	// false if the block mustn't be deallocated (it already was).
+	bool checkLargeDelete( char* header, bool array )
+	{
+		void* mem = header + HEADER_SIZE;
+
+		pthread_mutex_lock( &gLargeBlocksMutex );
+		LargeBlock* entry = gLargeBlocks ? findLargeBlock( mem, false ) : NULL;
+		uint32_t state = entry ? entry->state : uint32_t( kBlockUnknown );
+		if ( entry )
+			entry->state = kBlockFreed;
+		pthread_mutex_unlock( &gLargeBlocksMutex );
+
+		if ( state == kBlockFreed )
+		{
+			recordProblem( kFakeNewDoubleFree, mem );
+			return false;
+		}
+		if ( state != kBlockUnknown )
+		{
+			if ( (state == kBlockArray) != array )
+				recordProblem( kFakeNewArrayMismatch, mem );
+			return true;
+		}
+
+		// from before diagnostics were on, or from malloc: only the header can say.
+		if ( *((uint32_t*)header) != MAGIC_NUMERO )
+		{
+			recordProblem( kFakeNewDeleteOfMalloc, mem );
+			return true;
+		}
+		if ( (HEADER_KIND( header ) != 0) != array )
+			recordProblem( kFakeNewArrayMismatch, mem );
+		return true;
+	}
+}
+
+void FakeNewEnableDiagnostics( bool enable )
+{
+	pthread_once( &gInitOnce, initArena );
+	if ( enable and gArena and gBlockStates[0] == NULL )
+	{
+		size_t total = 0;
+		for ( int i = 0; i < kNumClasses; ++i )
+			total += kRegionSize / kClassSizes[i];
+
+		int flags = MAP_PRIVATE | MAP_ANON;
+	#ifdef MAP_NORESERVE
+		flags |= MAP_NORESERVE;
+	#endif
+		void* states = mmap( NULL, total, PROT_READ | PROT_WRITE, flags, -1, 0 );
+		if ( states != MAP_FAILED )
+		{
+			uint8_t* next = static_cast<uint8_t*>( states );
+			for ( int i = 0; i < kNumClasses; ++i )
+			{
+				gBlockStates[i] = next;
+				next += kRegionSize / kClassSizes[i];
+			}
+		}
+
+	#ifdef __APPLE__
+		registerArenaZone();
+	#endif
+	}
+	if ( enable and gLargeBlocks == NULL )
+	{
+		pthread_mutex_lock( &gLargeBlocksMutex );
+		gLargeBlocks = static_cast<LargeBlock*>( calloc( kMaxLargeBlocks, sizeof( LargeBlock ) ) );
+		pthread_mutex_unlock( &gLargeBlocksMutex );
+	}
+	gDiagnostics = enable;
+}
+
+void FakeNewSetContext( const char* context )
+{
+	pthread_mutex_lock( &gProblemsMutex );
+	strncpy( gContext, context ? context : "", sizeof( gContext ) - 1 );
+	gContext[sizeof( gContext ) - 1] = 0;
+	pthread_mutex_unlock( &gProblemsMutex );
+}
+
+uint64_t FakeNewProblemCount()
+{
+	return gProblemCount.load();
+}
+
+bool FakeNewGetProblem( uint64_t index, FakeNewProblem& problem )
+{
+	pthread_mutex_lock( &gProblemsMutex );
+	bool kept = index < gProblemCount and index < kFakeNewMaxProblems;
+	if ( kept )
+		problem = gProblems[index];
+	pthread_mutex_unlock( &gProblemsMutex );
+	return kept;
+}
+
+const char* FakeNewProblemDescription( FakeNewProblemKind kind )
+{
+	switch ( kind )
+	{
+		case kFakeNewDeleteOfMalloc:	return "delete on memory from malloc";
+		case kFakeNewFreeOfNew:			return "free on memory from new";
+		case kFakeNewArrayMismatch:		return "delete and delete[] mixed up";
+		case kFakeNewDoubleFree:		return "memory deleted twice";
+	}
+	return "unknown allocation problem";
+}
+
+int GetFakeNewStats( FakeNewClassStats* stats, int maxClasses )
+{
+	pthread_once( &gInitOnce, initArena );
+
+	for ( int i = 0; i < kNumClasses and i < maxClasses; ++i )
+	{
+		FakeNewClassStats& s = stats[i];
+		s.blockSize = kClassSizes[i];
+		s.allocations = s.frees = 0;
+		s.blocksCapacity = kRegionSize / kClassSizes[i];
+		s.blocksReserved = s.blocksFree = 0;
+	}
+
+	if ( gArena == NULL )
+		return kNumClasses;
+
+	// the other threads' counts are read as they go, so they're only a snapshot.
+	pthread_mutex_lock( &gCachesMutex );
+	for ( ThreadCache* cache = gCaches; cache; cache = cache->next )
+	{
+		for ( int i = 0; i < kNumClasses and i < maxClasses; ++i )
+		{
+			stats[i].allocations += cache->allocations[i];
+			stats[i].frees += cache->frees[i];
+			stats[i].blocksFree += cache->numFree[i];
+		}
+	}
+	for ( int i = 0; i < kNumClasses and i < maxClasses; ++i )
+	{
+		CentralList& central = gCentral[i];
+		pthread_mutex_lock( &central.mutex );
+		stats[i].allocations += central.allocations;
+		stats[i].frees += central.frees;
+		stats[i].blocksFree += central.numFree;
+		stats[i].blocksReserved = (central.unused - (gArena + i * kRegionSize)) / kClassSizes[i];
+		pthread_mutex_unlock( &central.mutex );
+	}
+	pthread_mutex_unlock( &gCachesMutex );
+
+	return kNumClasses;
+}
+
+static void* doAllocate( std::size_t size, bool array )
+{
+	if ( size <= kMaxSmallSize )
+	{
+		void* block = allocateSmall( size );
+		if ( block )
+		{
+			if ( gProfiling.load( std::memory_order_relaxed ) )
+				profileAllocation( kClassSizes[gClassOfGranules[(size + kGranule - 1) / kGranule]] );
+			if ( gTrackingSites.load( std::memory_order_relaxed ) )
+				trackBlock( block, size );
+			if ( gDiagnostics.load( std::memory_order_relaxed ) and gBlockStates[0] )
+				*blockState( block ) = array ? kBlockArray : kBlockScalar;
+			return block;
+		}
+	}
+
 	char* ret = reinterpret_cast<char*>(malloc( size + HEADER_SIZE ));
 	if ( ret )
 	{
+		// whether it's an array and its size go in the header too, for the
+		// diagnostics and the profiler.
 		*((int32_t*)ret) = MAGIC_NUMERO;
+		HEADER_KIND( ret ) = array;
+		HEADER_BLOCK_SIZE( ret ) = size;
 		ret += HEADER_SIZE;
+
+		if ( gDiagnostics.load( std::memory_order_relaxed ) and gLargeBlocks )
+			trackLargeBlock( ret, array );
+
+		if ( gProfiling.load( std::memory_order_relaxed ) )
+			profileAllocation( size );
+		if ( gTrackingSites.load( std::memory_order_relaxed ) )
+			trackBlock( ret, size );
 	}
 	return ret;
 }
 
-static void doDeallocate( void* mem )
+static void doDeallocate( void* mem, bool array )
 {
 	if ( mem )
 	{
+		bool diagnostics = gDiagnostics.load( std::memory_order_relaxed );
+		bool small = inArena( mem );
 		char* test = reinterpret_cast<char*>(mem) - HEADER_SIZE;
-		if ( *((int32_t*)test) == MAGIC_NUMERO )
+		if ( diagnostics and not (small ? checkSmallDelete( mem, array ) : checkLargeDelete( test, array )) )
+			return;
+
+		bool profiling = gProfiling.load( std::memory_order_relaxed );
+		if ( gTrackingSites.load( std::memory_order_relaxed ) )
+			untrackBlock( mem );
+		if ( small )
+		{
+			if ( deallocateSmall( mem ) and profiling )
+				profileFree( kClassSizes[(static_cast<char*>( mem ) - gArena) / kRegionSize] );
+			return;
+		}
+
+		if ( *((uint32_t*)test) == MAGIC_NUMERO )
+		{
+			if ( profiling )
+				profileFree( HEADER_BLOCK_SIZE( test ) );
 			free( test );
+		}
 		else
+		{
+			if ( profiling )
+				profileFree( 0 );
 			free( mem );
+		}
 	}
 }
 
-EXPORT void *operator new(std::size_t size) throw(std::bad_alloc)
+// a dynamic exception specification is deprecated from C++11 on, where
+// operator new is declared without one.
+#if __cplusplus >= 201103L
+	#define THROWS_BAD_ALLOC
+#else
+	#define THROWS_BAD_ALLOC throw(std::bad_alloc)
+#endif
+
+EXPORT void *operator new(std::size_t size) THROWS_BAD_ALLOC
 {
-	void* result = doAllocate(size);
+	void* result = doAllocate(size, false);
 
 	if (result == NULL)
 		throw std::bad_alloc();
@@ -78,12 +1115,12 @@ EXPORT void *operator new(std::size_t size) throw(std::bad_alloc)
 
 EXPORT void *operator new(std::size_t size, const std::nothrow_t&) throw()
 {
-	return doAllocate(size);
+	return doAllocate(size, false);
 }
 
-EXPORT void *operator new[](std::size_t size) throw(std::bad_alloc)
+EXPORT void *operator new[](std::size_t size) THROWS_BAD_ALLOC
 {
-	void* result = doAllocate(size);
+	void* result = doAllocate(size, true);
 
 	if (result == NULL)
 		throw std::bad_alloc();
@@ -93,25 +1130,25 @@ EXPORT void *operator new[](std::size_t size) throw(std::bad_alloc)
 
 EXPORT void *operator new[](std::size_t size, const std::nothrow_t&) throw()
 {
-	return doAllocate(size);
+	return doAllocate(size, true);
 }
 
 EXPORT void operator delete(void *address) throw()
 {
-	doDeallocate( address );
+	doDeallocate( address, false );
 }
 
 EXPORT void operator delete[](void *address) throw()
 {
-	doDeallocate( address );
+	doDeallocate( address, true );
 }
 
 EXPORT void operator delete(void *address, const std::nothrow_t&) throw()
 {
-	doDeallocate( address );
+	doDeallocate( address, false );
 }
 
 EXPORT void operator delete[](void *address, const std::nothrow_t&) throw()
 {
-	doDeallocate( address );
+	doDeallocate( address, true );
 }
@@ -0,0 +1,122 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#ifndef _FAKENEW_H_
+#define _FAKENEW_H_
+/****************************************************************************
+
+	FakeNew
+
+	Statistics from the allocator behind operator new (see FakeNew.cpp).
+	Small blocks are handed out by size class; larger ones go to malloc.
+
+****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct FakeNewClassStats
+{
+	size_t blockSize;
+	uint64_t allocations;
+	uint64_t frees;
+	size_t blocksCapacity;		// blocks the class's region has room for; past that, they come from malloc
+	size_t blocksReserved;		// blocks carved out of the class's region so far
+	size_t blocksFree;			// of those, the ones waiting to be reused
+};
+
+// fills in up to maxClasses entries, smallest class first, and returns how many
+// size classes there are.
+int GetFakeNewStats( FakeNewClassStats* stats, int maxClasses );
+
+// allocation profiling.  While it's on, each operator new and delete, on any
+// thread, is charged to the current phase.  What the phases mean is up to the
+// caller; phase 0 is where everything starts.
+const int kFakeNewMaxPhases = 8;
+
+// block sizes by power of two: up to 16 bytes, up to 32, ... the last bucket
+// has everything over 256K.
+const int kFakeNewHistogramBuckets = 16;
+
+struct FakeNewPhaseStats
+{
+	uint64_t allocations;
+	uint64_t frees;
+	uint64_t bytesAllocated;
+	uint64_t bytesFreed;		// blocks from malloc passed to delete aren't counted
+	int64_t peakLiveBytes;		// the most allocated but not freed, counting from entering the phase
+	uint64_t histogram[kFakeNewHistogramBuckets];
+};
+
+void FakeNewEnableProfiling( bool enable );
+
+// returns the phase that was current.
+int FakeNewSetPhase( int phase );
+
+void FakeNewGetPhaseStats( int phase, FakeNewPhaseStats& stats );
+void FakeNewResetPhaseStats();
+
+// bytes allocated and not yet freed since profiling was turned on.
+int64_t FakeNewLiveBytes();
+
+// allocation sites.  While tracking is on (which is slow), each block
+// remembers the call stack that allocated it, until it's freed.  Turning
+// tracking on forgets whatever was tracked before.
+const int kFakeNewSiteFrames = 12;
+
+struct FakeNewSite
+{
+	void* frames[kFakeNewSiteFrames];
+	int numFrames;
+	uint64_t liveBlocks;
+	uint64_t liveBytes;
+};
+
+void FakeNewTrackSites( bool track );
+
+// fills in up to maxSites sites, the ones with the most live bytes first,
+// and returns how many it filled in.
+int FakeNewTopSites( FakeNewSite* sites, int maxSites );
+
+// allocation diagnostics.  Normally a block passed to the wrong deallocator
+// is quietly dealt with.  While diagnostics are on, each of these problems
+// is recorded, with the call stack and the context it happened in.
+enum FakeNewProblemKind
+{
+	kFakeNewDeleteOfMalloc,		// delete on a block from malloc
+	kFakeNewFreeOfNew,			// free or realloc on a block from new (Mac only)
+	kFakeNewArrayMismatch,		// delete on a block from new[], or delete[] on one from new
+	kFakeNewDoubleFree			// delete on a block that was already deleted
+};
+
+const int kFakeNewProblemFrames = 16;
+const int kFakeNewMaxProblems = 64;
+
+struct FakeNewProblem
+{
+	FakeNewProblemKind kind;
+	void* address;
+	void* frames[kFakeNewProblemFrames];
+	int numFrames;
+	char context[128];
+};
+
+// only blocks allocated while diagnostics are on can be checked for
+// array mismatches and double frees.
+void FakeNewEnableDiagnostics( bool enable );
+
+// labels the problems found from here on (with the name of the running test, say).
+void FakeNewSetContext( const char* context );
+
+// the number of problems found so far.  Only the first kFakeNewMaxProblems are kept.
+uint64_t FakeNewProblemCount();
+
+// copies out a problem, counting from 0; false if it wasn't kept.
+bool FakeNewGetProblem( uint64_t index, FakeNewProblem& problem );
+
+const char* FakeNewProblemDescription( FakeNewProblemKind kind );
+
+#endif // _FAKENEW_H_
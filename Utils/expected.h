@@ -0,0 +1,51 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+#ifndef expected_h
+#define expected_h
+
+#include "optional.h"
+
+// the error half of an expected, so that an error can't be mistaken for a
+// value when the two have the same type (OSStatus and int32_t, say).
+template<typename e>
+struct unexpected_value
+{
+	explicit unexpected_value(const e& o) : error(o) {}
+	e error;
+};
+
+template<typename e>
+unexpected_value<e> make_unexpected(const e& error)
+{
+	return unexpected_value<e>(error);
+}
+
+// either a value, or the error that kept there from being one.  This lets a
+// call report a failure without throwing; like optional, the value is kept in place.
+template<typename t, typename e>
+struct expected
+{
+public:
+	expected(const t& o) : m(o), fError() {}
+	expected(t&& o) : m(std::move(o)), fError() {}
+	template<typename u>
+	expected(const unexpected_value<u>& o) : fError(o.error) {}
+
+	bool hasValue() const {return m.hasValue();}
+	const e& error() const {assert(not m.hasValue()); return fError;}
+
+	const t& valueOr(const t& fallback) const {return m.valueOr(fallback);}
+
+	t& operator*() {return *m;}
+	const t& operator*() const {return *m;}
+	t* operator->() {return m.operator->();}
+	const t* operator->() const {return m.operator->();}
+private:
+	optional<t> m;
+	e fError;
+};
+
+#endif
@@ -6,50 +6,124 @@
 #ifndef optional_h
 #define optional_h
 
-#include <memory>
+#include <assert.h>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
 
-// this loosely emulates the api of boost/optional with a unique_ptr.
-// unlike boost/optional, it requires an extra heap allocation.
+namespace optional_detail
+{
+	// the value is kept inside the optional, so nothing is allocated.
+	template<typename t, bool trivial = std::is_trivially_copyable<t>::value>
+	struct storage
+	{
+		storage() : has(false) {}
+		storage(const storage& o) : has(false) { if(o.has) construct(o.get()); }
+		storage(storage&& o) : has(false) { if(o.has) construct(std::move(o.get())); }
+		~storage() { reset(); }
+
+		storage& operator= (const storage& o)
+		{
+			if(o.has)
+				assign(o.get());
+			else
+				reset();
+			return *this;
+		}
+		storage& operator= (storage&& o)
+		{
+			if(o.has)
+				assign(std::move(o.get()));
+			else
+				reset();
+			return *this;
+		}
+
+		template<typename u> void assign(u&& o)
+		{
+			if(has)
+				get() = std::forward<u>(o);
+			else
+				construct(std::forward<u>(o));
+		}
+		template<typename u> void construct(u&& o)
+		{
+			new (&buffer) t(std::forward<u>(o));
+			has = true;
+		}
+		void reset()
+		{
+			if(has)
+			{
+				get().~t();
+				has = false;
+			}
+		}
+
+		t& get() {return *reinterpret_cast<t*>(&buffer);}
+		const t& get() const {return *reinterpret_cast<const t*>(&buffer);}
+
+		typename std::aligned_storage<sizeof(t), alignof(t)>::type buffer;
+		bool has;
+	};
+
+	// trivially copyable values need no bookkeeping, and leave the optional
+	// itself trivially copyable, so it can be copied around like the value.
+	template<typename t>
+	struct storage<t, true>
+	{
+		storage() : has(false) {}
+
+		template<typename u> void assign(u&& o) {construct(std::forward<u>(o));}
+		template<typename u> void construct(u&& o)
+		{
+			new (&buffer) t(std::forward<u>(o));
+			has = true;
+		}
+		void reset() {has = false;}
+
+		t& get() {return *reinterpret_cast<t*>(&buffer);}
+		const t& get() const {return *reinterpret_cast<const t*>(&buffer);}
+
+		typename std::aligned_storage<sizeof(t), alignof(t)>::type buffer;
+		bool has;
+	};
+}
+
+// this loosely emulates the api of boost/optional.  Like boost/optional,
+// the value is stored in place rather than on the heap.
 template<typename t>
 struct optional
 {
 public:
 	optional() {}
-	optional(const t& o) : m(new t(o)) {}
-	optional(const optional<t>& o)
-	{
-		if(o.m) m.reset(new t(*o.m.get()));
-	}
-	optional(optional<t>&& o) : m(std::move(o.m)) {}
+	optional(const t& o) {m.construct(o);}
+	optional(t&& o) {m.construct(std::move(o));}
 	optional(std::nullptr_t) {}
 
+	// copying and moving are left to the storage, so that they stay trivial
+	// for trivially copyable values.
+
 	const optional<t>& operator= (const t& o)
 	{
-		m.reset(new t(o));
+		m.assign(o);
 		return *this;
 	}
-	const optional<t>& operator= (const optional<t>& o)
+	const optional<t>& operator= (t&& o)
 	{
-		if(o.m)
-			m.reset(new t(*o.m.get()));
-		else
-			m.reset();
-		return *this;
-	}
-	const optional<t>& operator= (optional<t>&& o)
-	{
-		m = std::move(o.m);
+		m.assign(std::move(o));
 		return *this;
 	}
 	const optional<t>& operator=(std::nullptr_t)
 	{
 		m.reset();
-        return *this;
+		return *this;
 	}
 
 	bool operator< (const optional<t>& o) const
 	{
-		if(m and o.hasValue())
+		if(m.has and o.hasValue())
 			return *(*this) < *o;
 		if(o.hasValue())
 			return true;
@@ -59,14 +133,17 @@ public:
 	// if visual studio support this, wouldn't it be awesome!?!
 	// explicit operator bool() const {return m;}
 
-    // explicit cast is a workaround for clang bug....
-	bool hasValue() const {return static_cast<bool>(m);}
+	bool hasValue() const {return m.has;}
+	void reset() {m.reset();}
+
+	const t& valueOr(const t& fallback) const {return m.has ? m.get() : fallback;}
 
-	const t& operator*() const {assert(m); return *m.get();}
-	t* operator->() {assert(m); return m.get();}
-	const t* operator->() const {assert(m); return m.get();}
+	t& operator*() {assert(m.has); return m.get();}
+	const t& operator*() const {assert(m.has); return m.get();}
+	t* operator->() {assert(m.has); return &m.get();}
+	const t* operator->() const {assert(m.has); return &m.get();}
 private:
-	std::unique_ptr<t> m;
+	optional_detail::storage<t> m;
 };
 
-#endif
\ No newline at end of file
+#endif
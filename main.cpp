@@ -6,7 +6,13 @@
 
 #include "AUTortureTest.h"
 #include "gtest/gtest.h"
+#include "AUValChildProcess.h"
 #include "AUValExcptList.h"
+#include "FakeNew.h"
+#include "AUValOptions.h"
+#include "AUValResultStore.h"
+#include "AUValShards.h"
+#include "ComponentRegistry.h"
 
 #include <stdio.h>
 #include <pthread.h>
@@ -57,13 +63,78 @@ int successRet()
            ? kAUValStatusSuccessRequiresInit
            : kAUValStatusSuccessDoesNotRequireInit;
 }
+void printErrorStats()
+{
+    std::vector<AudioUnits::AudioUnitErrorStats> stats = AudioUnits::GetAudioUnitErrorStats();
+    for ( const AudioUnits::AudioUnitErrorStats& s : stats )
+        printf("%s (line %d): %u thrown, %u probed, last error %d\n", s.where.name, s.where.line, s.thrown, s.probed, int(s.lastError));
+}
+
+void printAllocatorStats()
+{
+    FakeNewClassStats stats[64];
+    int numClasses = GetFakeNewStats(stats, 64);
+    for ( int i = 0; i < numClasses and i < 64; ++i )
+    {
+        if ( stats[i].allocations == 0 )
+            continue;
+        printf("%zu byte blocks: %llu allocated, %llu freed, %zu reserved, %zu free\n", stats[i].blockSize,
+               (unsigned long long)stats[i].allocations, (unsigned long long)stats[i].frees, stats[i].blocksReserved, stats[i].blocksFree);
+    }
+}
+
+// a stored result stands in for a full run with the default settings, so
+// only such runs can use one, or leave one behind.  A filter, fail_fast or a
+// resumed checkpoint runs part of the tests; extra_tests, alloc_diagnostics
+// and guard_buffers can fail a plug-in that passes without them; and a plug-in
+// validated as not requiring initialization may be reported differently.
+bool usesResultStore( bool requiresInit )
+{
+    const AUValOptions& options = GetAUValOptions();
+    if ( options.resultStore.empty() )
+        return false;
+    return requiresInit and
+           ::testing::GTEST_FLAG(filter) == "*" and
+           not ::testing::GTEST_FLAG(also_run_disabled_tests) and
+           not options.failFast and
+           options.checkpoint.empty() and
+           options.extraTests.empty() and
+           options.allocDiagnostics == AUValOptions::kAllocDiagnosticsOff and
+           not options.guardBuffers;
+}
+
+AUValStatus runValidation( const AudioComponentDescription& cd )
+{
+    int shardCount = ChooseShardCount(cd);
+    if ( shardCount > 1 )
+        return RunShards(shardCount);
+
+    AudioUnits::SetupTest(cd);
+    if(not AudioUnits::IsAuthorized())
+        return kAUValStatusNotAuthorized;
+
+    AUValStatus failureStatus;
+    bool success = AudioUnits::RunTests(failureStatus);
+    if(not success)
+        return failureStatus;
+
+    return AUValStatus(successRet());
+}
 }
 
 int main( int argc, char** argv)
 {
-    // we want to shuffle the order of the tests
+    // kept so a test can be re-run in a fresh copy of the validator.
+    SetValidatorCommandLine(argc, argv);
+
+    // we want to shuffle the order of the tests (unless the options ask for a tiered schedule)
     testing::GTEST_FLAG(shuffle) = true;
 
+    // this removes our own options.  It has to come before InitGoogleTest,
+    // since some of them decide how many times each test is instantiated.
+    if ( not ParseAUValOptions(argc, argv) )
+        return kAUValStatusCouldNotRun;
+
     // this removes any google test options
     ::testing::InitGoogleTest(&argc, argv);
 
@@ -108,6 +179,9 @@ int main( int argc, char** argv)
 		}
 	}
 
+    if ( not GetAUValOptions().catalog.empty() )
+        AudioUnits::ComponentRegistry::Get().UseCatalog(GetAUValOptions().catalog);
+
 	optional<AudioUnits::UTF8ComponentInfo> info = AudioUnits::GetUTF8ComponentInfo(cd);
     if (not info.hasValue())
     {
@@ -115,6 +189,9 @@ int main( int argc, char** argv)
         return kAUValStatusNotFound;
     }
 
+    if ( not GetAUValOptions().exceptionList.empty() )
+        LoadExceptionList(GetAUValOptions().exceptionList);
+
     bool masDuplicate = false;
     if ( IsBlackListed( cd, info->name, masDuplicate) )
     {
@@ -126,13 +203,27 @@ int main( int argc, char** argv)
     if ( IsWhiteListed( cd ) )
         return successRet();
 
-    AudioUnits::SetupTest(cd);
-    if(not AudioUnits::IsAuthorized())
-        return kAUValStatusNotAuthorized;
+    // gRequiresInit is updated as the tests run; this is what was asked for.
+    bool resultStore = usesResultStore(gRequiresInit);
+    if ( resultStore )
+    {
+        OpenResultStore(GetAUValOptions().resultStore);
+
+        AUValStatus stored;
+        if ( FindStoredResult(cd, stored) )
+        {
+            printf("unchanged since it was last validated\n");
+            return stored;
+        }
+    }
 
-    bool success = (RUN_ALL_TESTS() == 0);
-    if(not success)
-        return kAUValStatusFailure;
+    AUValStatus status = runValidation(cd);
+    if ( GetAUValOptions().errorStats )
+        printErrorStats();
+    if ( GetAUValOptions().allocatorStats )
+        printAllocatorStats();
+    if ( resultStore )
+        StoreResult(cd, status);
 
-    return successRet();
+    return status;
 }
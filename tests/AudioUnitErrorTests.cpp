@@ -0,0 +1,79 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "AudioUnitError.h"
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+using namespace AudioUnits;
+
+namespace
+{
+    const AudioUnitErrorStats* findStats( const std::vector<AudioUnitErrorStats>& stats, const char* name )
+    {
+        for ( size_t i = 0; i < stats.size(); ++i )
+        {
+            if ( strcmp( stats[i].where.name, name ) == 0 )
+                return &stats[i];
+        }
+        return NULL;
+    }
+}
+
+TEST( AudioUnitError, NoErrorDoesNothing )
+{
+    DCL_AU_FUNC(NoErrorDoesNothing)
+    bool negOne = true;
+    FailAudioUnitError( 0, AU_DESC, &negOne );
+    EXPECT_FALSE( negOne );
+    EXPECT_TRUE( CheckAudioUnitError( 0, AU_DESC ) );
+    EXPECT_TRUE( findStats( GetAudioUnitErrorStats(), "NoErrorDoesNothing" ) == NULL );
+}
+
+TEST( AudioUnitError, ThrowsCodeAndCallSite )
+{
+    DCL_AU_FUNC(ThrowsCodeAndCallSite)
+    bool negOne = false;
+    int line = __LINE__ + 3;
+    try
+    {
+        FailAudioUnitError( -1, AU_DESC, &negOne );
+        FAIL() << "didn't throw";
+    }
+    catch ( const AudioUnitError& error )
+    {
+        EXPECT_EQ( -1, error.code() );
+        EXPECT_STREQ( "ThrowsCodeAndCallSite", error.where().name );
+        EXPECT_EQ( line, error.where().line );
+
+        char expected[64];
+        snprintf( expected, sizeof( expected ), "Failure: ThrowsCodeAndCallSite %d -1", line );
+        EXPECT_STREQ( expected, error.what() );
+    }
+    EXPECT_TRUE( negOne );
+}
+
+TEST( AudioUnitError, CountsThrownAndProbedApart )
+{
+    DCL_AU_FUNC(CountsThrownAndProbedApart)
+    for ( int i = 0; i < 3; ++i )
+        EXPECT_FALSE( CheckAudioUnitError( -10879, AU_DESC ) );
+    EXPECT_THROW( FailAudioUnitError( -10867, AU_DESC ), AudioUnitError );
+
+    std::vector<AudioUnitErrorStats> stats = GetAudioUnitErrorStats();
+    int probed = 0, thrown = 0;
+    for ( size_t i = 0; i < stats.size(); ++i )
+    {
+        if ( strcmp( stats[i].where.name, "CountsThrownAndProbedApart" ) == 0 )
+        {
+            probed += stats[i].probed;
+            thrown += stats[i].thrown;
+        }
+    }
+    EXPECT_EQ( 3, probed );
+    EXPECT_EQ( 1, thrown );
+}
@@ -0,0 +1,295 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "BundleTracker.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace AudioUnits;
+
+namespace
+{
+    const uint32_t kEffect = 0x61756678;        // 'aufx'
+
+    class BundleTrackerTest : public ::testing::Test
+    {
+    protected:
+        BundleTrackerTest() : fReads(0) {}
+
+        virtual void SetUp()
+        {
+            const char* tmp = getenv( "TMPDIR" );
+            std::string pattern = std::string( tmp ? tmp : "/tmp" ) + "/bundles.XXXXXX";
+            std::vector<char> buffer( pattern.begin(), pattern.end() );
+            buffer.push_back( 0 );
+            ASSERT_TRUE( mkdtemp( buffer.data() ) != NULL );
+
+            fDirectory = buffer.data();
+            fStatePath = fDirectory + "/state";
+            fPlugIns = fDirectory + "/Components";
+            ASSERT_EQ( 0, mkdir( fPlugIns.c_str(), 0755 ) );
+        }
+
+        virtual void TearDown()
+        {
+            for ( size_t i = 0; i < fCreated.size(); ++i )
+                unlink( fCreated[i].c_str() );
+            for ( size_t i = fCreatedDirectories.size(); i-- > 0; )
+                rmdir( fCreatedDirectories[i].c_str() );
+            unlink( fStatePath.c_str() );
+            rmdir( fPlugIns.c_str() );
+            rmdir( fDirectory.c_str() );
+        }
+
+        // stands in for opening the bundle: its Info.plist here is just a subtype per line.
+        BundleTracker::ComponentReader reader()
+        {
+            return [this]( const std::string& bundlePath )
+            {
+                ++fReads;
+                std::vector<ComponentKey> components;
+                FILE* file = fopen( (bundlePath + "/Contents/Info.plist").c_str(), "r" );
+                if ( file )
+                {
+                    unsigned subType;
+                    while ( fscanf( file, "%u", &subType ) == 1 )
+                        components.push_back( ComponentKey( kEffect, subType, 1 ) );
+                    fclose( file );
+                }
+                return components;
+            };
+        }
+
+        std::vector<std::string> directories() const
+        {
+            return std::vector<std::string>( 1, fPlugIns );
+        }
+
+        // returns the bundle's path.
+        std::string makeBundle( const std::string& name, const std::string& plist )
+        {
+            std::string bundle = fPlugIns + "/" + name;
+            std::string contents = bundle + "/Contents";
+            std::string executables = contents + "/MacOS";
+            fCreatedDirectories.push_back( bundle );
+            fCreatedDirectories.push_back( contents );
+            fCreatedDirectories.push_back( executables );
+            EXPECT_EQ( 0, mkdir( bundle.c_str(), 0755 ) );
+            EXPECT_EQ( 0, mkdir( contents.c_str(), 0755 ) );
+            EXPECT_EQ( 0, mkdir( executables.c_str(), 0755 ) );
+
+            fCreated.push_back( plistPath( bundle ) );
+            fCreated.push_back( executablePath( bundle ) );
+            writeText( plistPath( bundle ), plist, 1000000000 );
+            writeText( executablePath( bundle ), "code", 1000000000 );
+            return bundle;
+        }
+
+        static std::string plistPath( const std::string& bundle )
+        {
+            return bundle + "/Contents/Info.plist";
+        }
+
+        static std::string executablePath( const std::string& bundle )
+        {
+            return bundle + "/Contents/MacOS/Plugin";
+        }
+
+        // with the modification time set, so a change shows up however coarse the file system's clock is.
+        static void writeText( const std::string& path, const std::string& text, time_t when )
+        {
+            FILE* file = fopen( path.c_str(), "w" );
+            ASSERT_TRUE( file != NULL );
+            fputs( text.c_str(), file );
+            fclose( file );
+            setTime( path, when );
+        }
+
+        static void setTime( const std::string& path, time_t when )
+        {
+            struct timeval times[2] = { { when, 0 }, { when, 0 } };
+            ASSERT_EQ( 0, utimes( path.c_str(), times ) );
+        }
+
+        static bool contains( const std::vector<ComponentKey>& components, uint32_t subType )
+        {
+            return std::find_if( components.begin(), components.end(), [=]( const ComponentKey& key )
+                                 { return key.type == kEffect and key.subType == subType and key.manufacturer == 1; } ) != components.end();
+        }
+
+        std::string fDirectory;
+        std::string fStatePath;
+        std::string fPlugIns;
+        std::vector<std::string> fCreated;
+        std::vector<std::string> fCreatedDirectories;
+        int fReads;
+    };
+}
+
+TEST_F( BundleTrackerTest, FirstScanAddsEveryBundle )
+{
+    std::string eq = makeBundle( "EQ.component", "1\n2\n" );
+    std::string synth = makeBundle( "My Synth.component", "3\n" );
+    // not a bundle, though it looks like one inside.
+    makeBundle( "Notes.txt", "4\n" );
+
+    BundleTracker tracker( reader() );
+    BundleChanges changes = tracker.scan( directories() );
+
+    ASSERT_EQ( 2u, changes.added.size() );
+    EXPECT_EQ( eq, changes.added[0] );
+    EXPECT_EQ( synth, changes.added[1] );
+    EXPECT_TRUE( changes.removed.empty() );
+    EXPECT_TRUE( changes.modified.empty() );
+    EXPECT_EQ( 3u, changes.components.size() );
+    EXPECT_TRUE( contains( changes.components, 1 ) and contains( changes.components, 2 ) and contains( changes.components, 3 ) );
+    EXPECT_EQ( 2, fReads );
+
+    EXPECT_NE( 0u, tracker.getFingerprint( ComponentKey( kEffect, 1, 1 ) ) );
+    EXPECT_EQ( tracker.getFingerprint( ComponentKey( kEffect, 1, 1 ) ), tracker.getFingerprint( ComponentKey( kEffect, 2, 1 ) ) );
+    EXPECT_NE( tracker.getFingerprint( ComponentKey( kEffect, 1, 1 ) ), tracker.getFingerprint( ComponentKey( kEffect, 3, 1 ) ) );
+    EXPECT_EQ( 0u, tracker.getFingerprint( ComponentKey( kEffect, 4, 1 ) ) );
+}
+
+TEST_F( BundleTrackerTest, RescanWithoutChangesIsEmpty )
+{
+    makeBundle( "EQ.component", "1\n" );
+
+    BundleTracker tracker( reader() );
+    tracker.scan( directories() );
+    BundleChanges changes = tracker.scan( directories() );
+
+    EXPECT_TRUE( changes.empty() );
+    EXPECT_TRUE( changes.components.empty() );
+    EXPECT_EQ( 1, fReads );
+}
+
+TEST_F( BundleTrackerTest, FindsRemovedBundle )
+{
+    makeBundle( "EQ.component", "1\n" );
+    std::string synth = makeBundle( "Synth.component", "3\n" );
+
+    BundleTracker tracker( reader() );
+    tracker.scan( directories() );
+
+    unlink( plistPath( synth ).c_str() );
+    unlink( executablePath( synth ).c_str() );
+    rmdir( (synth + "/Contents/MacOS").c_str() );
+    rmdir( (synth + "/Contents").c_str() );
+    ASSERT_EQ( 0, rmdir( synth.c_str() ) );
+
+    BundleChanges changes = tracker.scan( directories() );
+    ASSERT_EQ( 1u, changes.removed.size() );
+    EXPECT_EQ( synth, changes.removed[0] );
+    EXPECT_TRUE( changes.added.empty() );
+    EXPECT_TRUE( changes.modified.empty() );
+    ASSERT_EQ( 1u, changes.components.size() );
+    EXPECT_TRUE( contains( changes.components, 3 ) );
+
+    EXPECT_EQ( 0u, tracker.getFingerprint( ComponentKey( kEffect, 3, 1 ) ) );
+    EXPECT_NE( 0u, tracker.getFingerprint( ComponentKey( kEffect, 1, 1 ) ) );
+}
+
+TEST_F( BundleTrackerTest, FindsModifiedInfoPlist )
+{
+    std::string eq = makeBundle( "EQ.component", "1\n" );
+
+    BundleTracker tracker( reader() );
+    tracker.scan( directories() );
+    uint64_t before = tracker.getFingerprint( ComponentKey( kEffect, 1, 1 ) );
+
+    writeText( plistPath( eq ), "2\n", 1000000100 );
+    BundleChanges changes = tracker.scan( directories() );
+
+    ASSERT_EQ( 1u, changes.modified.size() );
+    EXPECT_EQ( eq, changes.modified[0] );
+    EXPECT_TRUE( changes.added.empty() );
+    EXPECT_TRUE( changes.removed.empty() );
+    // before and after.
+    EXPECT_TRUE( contains( changes.components, 1 ) and contains( changes.components, 2 ) );
+    EXPECT_EQ( 2, fReads );
+
+    EXPECT_EQ( 0u, tracker.getFingerprint( ComponentKey( kEffect, 1, 1 ) ) );
+    EXPECT_NE( 0u, tracker.getFingerprint( ComponentKey( kEffect, 2, 1 ) ) );
+    EXPECT_NE( before, tracker.getFingerprint( ComponentKey( kEffect, 2, 1 ) ) );
+}
+
+TEST_F( BundleTrackerTest, FindsModifiedExecutable )
+{
+    std::string eq = makeBundle( "EQ.component", "1\n" );
+
+    BundleTracker tracker( reader() );
+    tracker.scan( directories() );
+    uint64_t before = tracker.getFingerprint( ComponentKey( kEffect, 1, 1 ) );
+
+    writeText( executablePath( eq ), "new code", 1000000100 );
+    BundleChanges changes = tracker.scan( directories() );
+
+    ASSERT_EQ( 1u, changes.modified.size() );
+    EXPECT_EQ( eq, changes.modified[0] );
+    EXPECT_EQ( 2, fReads );
+    EXPECT_NE( before, tracker.getFingerprint( ComponentKey( kEffect, 1, 1 ) ) );
+}
+
+// an Info.plist rewritten with the same contents only moves its stamp.
+TEST_F( BundleTrackerTest, TouchedBundleIsNotModified )
+{
+    std::string eq = makeBundle( "EQ.component", "1\n" );
+
+    BundleTracker tracker( reader() );
+    tracker.scan( directories() );
+    uint64_t before = tracker.getFingerprint( ComponentKey( kEffect, 1, 1 ) );
+
+    setTime( plistPath( eq ), 1000000100 );
+    BundleChanges changes = tracker.scan( directories() );
+
+    EXPECT_TRUE( changes.empty() );
+    EXPECT_TRUE( changes.components.empty() );
+    EXPECT_EQ( 1, fReads );
+    EXPECT_EQ( before, tracker.getFingerprint( ComponentKey( kEffect, 1, 1 ) ) );
+}
+
+TEST_F( BundleTrackerTest, SaveAndLoadRoundTrip )
+{
+    makeBundle( "EQ.component", "1\n2\n" );
+    makeBundle( "My Synth.component", "3\n" );
+
+    BundleTracker first( reader() );
+    first.scan( directories() );
+    ASSERT_TRUE( first.save( fStatePath ) );
+
+    BundleTracker second( reader() );
+    second.load( fStatePath );
+    for ( uint32_t subType = 1; subType <= 3; ++subType )
+    {
+        EXPECT_NE( 0u, second.getFingerprint( ComponentKey( kEffect, subType, 1 ) ) ) << subType;
+        EXPECT_EQ( first.getFingerprint( ComponentKey( kEffect, subType, 1 ) ),
+                   second.getFingerprint( ComponentKey( kEffect, subType, 1 ) ) ) << subType;
+    }
+
+    // nothing has moved since the first tracker's scan, so nothing is read again.
+    BundleChanges changes = second.scan( directories() );
+    EXPECT_TRUE( changes.empty() );
+    EXPECT_EQ( 2, fReads );
+}
+
+TEST_F( BundleTrackerTest, MissingStateFileAddsEveryBundle )
+{
+    makeBundle( "EQ.component", "1\n" );
+
+    BundleTracker tracker( reader() );
+    tracker.load( fStatePath );
+    EXPECT_EQ( 0u, tracker.getFingerprint( ComponentKey( kEffect, 1, 1 ) ) );
+
+    BundleChanges changes = tracker.scan( directories() );
+    EXPECT_EQ( 1u, changes.added.size() );
+}
@@ -0,0 +1,308 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "ComponentCatalog.h"
+#include "gtest/gtest.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace AudioUnits;
+
+namespace
+{
+    const uint32_t kEffect = 0x61756678;        // 'aufx'
+    const uint32_t kMusicDevice = 0x61756d75;   // 'aumu'
+
+    class ComponentCatalogTest : public ::testing::Test
+    {
+    protected:
+        virtual void SetUp()
+        {
+            const char* tmp = getenv( "TMPDIR" );
+            std::string pattern = std::string( tmp ? tmp : "/tmp" ) + "/catalog.XXXXXX";
+            std::vector<char> buffer( pattern.begin(), pattern.end() );
+            buffer.push_back( 0 );
+            ASSERT_TRUE( mkdtemp( buffer.data() ) != NULL );
+
+            fDirectory = buffer.data();
+            fPath = fDirectory + "/catalog";
+            fPlugIns = fDirectory + "/Components";
+            ASSERT_EQ( 0, mkdir( fPlugIns.c_str(), 0755 ) );
+
+            // well in the past, so any change to the directory moves its time.
+            struct timeval times[2] = { { 1000000000, 0 }, { 1000000000, 0 } };
+            ASSERT_EQ( 0, utimes( fPlugIns.c_str(), times ) );
+        }
+
+        virtual void TearDown()
+        {
+            for ( size_t i = 0; i < fCreated.size(); ++i )
+                unlink( fCreated[i].c_str() );
+            for ( size_t i = fCreatedDirectories.size(); i-- > 0; )
+                rmdir( fCreatedDirectories[i].c_str() );
+            unlink( fPath.c_str() );
+            rmdir( (fDirectory + "/Later").c_str() );
+            rmdir( fPlugIns.c_str() );
+            rmdir( fDirectory.c_str() );
+        }
+
+        void writeCatalog()
+        {
+            ComponentCatalogWriter writer;
+            writer.addWatchedDirectory( fPlugIns );
+
+            std::string eq = "Parametric EQ";
+            std::string synth = "Synth";
+            uint32_t version = 0x00010200;
+            writer.addComponent( kMusicDevice, 1, 2, &synth, &version );
+            writer.addComponent( kEffect, 3, 4, &eq, &version );
+            writer.addComponent( kEffect, 5, 4, NULL, NULL );
+            writer.addComponent( kEffect, 3, 4, &synth, NULL );       // a duplicate; the first one wins
+            ASSERT_TRUE( writer.write( fPath ) );
+        }
+
+        // a bundle in the plug-in directory with an Info.plist, made before the catalog is written.
+        std::string makeBundle( const std::string& name, const std::string& plist )
+        {
+            std::string bundle = fPlugIns + "/" + name;
+            std::string contents = bundle + "/Contents";
+            fCreatedDirectories.push_back( bundle );
+            fCreatedDirectories.push_back( contents );
+            EXPECT_EQ( 0, mkdir( bundle.c_str(), 0755 ) );
+            EXPECT_EQ( 0, mkdir( contents.c_str(), 0755 ) );
+
+            std::string plistPath = contents + "/Info.plist";
+            fCreated.push_back( plistPath );
+            writeText( plistPath, plist );
+            return plistPath;
+        }
+
+        static void writeText( const std::string& path, const std::string& text )
+        {
+            FILE* file = fopen( path.c_str(), "w" );
+            ASSERT_TRUE( file != NULL );
+            fputs( text.c_str(), file );
+            fclose( file );
+        }
+
+        std::string readFile() const
+        {
+            std::string contents;
+            FILE* file = fopen( fPath.c_str(), "rb" );
+            if ( file )
+            {
+                char buffer[4096];
+                size_t count;
+                while ( (count = fread( buffer, 1, sizeof( buffer ), file )) > 0 )
+                    contents.append( buffer, count );
+                fclose( file );
+            }
+            return contents;
+        }
+
+        void writeFile( const std::string& contents ) const
+        {
+            FILE* file = fopen( fPath.c_str(), "wb" );
+            ASSERT_TRUE( file != NULL );
+            ASSERT_EQ( contents.size(), fwrite( contents.data(), 1, contents.size(), file ) );
+            fclose( file );
+        }
+
+        std::string fDirectory;
+        std::string fPath;
+        std::string fPlugIns;
+        std::vector<std::string> fCreated;
+        std::vector<std::string> fCreatedDirectories;
+    };
+}
+
+TEST_F( ComponentCatalogTest, RoundTrip )
+{
+    writeCatalog();
+
+    ComponentCatalog catalog;
+    ASSERT_TRUE( catalog.open( fPath ) );
+    ASSERT_EQ( 3u, catalog.size() );
+
+    // sorted by type, subtype, manufacturer.
+    EXPECT_EQ( kEffect, catalog[0].type );
+    EXPECT_EQ( 3u, catalog[0].subType );
+    EXPECT_EQ( kEffect, catalog[1].type );
+    EXPECT_EQ( 5u, catalog[1].subType );
+    EXPECT_EQ( kMusicDevice, catalog[2].type );
+
+    const CatalogEntry* eq = catalog.find( kEffect, 3, 4 );
+    ASSERT_TRUE( eq != NULL );
+    EXPECT_STREQ( "Parametric EQ", catalog.getName( *eq ) );
+    EXPECT_TRUE( eq->flags & CatalogEntry::kHasVersion );
+    EXPECT_EQ( 0x00010200u, eq->version );
+
+    const CatalogEntry* unnamed = catalog.find( kEffect, 5, 4 );
+    ASSERT_TRUE( unnamed != NULL );
+    EXPECT_TRUE( catalog.getName( *unnamed ) == NULL );
+    EXPECT_FALSE( unnamed->flags & CatalogEntry::kHasVersion );
+
+    const CatalogEntry* synth = catalog.find( kMusicDevice, 1, 2 );
+    ASSERT_TRUE( synth != NULL );
+    EXPECT_STREQ( "Synth", catalog.getName( *synth ) );
+
+    EXPECT_TRUE( catalog.find( kEffect, 3, 5 ) == NULL );
+    EXPECT_TRUE( catalog.isCurrent() );
+}
+
+TEST_F( ComponentCatalogTest, LeavesNoTemporaryFile )
+{
+    writeCatalog();
+
+    char suffix[32];
+    snprintf( suffix, sizeof( suffix ), ".%d.tmp", int( getpid() ) );
+    EXPECT_NE( 0, access( (fPath + suffix).c_str(), F_OK ) );
+}
+
+TEST_F( ComponentCatalogTest, RejectsMissingFile )
+{
+    ComponentCatalog catalog;
+    EXPECT_FALSE( catalog.open( fPath ) );
+    EXPECT_FALSE( catalog.isOpen() );
+    EXPECT_EQ( 0u, catalog.size() );
+    EXPECT_FALSE( catalog.isCurrent() );
+}
+
+TEST_F( ComponentCatalogTest, RejectsTruncatedFile )
+{
+    writeCatalog();
+    std::string contents = readFile();
+
+    const size_t lengths[] = { 0, sizeof( CatalogHeader ) - 1, sizeof( CatalogHeader ), contents.size() / 2, contents.size() - 1 };
+    for ( size_t i = 0; i < sizeof( lengths ) / sizeof( lengths[0] ); ++i )
+    {
+        writeFile( contents.substr( 0, lengths[i] ) );
+        ComponentCatalog catalog;
+        EXPECT_FALSE( catalog.open( fPath ) ) << "truncated to " << lengths[i] << " bytes";
+    }
+}
+
+TEST_F( ComponentCatalogTest, RejectsExtraBytes )
+{
+    writeCatalog();
+    writeFile( readFile() + '\0' );
+
+    ComponentCatalog catalog;
+    EXPECT_FALSE( catalog.open( fPath ) );
+}
+
+TEST_F( ComponentCatalogTest, RejectsCorruptHeader )
+{
+    writeCatalog();
+    const std::string contents = readFile();
+
+    // each of the header's fields in turn.
+    for ( size_t offset = 0; offset < sizeof( CatalogHeader ); offset += sizeof( uint32_t ) )
+    {
+        std::string corrupt = contents;
+        corrupt[offset] ^= 0x40;
+        writeFile( corrupt );
+
+        ComponentCatalog catalog;
+        EXPECT_FALSE( catalog.open( fPath ) ) << "header byte " << offset << " changed";
+    }
+}
+
+TEST_F( ComponentCatalogTest, RejectsUnterminatedStrings )
+{
+    writeCatalog();
+    std::string contents = readFile();
+    contents[contents.size() - 1] = 'x';
+    writeFile( contents );
+
+    ComponentCatalog catalog;
+    EXPECT_FALSE( catalog.open( fPath ) );
+}
+
+TEST_F( ComponentCatalogTest, NotCurrentAfterDirectoryChanges )
+{
+    writeCatalog();
+
+    ComponentCatalog catalog;
+    ASSERT_TRUE( catalog.open( fPath ) );
+    ASSERT_TRUE( catalog.isCurrent() );
+
+    std::string plugIn = fPlugIns + "/New.component";
+    fCreated.push_back( plugIn );
+    int fd = open( plugIn.c_str(), O_WRONLY | O_CREAT, 0644 );
+    ASSERT_GE( fd, 0 );
+    close( fd );
+
+    EXPECT_FALSE( catalog.isCurrent() );
+}
+
+TEST_F( ComponentCatalogTest, NotCurrentAfterMissingDirectoryAppears )
+{
+    std::string later = fDirectory + "/Later";
+
+    ComponentCatalogWriter writer;
+    writer.addWatchedDirectory( later );
+    ASSERT_TRUE( writer.write( fPath ) );
+
+    ComponentCatalog catalog;
+    ASSERT_TRUE( catalog.open( fPath ) );
+    EXPECT_TRUE( catalog.isCurrent() );
+
+    ASSERT_EQ( 0, mkdir( later.c_str(), 0755 ) );
+    EXPECT_FALSE( catalog.isCurrent() );
+}
+
+// updating a bundle in place doesn't move its directory's time; its Info.plist's does.
+TEST_F( ComponentCatalogTest, NotCurrentAfterBundleUpdatedInPlace )
+{
+    std::string plist = makeBundle( "EQ.component", "<plist>1.2.0</plist>" );
+    writeCatalog();
+
+    ComponentCatalog catalog;
+    ASSERT_TRUE( catalog.open( fPath ) );
+    ASSERT_TRUE( catalog.isCurrent() );
+
+    struct stat before;
+    ASSERT_EQ( 0, stat( fPlugIns.c_str(), &before ) );
+    writeText( plist, "<plist>1.3.0</plist>\n" );
+    struct stat after;
+    ASSERT_EQ( 0, stat( fPlugIns.c_str(), &after ) );
+    ASSERT_EQ( before.st_mtime, after.st_mtime );
+
+    EXPECT_FALSE( catalog.isCurrent() );
+}
+
+TEST_F( ComponentCatalogTest, NotCurrentAfterBundleLosesItsInfoPlist )
+{
+    std::string plist = makeBundle( "EQ.component", "<plist/>" );
+    writeCatalog();
+
+    ComponentCatalog catalog;
+    ASSERT_TRUE( catalog.open( fPath ) );
+    ASSERT_TRUE( catalog.isCurrent() );
+
+    ASSERT_EQ( 0, unlink( plist.c_str() ) );
+    EXPECT_FALSE( catalog.isCurrent() );
+}
+
+TEST_F( ComponentCatalogTest, OtherFilesInTheDirectoryAreNotBundles )
+{
+    makeBundle( "Notes.txt", "not a bundle" );
+    writeCatalog();
+
+    ComponentCatalog catalog;
+    ASSERT_TRUE( catalog.open( fPath ) );
+    ASSERT_TRUE( catalog.isCurrent() );
+
+    writeText( fPlugIns + "/Notes.txt/Contents/Info.plist", "changed, but not watched" );
+    EXPECT_TRUE( catalog.isCurrent() );
+}
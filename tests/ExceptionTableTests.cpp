@@ -0,0 +1,406 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "AUValExcptTable.h"
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace
+{
+    const int kNumRules = 8;
+
+    // a run is the first rule and the number of rules.
+    const size_t kRunSize = 2 * sizeof( uint32_t );
+
+    class ExceptionTableTest : public ::testing::Test
+    {
+    protected:
+        virtual void SetUp()
+        {
+            const char* tmp = getenv( "TMPDIR" );
+            std::string pattern = std::string( tmp ? tmp : "/tmp" ) + "/exceptions.XXXXXX";
+            std::vector<char> buffer( pattern.begin(), pattern.end() );
+            buffer.push_back( 0 );
+            ASSERT_TRUE( mkdtemp( buffer.data() ) != NULL );
+
+            fDirectory = buffer.data();
+            fPath = fDirectory + "/exceptions.txt";
+            fCachePath = fPath + ".cache";
+
+            // every other rule has a message.
+            std::string rules;
+            for ( int i = 0; i < kNumRules; ++i )
+            {
+                char line[128];
+                snprintf( line, sizeof( line ), "incompatible aufx %d 'Mfr ' * %s\n", 1000 + i, (i % 2) ? "" : message( i ).c_str() );
+                rules += line;
+                if ( i % 2 == 0 )
+                    fMessageBytes += message( i ).size() + 1;
+            }
+            writeFile( fPath, rules );
+        }
+
+        virtual void TearDown()
+        {
+            unlink( fCachePath.c_str() );
+            unlink( fPath.c_str() );
+            rmdir( fDirectory.c_str() );
+        }
+
+        static std::string message( int i )
+        {
+            char str[32];
+            snprintf( str, sizeof( str ), "rule %d", i );
+            return str;
+        }
+
+        static std::string readFile( const std::string& path )
+        {
+            std::string contents;
+            FILE* file = fopen( path.c_str(), "rb" );
+            if ( file )
+            {
+                char buffer[4096];
+                size_t count;
+                while ( (count = fread( buffer, 1, sizeof( buffer ), file )) > 0 )
+                    contents.append( buffer, count );
+                fclose( file );
+            }
+            return contents;
+        }
+
+        static void writeFile( const std::string& path, const std::string& contents )
+        {
+            FILE* file = fopen( path.c_str(), "wb" );
+            ASSERT_TRUE( file != NULL );
+            ASSERT_EQ( contents.size(), fwrite( contents.data(), 1, contents.size(), file ) );
+            fclose( file );
+        }
+
+        // the cache ends with the displacements and the runs (a slot each per component),
+        // the rules and the messages.  Each rule here is for a different component.
+        size_t displacementsOffset( const std::string& cache ) const
+        {
+            return runsOffset( cache ) - kNumRules * sizeof( int32_t );
+        }
+
+        size_t runsOffset( const std::string& cache ) const
+        {
+            return rulesOffset( cache ) - kNumRules * kRunSize;
+        }
+
+        size_t rulesOffset( const std::string& cache ) const
+        {
+            return cache.size() - fMessageBytes - kNumRules * sizeof( ExceptionRule );
+        }
+
+        void expectAllRules( const ExceptionTable& table ) const
+        {
+            for ( int i = 0; i < kNumRules; ++i )
+            {
+                const ExceptionRule* rule = table.find( 'aufx', 1000 + i, 'Mfr ', 1 );
+                ASSERT_TRUE( rule != NULL ) << "rule " << i;
+                EXPECT_EQ( uint32_t( kExceptionIncompatible ), rule->kind );
+
+                const char* text = table.getMessage( *rule );
+                if ( i % 2 )
+                    EXPECT_TRUE( text == NULL );
+                else
+                    EXPECT_STREQ( message( i ).c_str(), text );
+            }
+            EXPECT_TRUE( table.find( 'aufx', 1000 + kNumRules, 'Mfr ', 1 ) == NULL );
+        }
+
+        // replaces the fixture's data file.
+        bool loadText( const std::string& text, ExceptionTable& table, std::string& error )
+        {
+            unlink( fCachePath.c_str() );
+            writeFile( fPath, text );
+            return table.load( fPath, error );
+        }
+
+        std::string loadError( const std::string& text )
+        {
+            ExceptionTable table;
+            std::string error;
+            EXPECT_FALSE( loadText( text, table, error ) ) << text;
+            EXPECT_NE( 0, access( fCachePath.c_str(), F_OK ) ) << text;
+            return error;
+        }
+
+        // loads once to write the cache, corrupts it, and checks that the next
+        // load throws it away and parses the data file again.
+        void expectCorruptCacheReparsed( void (*corrupt)( std::string& cache, size_t displacements, size_t runs, size_t rules ) )
+        {
+            std::string error;
+            ExceptionTable first;
+            ASSERT_TRUE( first.load( fPath, error ) ) << error;
+            const std::string cache = readFile( fCachePath );
+            ASSERT_FALSE( cache.empty() );
+
+            std::string corrupted = cache;
+            corrupt( corrupted, displacementsOffset( cache ), runsOffset( cache ), rulesOffset( cache ) );
+            ASSERT_NE( cache, corrupted );
+            writeFile( fCachePath, corrupted );
+
+            ExceptionTable second;
+            ASSERT_TRUE( second.load( fPath, error ) ) << error;
+            expectAllRules( second );
+            EXPECT_EQ( cache, readFile( fCachePath ) );
+        }
+
+        std::string fDirectory;
+        std::string fPath;
+        std::string fCachePath;
+        size_t fMessageBytes = 0;
+    };
+
+    int32_t getInt32( const std::string& bytes, size_t offset )
+    {
+        int32_t value;
+        memcpy( &value, &bytes[offset], sizeof( value ) );
+        return value;
+    }
+
+    void setUInt32( std::string& bytes, size_t offset, uint32_t value )
+    {
+        memcpy( &bytes[offset], &value, sizeof( value ) );
+    }
+}
+
+TEST_F( ExceptionTableTest, LoadsFromCache )
+{
+    std::string error;
+    ExceptionTable parsed;
+    ASSERT_TRUE( parsed.load( fPath, error ) ) << error;
+    expectAllRules( parsed );
+    ASSERT_EQ( 0, access( fCachePath.c_str(), F_OK ) );
+
+    ExceptionTable cached;
+    ASSERT_TRUE( cached.load( fPath, error ) ) << error;
+    expectAllRules( cached );
+}
+
+TEST_F( ExceptionTableTest, RejectsSlotOutsideTable )
+{
+    expectCorruptCacheReparsed( []( std::string& cache, size_t displacements, size_t, size_t )
+    {
+        for ( int i = 0; i < kNumRules; ++i )
+        {
+            size_t offset = displacements + i * sizeof( int32_t );
+            if ( getInt32( cache, offset ) < 0 )
+                setUInt32( cache, offset, uint32_t( -(kNumRules + 1) ) );
+        }
+    } );
+}
+
+TEST_F( ExceptionTableTest, RejectsRunOutsideRules )
+{
+    expectCorruptCacheReparsed( []( std::string& cache, size_t, size_t runs, size_t )
+    {
+        setUInt32( cache, runs, kNumRules );
+    } );
+}
+
+TEST_F( ExceptionTableTest, RejectsEmptyRun )
+{
+    expectCorruptCacheReparsed( []( std::string& cache, size_t, size_t runs, size_t )
+    {
+        setUInt32( cache, runs + sizeof( uint32_t ), 0 );
+    } );
+}
+
+TEST_F( ExceptionTableTest, RejectsMessageOutsideMessages )
+{
+    expectCorruptCacheReparsed( []( std::string& cache, size_t, size_t, size_t rules )
+    {
+        setUInt32( cache, rules + offsetof( ExceptionRule, messageOffset ), 0x7FFFFFFF );
+    } );
+}
+
+TEST_F( ExceptionTableTest, RejectsUnterminatedMessage )
+{
+    expectCorruptCacheReparsed( []( std::string& cache, size_t, size_t, size_t )
+    {
+        cache[cache.size() - 1] = 'x';
+    } );
+}
+
+TEST_F( ExceptionTableTest, RejectsUnknownKind )
+{
+    expectCorruptCacheReparsed( []( std::string& cache, size_t, size_t, size_t rules )
+    {
+        setUInt32( cache, rules + offsetof( ExceptionRule, kind ), 7 );
+    } );
+}
+
+TEST_F( ExceptionTableTest, RejectsTruncatedCache )
+{
+    expectCorruptCacheReparsed( []( std::string& cache, size_t, size_t, size_t )
+    {
+        cache.erase( cache.size() - 1 );
+    } );
+}
+
+TEST_F( ExceptionTableTest, ParsesEachKind )
+{
+    std::string error;
+    ExceptionTable table;
+    ASSERT_TRUE( loadText( "valid aufx aaaa Mfr_ *\n"
+                           "duplicate aufx bbbb Mfr_ * use the MAS version\n"
+                           "incompatible aufx cccc Mfr_ *   crashes on open  # not part of the message\n", table, error ) ) << error;
+
+    const ExceptionRule* valid = table.find( 'aufx', 'aaaa', 'Mfr_', 1 );
+    ASSERT_TRUE( valid != NULL );
+    EXPECT_EQ( uint32_t( kExceptionValid ), valid->kind );
+    EXPECT_TRUE( table.getMessage( *valid ) == NULL );
+
+    const ExceptionRule* duplicate = table.find( 'aufx', 'bbbb', 'Mfr_', 1 );
+    ASSERT_TRUE( duplicate != NULL );
+    EXPECT_EQ( uint32_t( kExceptionDuplicate ), duplicate->kind );
+    EXPECT_STREQ( "use the MAS version", table.getMessage( *duplicate ) );
+
+    const ExceptionRule* incompatible = table.find( 'aufx', 'cccc', 'Mfr_', 1 );
+    ASSERT_TRUE( incompatible != NULL );
+    EXPECT_EQ( uint32_t( kExceptionIncompatible ), incompatible->kind );
+    EXPECT_STREQ( "crashes on open", table.getMessage( *incompatible ) );
+}
+
+TEST_F( ExceptionTableTest, ParsesQuotedAndDecimalCodes )
+{
+    std::string error;
+    ExceptionTable table;
+    ASSERT_TRUE( loadText( "valid 'aufx' 'ab c' 'MVO ' *\n"
+                           "valid aumf 1234 1835430501 *\n"
+                           "valid aumf '1234' 1835430501 *\n", table, error ) ) << error;
+
+    EXPECT_TRUE( table.find( 'aufx', 'ab c', 'MVO ', 1 ) != NULL );
+    EXPECT_TRUE( table.find( 'aumf', 1234, 'mfre', 1 ) != NULL );
+    // quoted, it's the characters rather than the number.
+    EXPECT_TRUE( table.find( 'aumf', '1234', 'mfre', 1 ) != NULL );
+    EXPECT_TRUE( table.find( 'aumf', 1235, 'mfre', 1 ) == NULL );
+}
+
+TEST_F( ExceptionTableTest, ParsesVersionRanges )
+{
+    std::string error;
+    ExceptionTable table;
+    ASSERT_TRUE( loadText( "valid aufx all_ Mfr_ *\n"
+                           "valid aufx one_ Mfr_ 7\n"
+                           "valid aufx atMo Mfr_ <=7\n"
+                           "valid aufx atLe Mfr_ >=7\n"
+                           "valid aufx span Mfr_ 7-9\n", table, error ) ) << error;
+
+    EXPECT_TRUE( table.find( 'aufx', 'all_', 'Mfr_', 0 ) != NULL );
+    EXPECT_TRUE( table.find( 'aufx', 'all_', 'Mfr_', 0xFFFFFFFF ) != NULL );
+
+    EXPECT_TRUE( table.find( 'aufx', 'one_', 'Mfr_', 6 ) == NULL );
+    EXPECT_TRUE( table.find( 'aufx', 'one_', 'Mfr_', 7 ) != NULL );
+    EXPECT_TRUE( table.find( 'aufx', 'one_', 'Mfr_', 8 ) == NULL );
+
+    EXPECT_TRUE( table.find( 'aufx', 'atMo', 'Mfr_', 0 ) != NULL );
+    EXPECT_TRUE( table.find( 'aufx', 'atMo', 'Mfr_', 7 ) != NULL );
+    EXPECT_TRUE( table.find( 'aufx', 'atMo', 'Mfr_', 8 ) == NULL );
+
+    EXPECT_TRUE( table.find( 'aufx', 'atLe', 'Mfr_', 6 ) == NULL );
+    EXPECT_TRUE( table.find( 'aufx', 'atLe', 'Mfr_', 7 ) != NULL );
+    EXPECT_TRUE( table.find( 'aufx', 'atLe', 'Mfr_', 0xFFFFFFFF ) != NULL );
+
+    EXPECT_TRUE( table.find( 'aufx', 'span', 'Mfr_', 6 ) == NULL );
+    EXPECT_TRUE( table.find( 'aufx', 'span', 'Mfr_', 7 ) != NULL );
+    EXPECT_TRUE( table.find( 'aufx', 'span', 'Mfr_', 9 ) != NULL );
+    EXPECT_TRUE( table.find( 'aufx', 'span', 'Mfr_', 10 ) == NULL );
+}
+
+TEST_F( ExceptionTableTest, PicksTheRuleForTheVersion )
+{
+    // out of order in the file, with a gap between the last two.
+    const std::string text = "duplicate aufx abcd Mfr_ >=300 newer\n"
+                             "valid aufx abcd Mfr_ <=99 older\n"
+                             "incompatible aufx abcd Mfr_ 100-199 middle\n"
+                             "valid aufx efgh Mfr_ *\n";
+    std::string error;
+    ExceptionTable parsed;
+    ASSERT_TRUE( loadText( text, parsed, error ) ) << error;
+    ExceptionTable cached;
+    ASSERT_TRUE( cached.load( fPath, error ) ) << error;
+
+    for ( const ExceptionTable* table : { &parsed, &cached } )
+    {
+        const struct { uint32_t version; const char* message; } kExpected[] = {
+            { 0, "older" }, { 99, "older" }, { 100, "middle" }, { 199, "middle" },
+            { 200, NULL }, { 299, NULL }, { 300, "newer" }, { 0xFFFFFFFF, "newer" } };
+        for ( const auto& expected : kExpected )
+        {
+            const ExceptionRule* rule = table->find( 'aufx', 'abcd', 'Mfr_', expected.version );
+            if ( not expected.message )
+            {
+                EXPECT_TRUE( rule == NULL ) << expected.version;
+                continue;
+            }
+            ASSERT_TRUE( rule != NULL ) << expected.version;
+            EXPECT_STREQ( expected.message, table->getMessage( *rule ) ) << expected.version;
+        }
+        EXPECT_TRUE( table->find( 'aufx', 'efgh', 'Mfr_', 200 ) != NULL );
+    }
+}
+
+TEST_F( ExceptionTableTest, RejectsOverlappingVersions )
+{
+    EXPECT_EQ( "line 3: versions overlap line 1's, for the same component",
+               loadError( "valid aufx abcd Mfr_ 100-199\n"
+                          "valid aufx abcd Mfr_ 200-299\n"
+                          "incompatible aufx abcd Mfr_ >=150\n" ) );
+    EXPECT_EQ( "line 2: versions overlap line 1's, for the same component",
+               loadError( "valid aufx abcd Mfr_ *\n"
+                          "valid aufx abcd Mfr_ *\n" ) );
+    EXPECT_EQ( "line 2: versions overlap line 1's, for the same component",
+               loadError( "valid aufx abcd Mfr_ 5\n"
+                          "valid aufx abcd Mfr_ <=5\n" ) );
+}
+
+TEST_F( ExceptionTableTest, ReportsMalformedLines )
+{
+    const std::string kExpectedFields = "expected <kind> <type> <subtype> <manufacturer> <versions> [message]";
+    const struct { const char* text; std::string error; } kCases[] = {
+        { "bogus aufx abcd Mfr_ *\n",                  "line 1: unknown kind (expected valid, duplicate or incompatible)" },
+        { "# comment\n\nvalid aufx abcd Mfr_\n",     "line 3: " + kExpectedFields },
+        { "valid aufx 'ab Mfr_ *\n",                   "line 1: " + kExpectedFields },
+        { "valid aufx abcde Mfr_ *\n",                 "line 1: bad component code" },
+        { "valid aufx 'abc' Mfr_ *\n",                 "line 1: bad component code" },
+        { "valid aufx 4294967296 Mfr_ *\n",            "line 1: bad component code" },
+        { "valid aufx abcd Mfr_ 9-5\n",                "line 1: bad version range" },
+        { "valid aufx abcd Mfr_ <=x\n",                "line 1: bad version range" },
+        { "valid aufx abcd Mfr_ 1.0\n",                "line 1: bad version range" },
+        { "valid aufx abcd Mfr_ 4294967296\n",         "line 1: bad version range" },
+        // the error is for the first bad line, and good lines before it don't save the file.
+        { "valid aufx abcd Mfr_ *\nvalid aufx efgh Mfr_ -\n", "line 2: bad version range" },
+    };
+    for ( const auto& c : kCases )
+        EXPECT_EQ( c.error, loadError( c.text ) ) << c.text;
+
+    EXPECT_EQ( "line 2: too long", loadError( "valid aufx abcd Mfr_ *\nvalid aufx efgh Mfr_ * " + std::string( 1100, 'x' ) + "\n" ) );
+}
+
+TEST( ExceptionRule, AppliesTo )
+{
+    ExceptionRule rule;
+    rule.minVersion = 100;
+    rule.maxVersion = 199;
+    EXPECT_FALSE( rule.appliesTo( 99 ) );
+    EXPECT_TRUE( rule.appliesTo( 100 ) );
+    EXPECT_TRUE( rule.appliesTo( 199 ) );
+    EXPECT_FALSE( rule.appliesTo( 200 ) );
+
+    rule.minVersion = 0;
+    rule.maxVersion = 0xFFFFFFFF;
+    EXPECT_TRUE( rule.appliesTo( 0 ) );
+    EXPECT_TRUE( rule.appliesTo( 0xFFFFFFFF ) );
+}
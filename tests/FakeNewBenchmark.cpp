@@ -0,0 +1,103 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+// Throughput of FakeNew's operator new and delete against malloc and free,
+// on 1, 2, 4 and 8 threads at once.  Each thread keeps a window of live
+// blocks of mixed small sizes (16 to 2048 bytes) and replaces one at random
+// with each operation, the way a plug-in's render and parameter code churns
+// through small objects:
+//
+//     new         ::operator new / ::operator delete (FakeNew's size classes)
+//     malloc      malloc / free
+//
+//     fakenew_benchmark [operations per thread]
+//
+
+#include "FakeNew.h"
+
+#include <chrono>
+#include <new>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const int kWindow = 256;
+
+    // the same sequence of sizes and slots for both allocators.
+    uint32_t nextRandom( uint32_t& state )
+    {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+
+    struct UseNew
+    {
+        static void* allocate( size_t size ) { return ::operator new( size ); }
+        static void deallocate( void* block ) { ::operator delete( block ); }
+    };
+
+    struct UseMalloc
+    {
+        static void* allocate( size_t size ) { return malloc( size ); }
+        static void deallocate( void* block ) { free( block ); }
+    };
+
+    template <class Allocator>
+    void churn( int operations, uint32_t seed )
+    {
+        void* window[kWindow] = {};
+        uint32_t random = seed;
+        for ( int i = 0; i < operations; ++i )
+        {
+            int slot = nextRandom( random ) % kWindow;
+            size_t size = 16 + nextRandom( random ) % 2033;
+            Allocator::deallocate( window[slot] );
+            window[slot] = Allocator::allocate( size );
+            // touch it, as a real owner would.
+            *static_cast<volatile char*>( window[slot] ) = char( i );
+        }
+        for ( void* block : window )
+            Allocator::deallocate( block );
+    }
+
+    // millions of operations a second, across all the threads.
+    template <class Allocator>
+    double throughput( int numThreads, int operations )
+    {
+        Clock::time_point start = Clock::now();
+        std::vector<std::thread> threads;
+        for ( int t = 0; t < numThreads; ++t )
+            threads.push_back( std::thread( churn<Allocator>, operations, uint32_t( t + 1 ) ) );
+        for ( std::thread& thread : threads )
+            thread.join();
+        double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+        return numThreads * double( operations ) / seconds / 1e6;
+    }
+}
+
+int main( int argc, char** argv )
+{
+    int operations = (argc > 1) ? atoi( argv[1] ) : 2000000;
+
+    // the first run on each side pays for committing pages.
+    throughput<UseNew>( 1, operations / 10 );
+    throughput<UseMalloc>( 1, operations / 10 );
+
+    printf( "%-8s %10s %10s\n", "threads", "new", "malloc" );
+    const int kThreads[] = { 1, 2, 4, 8 };
+    for ( int numThreads : kThreads )
+    {
+        printf( "%8d %10.1f %10.1f\n", numThreads,
+                throughput<UseNew>( numThreads, operations ), throughput<UseMalloc>( numThreads, operations ) );
+    }
+    printf( "(millions of operations per second)\n" );
+    return 0;
+}
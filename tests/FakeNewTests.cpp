@@ -0,0 +1,259 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "FakeNew.h"
+#include "gtest/gtest.h"
+
+#include <new>
+#include <set>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // small blocks come from FakeNew's arena, large ones from malloc with a header.
+    const size_t kSmallSize = 24;
+    const size_t kLargeSize = 64 * 1024;
+
+    // the operator functions are called directly, since the compiler is
+    // free to leave out a new and delete expression that it can see match.
+    class FakeNewDiagnostics : public ::testing::TestWithParam<size_t>
+    {
+    protected:
+        virtual void SetUp()
+        {
+            FakeNewEnableDiagnostics( true );
+            fProblemsBefore = FakeNewProblemCount();
+        }
+
+        uint64_t newProblems() const
+        {
+            return FakeNewProblemCount() - fProblemsBefore;
+        }
+
+        FakeNewProblem lastProblem() const
+        {
+            FakeNewProblem problem;
+            EXPECT_TRUE( FakeNewGetProblem( FakeNewProblemCount() - 1, problem ) );
+            return problem;
+        }
+
+        uint64_t fProblemsBefore;
+    };
+}
+
+TEST_P( FakeNewDiagnostics, MatchedDeletesAreQuiet )
+{
+    ::operator delete( ::operator new( GetParam() ) );
+    ::operator delete[]( ::operator new[]( GetParam() ) );
+
+    EXPECT_EQ( 0u, newProblems() );
+}
+
+TEST_P( FakeNewDiagnostics, DeleteArrayOfScalar )
+{
+    void* block = ::operator new( GetParam() );
+    ::operator delete[]( block );
+
+    ASSERT_EQ( 1u, newProblems() );
+    FakeNewProblem problem = lastProblem();
+    EXPECT_EQ( kFakeNewArrayMismatch, problem.kind );
+    EXPECT_EQ( block, problem.address );
+}
+
+TEST_P( FakeNewDiagnostics, DeleteScalarOfArray )
+{
+    void* block = ::operator new[]( GetParam() );
+    ::operator delete( block );
+
+    ASSERT_EQ( 1u, newProblems() );
+    FakeNewProblem problem = lastProblem();
+    EXPECT_EQ( kFakeNewArrayMismatch, problem.kind );
+    EXPECT_EQ( block, problem.address );
+}
+
+TEST_P( FakeNewDiagnostics, DoubleFree )
+{
+    void* block = ::operator new( GetParam() );
+    ::operator delete( block );
+    ::operator delete( block );
+
+    ASSERT_EQ( 1u, newProblems() );
+    FakeNewProblem problem = lastProblem();
+    EXPECT_EQ( kFakeNewDoubleFree, problem.kind );
+    EXPECT_EQ( block, problem.address );
+}
+
+TEST_P( FakeNewDiagnostics, DoubleFreeOfArray )
+{
+    void* block = ::operator new[]( GetParam() );
+    ::operator delete[]( block );
+    ::operator delete[]( block );
+
+    ASSERT_EQ( 1u, newProblems() );
+    EXPECT_EQ( kFakeNewDoubleFree, lastProblem().kind );
+}
+
+TEST_P( FakeNewDiagnostics, DeleteOfMalloc )
+{
+    void* block = malloc( GetParam() );
+    ASSERT_TRUE( block != NULL );
+    ::operator delete( block );
+
+    ASSERT_EQ( 1u, newProblems() );
+    FakeNewProblem problem = lastProblem();
+    EXPECT_EQ( kFakeNewDeleteOfMalloc, problem.kind );
+    EXPECT_EQ( block, problem.address );
+}
+
+// the address is handed out again, so deleting it is fine once more.
+TEST_P( FakeNewDiagnostics, ReusedAddressIsLive )
+{
+    void* block = ::operator new( GetParam() );
+    ::operator delete( block );
+
+    void* again = ::operator new[]( GetParam() );
+    ::operator delete[]( again );
+
+    EXPECT_EQ( 0u, newProblems() );
+}
+
+TEST_P( FakeNewDiagnostics, ProblemHasContext )
+{
+    FakeNewSetContext( "FakeNewDiagnostics.ProblemHasContext" );
+    void* block = ::operator new( GetParam() );
+    ::operator delete[]( block );
+    FakeNewSetContext( NULL );
+
+    ASSERT_EQ( 1u, newProblems() );
+    EXPECT_STREQ( "FakeNewDiagnostics.ProblemHasContext", lastProblem().context );
+}
+
+INSTANTIATE_TEST_CASE_P( BlockSizes, FakeNewDiagnostics, ::testing::Values( kSmallSize, kLargeSize ) );
+
+namespace
+{
+    // the stats of the size class a block of this size comes from.
+    FakeNewClassStats classStats( size_t size )
+    {
+        FakeNewClassStats stats[64];
+        int numClasses = GetFakeNewStats( stats, 64 );
+        for ( int i = 0; i < numClasses and i < 64; ++i )
+        {
+            if ( stats[i].blockSize >= size )
+                return stats[i];
+        }
+        return FakeNewClassStats();
+    }
+
+    // a size class that gtest itself has no use for, so the counts are ours.
+    const size_t kQuietSize = 1000;
+
+    void allocateBlocks( void** blocks, int count, size_t size )
+    {
+        for ( int i = 0; i < count; ++i )
+            blocks[i] = ::operator new( size );
+    }
+}
+
+// without the diagnostics, a second delete has to be ignored rather than put
+// the block on a free list twice, or two owners would get it next.
+TEST( FakeNewAllocator, DoubleFreeWithoutDiagnostics )
+{
+    FakeNewEnableDiagnostics( false );
+    void* block = ::operator new( kSmallSize );
+    ::operator delete( block );
+    ::operator delete( block );
+
+    void* first = ::operator new( kSmallSize );
+    void* second = ::operator new( kSmallSize );
+    EXPECT_NE( first, second );
+    ::operator delete( first );
+    ::operator delete( second );
+    FakeNewEnableDiagnostics( true );
+}
+
+TEST( FakeNewAllocator, StatsBalance )
+{
+    const int kCount = 200;
+    void* blocks[kCount];
+
+    FakeNewClassStats before = classStats( kQuietSize );
+    allocateBlocks( blocks, kCount, kQuietSize );
+    FakeNewClassStats allocated = classStats( kQuietSize );
+    for ( int i = 0; i < kCount; ++i )
+        ::operator delete( blocks[i] );
+    FakeNewClassStats after = classStats( kQuietSize );
+
+    EXPECT_EQ( before.allocations + kCount, allocated.allocations );
+    EXPECT_EQ( before.frees, allocated.frees );
+    EXPECT_EQ( allocated.allocations, after.allocations );
+    EXPECT_EQ( before.frees + kCount, after.frees );
+    EXPECT_EQ( after.blocksFree, before.blocksFree + (after.blocksReserved - before.blocksReserved) );
+}
+
+// blocks freed by a thread other than the one that allocated them go on the
+// freeing thread's list, and back to the central one when that thread exits.
+TEST( FakeNewAllocator, CrossThreadFree )
+{
+    const int kCount = 500;
+    void* blocks[kCount];
+
+    FakeNewClassStats before = classStats( kQuietSize );
+    allocateBlocks( blocks, kCount, kQuietSize );
+    std::thread consumer( [&blocks]()
+    {
+        for ( int i = 0; i < kCount; ++i )
+            ::operator delete( blocks[i] );
+    } );
+    consumer.join();
+    FakeNewClassStats after = classStats( kQuietSize );
+
+    EXPECT_EQ( before.allocations + kCount, after.allocations );
+    EXPECT_EQ( before.frees + kCount, after.frees );
+
+    // and the blocks can be handed out again, each to one owner.
+    allocateBlocks( blocks, kCount, kQuietSize );
+    std::set<void*> distinct( blocks, blocks + kCount );
+    EXPECT_EQ( size_t( kCount ), distinct.size() );
+    for ( int i = 0; i < kCount; ++i )
+        ::operator delete( blocks[i] );
+}
+
+// once a class's region is used up, its blocks come from malloc instead.
+TEST( FakeNewAllocator, FallsBackToMallocWhenRegionIsFull )
+{
+    const size_t kSize = 2048;
+    uint64_t problemsBefore = FakeNewProblemCount();
+    FakeNewClassStats before = classStats( kSize );
+    ASSERT_LT( before.blocksCapacity, 100000u ) << "build FakeNew.cpp with a small FAKENEW_REGION_SIZE to run this";
+
+    const size_t count = before.blocksCapacity + 64;
+    std::vector<void*> blocks( count );
+    allocateBlocks( blocks.data(), int( count ), kSize );
+    FakeNewClassStats full = classStats( kSize );
+
+    EXPECT_EQ( full.blocksCapacity, full.blocksReserved );
+    EXPECT_EQ( 0u, full.blocksFree );
+    uint64_t fromRegion = full.allocations - before.allocations;
+    EXPECT_LT( fromRegion, uint64_t( count ) );
+
+    std::set<void*> distinct;
+    for ( void* block : blocks )
+    {
+        ASSERT_TRUE( block != NULL );
+        memset( block, 0xa5, kSize );
+        distinct.insert( block );
+    }
+    EXPECT_EQ( count, distinct.size() );
+
+    for ( void* block : blocks )
+        ::operator delete( block );
+    EXPECT_EQ( before.frees + fromRegion, classStats( kSize ).frees );
+    EXPECT_EQ( problemsBefore, FakeNewProblemCount() );
+}
@@ -0,0 +1,87 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "AUValGuardedBuffer.h"
+#include "AUValStatus.h"
+#include "gtest/gtest.h"
+
+#include <stdint.h>
+#include <unistd.h>
+
+namespace
+{
+    const size_t kCapacity = 4096 * sizeof( float );
+
+    char* guardPage( const AUValGuardedBuffer& buffer )
+    {
+        const uintptr_t pageSize = uintptr_t( sysconf( _SC_PAGESIZE ) );
+        const uintptr_t end = uintptr_t( static_cast<char*>( buffer.Data() ) + buffer.Size() );
+        return reinterpret_cast<char*>( (end + pageSize - 1) / pageSize * pageSize );
+    }
+}
+
+TEST( AUValGuardedBuffer, PlaceKeepsTheEndAgainstTheGuardPage )
+{
+    AUValGuardedBuffer buffer( kCapacity );
+    EXPECT_EQ( kCapacity, buffer.Size() );
+    char* guard = guardPage( buffer );
+
+    const size_t kSizes[] = { kCapacity, kCapacity / 2, 100 * sizeof( float ), 13, 1 };
+    for ( size_t bytes : kSizes )
+    {
+        char* data = static_cast<char*>( buffer.Place( bytes ) );
+        EXPECT_EQ( data, buffer.Data() );
+        EXPECT_EQ( bytes, buffer.Size() );
+        EXPECT_EQ( 0u, uintptr_t( data ) % 16 ) << bytes;
+        // flush against the guard page, but for the rounding down to the alignment.
+        EXPECT_EQ( guard, guardPage( buffer ) ) << bytes;
+        EXPECT_LT( size_t( guard - (data + bytes) ), 16u ) << bytes;
+        EXPECT_TRUE( buffer.CanariesIntact() ) << bytes;
+    }
+}
+
+TEST( AUValGuardedBuffer, WholeBufferIsWritable )
+{
+    AUValGuardedBuffer buffer( kCapacity );
+    float* samples = static_cast<float*>( buffer.Place( kCapacity ) );
+    for ( size_t i = 0; i < kCapacity / sizeof( float ); ++i )
+        samples[i] = 1.0f;
+    EXPECT_TRUE( buffer.CanariesIntact() );
+}
+
+TEST( AUValGuardedBuffer, CanariesCatchWriteInFront )
+{
+    AUValGuardedBuffer buffer( kCapacity );
+    volatile char* data = static_cast<char*>( buffer.Place( kCapacity / 2 ) );
+    data[-1] = 0;
+    EXPECT_FALSE( buffer.CanariesIntact() );
+
+    // placing it again refills them.
+    buffer.Place( kCapacity / 2 );
+    EXPECT_TRUE( buffer.CanariesIntact() );
+}
+
+// an unaligned size leaves a few canary bytes between the end and the guard page.
+TEST( AUValGuardedBuffer, CanariesCatchWriteJustPastAnUnalignedEnd )
+{
+    AUValGuardedBuffer buffer( kCapacity );
+    volatile char* data = static_cast<char*>( buffer.Place( 13 ) );
+    data[13] = 0;
+    EXPECT_FALSE( buffer.CanariesIntact() );
+}
+
+TEST( AUValGuardedBufferDeathTest, OverrunExitsWithBufferOverrun )
+{
+    // the overrun is reported on stdout, so there's nothing to match on stderr.
+    EXPECT_EXIT(
+        {
+            AUValGuardedBuffer::InstallFaultHandler();
+            AUValGuardedBuffer buffer( kCapacity );
+            volatile char* data = static_cast<char*>( buffer.Place( kCapacity ) );
+            data[kCapacity] = 0;
+        },
+        ::testing::ExitedWithCode( kAUValStatusBufferOverrun ), "" );
+}
@@ -0,0 +1,148 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "FakeNew.h"
+#include "expected.h"
+#include "optional.h"
+#include "gtest/gtest.h"
+
+#include <stdint.h>
+#include <type_traits>
+
+namespace
+{
+    struct Format
+    {
+        double sampleRate;
+        uint32_t channels;
+        uint32_t flags;
+    };
+
+    // not trivially copyable, so it goes through optional's general storage.
+    struct Counted
+    {
+        explicit Counted( int v ) : value(v) { ++sLive; }
+        Counted( const Counted& o ) : value(o.value) { ++sLive; }
+        Counted( Counted&& o ) : value(o.value) { ++sLive; }
+        Counted& operator=( const Counted& o ) { value = o.value; return *this; }
+        ~Counted() { --sLive; }
+
+        int value;
+        static int sLive;
+    };
+    int Counted::sLive = 0;
+
+    // counts operator new calls through FakeNew's profiling.
+    class AllocationCount : public ::testing::Test
+    {
+    protected:
+        virtual void SetUp()
+        {
+            FakeNewEnableProfiling( true );
+            fPreviousPhase = FakeNewSetPhase( 0 );
+            FakeNewResetPhaseStats();
+        }
+
+        virtual void TearDown()
+        {
+            FakeNewSetPhase( fPreviousPhase );
+            FakeNewEnableProfiling( false );
+        }
+
+        uint64_t allocations() const
+        {
+            FakeNewPhaseStats stats;
+            FakeNewGetPhaseStats( 0, stats );
+            return stats.allocations;
+        }
+
+        int fPreviousPhase;
+    };
+
+    expected<Format, int32_t> probe( bool succeed )
+    {
+        if ( not succeed )
+            return make_unexpected( int32_t( -10879 ) );
+        Format format = { 44100, 2, 0 };
+        return format;
+    }
+}
+
+TEST_F( AllocationCount, CountsOperatorNew )
+{
+    ::operator delete( ::operator new( 32 ) );
+    EXPECT_EQ( 1u, allocations() );
+}
+
+TEST_F( AllocationCount, OptionalOfTrivialValue )
+{
+    static_assert( std::is_trivially_copyable<optional<Format> >::value, "should copy like the value" );
+
+    optional<double> empty;
+    optional<double> tail( 0.5 );
+    optional<double> copy( tail );
+    optional<double> moved( std::move( copy ) );
+    empty = 2.0;
+    tail = nullptr;
+    moved = empty;
+
+    EXPECT_FALSE( tail.hasValue() );
+    EXPECT_EQ( 2.0, *moved );
+    EXPECT_EQ( 1.0, tail.valueOr( 1.0 ) );
+
+    Format format = { 48000, 2, 0 };
+    optional<Format> f( format );
+    EXPECT_EQ( 2u, f->channels );
+
+    EXPECT_EQ( 0u, allocations() );
+}
+
+TEST_F( AllocationCount, OptionalOfNonTrivialValue )
+{
+    {
+        optional<Counted> a( Counted( 1 ) );
+        optional<Counted> b;
+        b = a;
+        optional<Counted> c( std::move( b ) );
+        a = nullptr;
+        c = Counted( 3 );
+
+        EXPECT_FALSE( a.hasValue() );
+        EXPECT_EQ( 3, c->value );
+        EXPECT_EQ( 2, Counted::sLive );
+    }
+    EXPECT_EQ( 0, Counted::sLive );
+    EXPECT_EQ( 0u, allocations() );
+}
+
+TEST_F( AllocationCount, Expected )
+{
+    expected<Format, int32_t> good = probe( true );
+    expected<Format, int32_t> bad = probe( false );
+
+    ASSERT_TRUE( good.hasValue() );
+    EXPECT_EQ( 44100, good->sampleRate );
+    ASSERT_FALSE( bad.hasValue() );
+    EXPECT_EQ( -10879, bad.error() );
+    EXPECT_EQ( 0u, bad.valueOr( Format() ).channels );
+
+    expected<Format, int32_t> copy = good;
+    EXPECT_EQ( 2u, copy->channels );
+
+    EXPECT_EQ( 0u, allocations() );
+}
+
+// an error of the same type as the value still reads as an error.
+TEST( Expected, ErrorOfValueType )
+{
+    expected<int32_t, int32_t> value( 5 );
+    expected<int32_t, int32_t> error( make_unexpected( int32_t( 5 ) ) );
+
+    EXPECT_TRUE( value.hasValue() );
+    EXPECT_EQ( 5, *value );
+    EXPECT_FALSE( error.hasValue() );
+    EXPECT_EQ( 5, error.error() );
+}
@@ -0,0 +1,159 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+// What a probe costs when the property it asks for fails, some or all of the
+// time, for each way the validator has had of reporting the failure:
+//
+//     before      the message formatted and std::runtime_error thrown, as
+//                 FailAudioUnitError used to, caught with catch (...)
+//     throw       FailAudioUnitError's AudioUnitError, caught
+//     check       CheckAudioUnitError, which counts the failure and returns
+//     expected    an expected<T, OSStatus>, as the tryGet getters return
+//
+// The "property" is a function that can't be inlined, so only the reporting
+// differs between the four.
+//
+//     probe_error_benchmark [probes]
+//
+
+#include "AudioUnitError.h"
+#include "expected.h"
+
+#include <chrono>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace AudioUnits;
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const int32_t kInvalidProperty = -10879;
+
+    // whether each probe fails, filled in for each failure rate.
+    const int kPattern = 1024;
+    volatile bool gFails[kPattern];
+
+    __attribute__((noinline)) int32_t getProperty( int i, double& value )
+    {
+        if ( gFails[i % kPattern] )
+            return kInvalidProperty;
+        value = i * 0.5;
+        return 0;
+    }
+
+    void failTheOldWay( int32_t error, const FuncDesc& desc )
+    {
+        if ( error != 0 )
+        {
+            char errorStr[500];
+            sprintf( errorStr, "Failure: %s %d %d", desc.name, desc.line, error );
+            throw std::runtime_error( errorStr );
+        }
+    }
+
+    __attribute__((noinline)) expected<double, int32_t> tryGetProperty( int i )
+    {
+        double value;
+        int32_t error = getProperty( i, value );
+        if ( error != 0 )
+            return make_unexpected( error );
+        return value;
+    }
+
+    double before( int probes )
+    {
+        DCL_AU_FUNC(before)
+        double sum = 0;
+        for ( int i = 0; i < probes; ++i )
+        {
+            try
+            {
+                double value;
+                failTheOldWay( getProperty( i, value ), AU_DESC );
+                sum += value;
+            }
+            catch (...)
+            {
+            }
+        }
+        return sum;
+    }
+
+    double thrown( int probes )
+    {
+        DCL_AU_FUNC(thrown)
+        double sum = 0;
+        for ( int i = 0; i < probes; ++i )
+        {
+            try
+            {
+                double value;
+                FailAudioUnitError( getProperty( i, value ), AU_DESC );
+                sum += value;
+            }
+            catch ( const AudioUnitError& )
+            {
+            }
+        }
+        return sum;
+    }
+
+    double checked( int probes )
+    {
+        DCL_AU_FUNC(checked)
+        double sum = 0;
+        for ( int i = 0; i < probes; ++i )
+        {
+            double value;
+            if ( CheckAudioUnitError( getProperty( i, value ), AU_DESC ) )
+                sum += value;
+        }
+        return sum;
+    }
+
+    double returned( int probes )
+    {
+        double sum = 0;
+        for ( int i = 0; i < probes; ++i )
+        {
+            expected<double, int32_t> value = tryGetProperty( i );
+            if ( value.hasValue() )
+                sum += *value;
+        }
+        return sum;
+    }
+
+    volatile double gSink;
+
+    double nanosecondsPerProbe( double (*run)( int ), int probes )
+    {
+        Clock::time_point start = Clock::now();
+        gSink = run( probes );
+        return std::chrono::duration<double, std::nano>( Clock::now() - start ).count() / probes;
+    }
+}
+
+int main( int argc, char** argv )
+{
+    int probes = (argc > 1) ? atoi( argv[1] ) : 200000;
+
+    printf( "%-10s %10s %10s %10s %10s\n", "failing", "before", "throw", "check", "expected" );
+    const int kPercents[] = { 0, 10, 50, 100 };
+    for ( int percent : kPercents )
+    {
+        for ( int i = 0; i < kPattern; ++i )
+            gFails[i] = (i * 37 % 100) < percent;
+
+        printf( "%9d%% %10.1f %10.1f %10.1f %10.1f\n", percent,
+                nanosecondsPerProbe( before, probes ), nanosecondsPerProbe( thrown, probes ),
+                nanosecondsPerProbe( checked, probes ), nanosecondsPerProbe( returned, probes ) );
+    }
+    printf( "(ns per probe)\n" );
+    return 0;
+}
@@ -0,0 +1,95 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+// Compares sorted_vector_map with std::map and std::unordered_map: the time
+// to build a map from unsorted elements with duplicates, and the time per
+// lookup (half hits, half misses), from 10 to 1M elements.
+//
+//     sorted_vector_map_benchmark [max elements]
+//
+
+#include "sorted_vector_map.h"
+
+#include <chrono>
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+    typedef std::pair<uint32_t, uint32_t> Element;
+
+    // enough lookups at every size for the clock to measure.
+    const size_t kLookups = 2000000;
+
+    uint32_t gSeed = 1;
+
+    uint32_t nextRandom()
+    {
+        gSeed ^= gSeed << 13;
+        gSeed ^= gSeed >> 17;
+        gSeed ^= gSeed << 5;
+        return gSeed;
+    }
+
+    double secondsSince( Clock::time_point start )
+    {
+        return std::chrono::duration<double>( Clock::now() - start ).count();
+    }
+
+    // keeps the compiler from dropping work whose result isn't used.
+    volatile uint64_t gSink;
+
+    template <class Map>
+    void measure( const char* name, const std::vector<Element>& elements, const std::vector<uint32_t>& keys )
+    {
+        Clock::time_point start = Clock::now();
+        Map map( elements.begin(), elements.end() );
+        double buildSeconds = secondsSince( start );
+
+        uint64_t sum = 0;
+        start = Clock::now();
+        for ( size_t i = 0; i < keys.size(); ++i )
+        {
+            typename Map::const_iterator found = map.find( keys[i] );
+            if ( found != map.end() )
+                sum += found->second;
+        }
+        double lookupSeconds = secondsSince( start );
+        gSink = sum;
+
+        printf( "  %-20s %12.1f %12.1f\n", name, buildSeconds * 1e9 / elements.size(), lookupSeconds * 1e9 / keys.size() );
+    }
+}
+
+int main( int argc, char** argv )
+{
+    size_t maxElements = (argc > 1) ? size_t( atol( argv[1] ) ) : 1000000;
+
+    for ( size_t n = 10; n <= maxElements; n *= 10 )
+    {
+        // even keys from a range twice the size, so about a quarter of them repeat.
+        std::vector<Element> elements( n );
+        for ( size_t i = 0; i < n; ++i )
+            elements[i] = Element( 2 * (nextRandom() % uint32_t( 2 * n )), uint32_t( i ) );
+
+        // the odd keys are always misses.
+        std::vector<uint32_t> keys( kLookups );
+        for ( size_t i = 0; i < kLookups; ++i )
+            keys[i] = (i % 2) ? elements[nextRandom() % n].first : 2 * (nextRandom() % uint32_t( 2 * n )) + 1;
+
+        char title[32];
+        snprintf( title, sizeof( title ), "%zu elements", n );
+        printf( "%-22s %12s %12s\n", title, "build ns/elt", "lookup ns" );
+        measure<sorted_vector_map<uint32_t, uint32_t> >( "sorted_vector_map", elements, keys );
+        measure<std::map<uint32_t, uint32_t> >( "std::map", elements, keys );
+        measure<std::unordered_map<uint32_t, uint32_t> >( "std::unordered_map", elements, keys );
+    }
+    return 0;
+}
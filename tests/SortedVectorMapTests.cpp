@@ -0,0 +1,144 @@
+//
+// Copyright (c) 2013 MOTU, Inc. All rights reserved.
+// Use of this source code is governed by an MIT-style license that can be
+// found in the LICENSE file.
+//
+
+#include "sorted_vector_map.h"
+#include "gtest/gtest.h"
+
+#include <string.h>
+#include <string>
+
+namespace
+{
+    typedef std::pair<int, std::string> Element;
+    typedef sorted_vector_map<int, std::string> IntMap;
+
+    // compares strings with C strings, without making a std::string of them.
+    struct NameLess
+    {
+        typedef void is_transparent;
+
+        bool operator() ( const std::string& a, const std::string& b ) const { return a < b; }
+        bool operator() ( const std::string& a, const char* b ) const { return strcmp( a.c_str(), b ) < 0; }
+        bool operator() ( const char* a, const std::string& b ) const { return strcmp( a, b.c_str() ) < 0; }
+    };
+
+    std::vector<int> keysOf( const IntMap& map )
+    {
+        std::vector<int> keys;
+        for ( IntMap::const_iterator iter = map.begin(); iter != map.end(); ++iter )
+            keys.push_back( iter->first );
+        return keys;
+    }
+}
+
+TEST( SortedVectorMap, RangeConstructorSortsAndKeepsFirstOfEachKey )
+{
+    const Element elements[] =
+    {
+        Element( 5, "five" ), Element( 1, "one" ), Element( 3, "three" ),
+        Element( 1, "uno" ), Element( 5, "cinq" ), Element( 2, "two" ), Element( 5, "fuenf" )
+    };
+    IntMap map( elements, elements + sizeof( elements ) / sizeof( elements[0] ) );
+
+    const int expected[] = { 1, 2, 3, 5 };
+    EXPECT_EQ( std::vector<int>( expected, expected + 4 ), keysOf( map ) );
+    EXPECT_EQ( "one", map.find( 1 )->second );
+    EXPECT_EQ( "five", map.find( 5 )->second );
+}
+
+TEST( SortedVectorMap, RangeConstructorOfNothing )
+{
+    std::vector<Element> none;
+    IntMap map( none.begin(), none.end() );
+    EXPECT_TRUE( map.empty() );
+    EXPECT_TRUE( map.find( 0 ) == map.end() );
+}
+
+TEST( SortedVectorMap, BulkInsertKeepsExistingElements )
+{
+    IntMap map;
+    map.insert( Element( 2, "two" ) );
+    map.insert( Element( 4, "four" ) );
+
+    std::vector<Element> more;
+    more.push_back( Element( 4, "vier" ) );
+    more.push_back( Element( 3, "three" ) );
+    more.push_back( Element( 1, "one" ) );
+    more.push_back( Element( 3, "drei" ) );
+    map.insert( more.begin(), more.end() );
+
+    const int expected[] = { 1, 2, 3, 4 };
+    EXPECT_EQ( std::vector<int>( expected, expected + 4 ), keysOf( map ) );
+    EXPECT_EQ( "four", map[4] );
+    EXPECT_EQ( "three", map[3] );
+
+    more.assign( 1, Element( 0, "zero" ) );
+    map.insert_range( more.begin(), more.end() );
+    EXPECT_EQ( 5u, map.size() );
+    EXPECT_EQ( 0, map.begin()->first );
+}
+
+TEST( SortedVectorMap, BulkInsertMatchesSingleInserts )
+{
+    std::vector<Element> elements;
+    unsigned int seed = 12345;
+    for ( int i = 0; i < 1000; ++i )
+    {
+        seed = seed * 1103515245 + 12345;
+        elements.push_back( Element( int( (seed >> 16) % 300 ), std::to_string( i ) ) );
+    }
+
+    IntMap bulk( elements.begin(), elements.end() );
+    IntMap single;
+    for ( size_t i = 0; i < elements.size(); ++i )
+        single.insert( elements[i] );
+
+    EXPECT_TRUE( bulk == single );
+}
+
+TEST( SortedVectorMap, AdoptSorted )
+{
+    std::vector<Element> sorted;
+    sorted.push_back( Element( 1, "one" ) );
+    sorted.push_back( Element( 7, "seven" ) );
+
+    IntMap map;
+    map.insert( Element( 3, "three" ) );
+    map.adopt_sorted( std::move( sorted ) );
+
+    EXPECT_EQ( 2u, map.size() );
+    EXPECT_TRUE( map.find( 3 ) == map.end() );
+    EXPECT_EQ( "seven", map.find( 7 )->second );
+}
+
+TEST( SortedVectorMap, HeterogeneousLookup )
+{
+    sorted_vector_map<std::string, int, NameLess> map;
+    map["bass"] = 1;
+    map["drums"] = 2;
+
+    EXPECT_EQ( 2, map.find( "drums" )->second );
+    EXPECT_TRUE( map.find( "keys" ) == map.end() );
+    EXPECT_EQ( 1u, map.count( "bass" ) );
+    EXPECT_EQ( "drums", map.lower_bound( "c" )->first );
+    EXPECT_TRUE( map.upper_bound( "drums" ) == map.end() );
+}
+
+TEST( SortedVectorMap, MoveAndEmplace )
+{
+    IntMap map;
+    EXPECT_TRUE( map.emplace( 2, "two" ).second );
+    EXPECT_FALSE( map.emplace( 2, "deux" ).second );
+    map[int( 1 )] = "one";
+
+    IntMap moved( std::move( map ) );
+    EXPECT_EQ( 2u, moved.size() );
+    EXPECT_EQ( "two", moved.find( 2 )->second );
+
+    IntMap assigned;
+    assigned = std::move( moved );
+    EXPECT_EQ( "one", assigned.find( 1 )->second );
+}